@@ -0,0 +1,962 @@
+#include <CpuRenderer.h>
+#include <Kernel.h>
+#include <IterationBuffer.h>
+#include <OrbitState.h>
+#include <Palette.h>
+#include <Sampling.h>
+#include <utility.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Runs every row kernel on one thread over the same view and reports the
+// raw escape-time throughput, then the time with distance estimation
+static void BenchmarkKernels()
+{
+	const double centerX = -0.5;
+	const double centerY = 0;
+	const double radius = 1.1;
+	const uint32_t width = 1024;
+	const uint32_t height = 1024;
+	const int maxIters = 1500;
+
+	const double pixelSize = 2 * radius / height;
+
+	KernelIsa isas[] = { KernelIsa::Scalar, KernelIsa::AVX2, KernelIsa::AVX512 };
+
+	IterationBuffer reference;
+
+	printf("%-10s %12s %14s %12s %10s\n", "kernel", "time [ms]", "Giters/s", "DE [ms]", "mismatch");
+	for (KernelIsa isa : isas)
+	{
+		if (!IsKernelIsaSupported(isa))
+		{
+			printf("%-10s %12s\n", GetKernelIsaName(isa), "unsupported");
+			continue;
+		}
+
+		RowKernel kernel = GetRowKernel(isa);
+		IterationBuffer buffer(width, height);
+		IterationBuffer estimated(width, height);
+		estimated.SetDistanceEnabled(true);
+
+		KernelRow row;
+		row.x0 = centerX - 0.5 * width * pixelSize + 0.5 * pixelSize;
+		row.dx = pixelSize;
+		row.y0 = centerY + radius - 0.5 * pixelSize;
+		row.dy = -pixelSize;
+		row.x = 0;
+		row.count = width;
+		row.vertical = false;
+		row.stride = 1;
+		row.maxIters = maxIters;
+		row.cardioid = false;
+		row.periodEpsilon = 0;
+
+		auto run = [&](IterationBuffer& out)
+		{
+			KernelStats stats;
+			Timer timer;
+			for (uint32_t j = 0; j < height; j++)
+			{
+				row.y = j;
+				row.iters = out.GetRow(j);
+				row.smooth = out.GetSmoothRow(j);
+				row.distance = out.HasDistance() ? out.GetDistanceRow(j) : nullptr;
+				kernel(row, stats);
+			}
+			return timer.GetElapsedTime<Timer::milliseconds>();
+		};
+
+		double ms = run(buffer);
+		double distanceMs = run(estimated);
+
+		uint64_t iterations = 0;
+		for (uint32_t i : buffer.GetData())
+			iterations += i;
+
+		size_t mismatch = 0;
+		if (reference.GetWidth() == 0)
+			reference = buffer;
+		else
+			for (size_t i = 0; i < buffer.GetData().size(); i++)
+				mismatch += buffer.GetData()[i] != reference.GetData()[i];
+
+		// The derivative must not change the counts
+		for (size_t i = 0; i < buffer.GetData().size(); i++)
+			mismatch += buffer.GetData()[i] != estimated.GetData()[i];
+
+		printf("%-10s %12.1f %14.3f %12.1f %10zu\n", GetKernelIsaName(isa), ms, iterations / (ms * 1e6), distanceMs, mismatch);
+	}
+}
+
+// Runs the kernel of every formula on one thread over a view inside its
+// set, so every lane iterates up to maxIters and Giters/s is the cost of
+// the step alone. relative is to the Mandelbrot kernel on the same ISA, a
+// step of z^n takes more multiplications for every n > 2.
+static void BenchmarkFormulas()
+{
+	struct Variant
+	{
+		Formula formula;
+		int power;
+		double x, y, radius;
+	};
+
+	const Variant variants[] =
+	{
+		{ Formula::Mandelbrot, 2, -0.2, 0, 0.1 },
+		{ Formula::Multibrot, 3, 0, 0, 0.1 },
+		{ Formula::Multibrot, 5, 0, 0, 0.1 },
+		{ Formula::BurningShip, 2, -0.2, -0.05, 0.05 },
+		{ Formula::Tricorn, 2, 0, 0, 0.1 },
+		{ Formula::Julia, 2, 0, 0, 0.1 },
+	};
+
+	const uint32_t width = 512;
+	const uint32_t height = 512;
+	const int maxIters = 500;
+
+	KernelIsa isas[] = { KernelIsa::Scalar, KernelIsa::AVX2, KernelIsa::AVX512 };
+	double mandelbrotRate[3] = {};
+
+	printf("\n%-14s %-10s %12s %14s %10s %10s\n", "formula", "kernel", "time [ms]", "Giters/s", "relative", "mismatch");
+	for (const Variant& variant : variants)
+	{
+		char name[32];
+		if (variant.formula == Formula::Multibrot)
+			snprintf(name, sizeof(name), "%s %d", GetFormulaName(variant.formula), variant.power);
+		else
+			snprintf(name, sizeof(name), "%s", GetFormulaName(variant.formula));
+
+		IterationBuffer reference;
+		for (int k = 0; k < 3; k++)
+		{
+			KernelIsa isa = isas[k];
+			if (!IsKernelIsaSupported(isa))
+				continue;
+
+			const double pixelSize = 2 * variant.radius / height;
+
+			KernelRow row;
+			row.x0 = variant.x - 0.5 * width * pixelSize + 0.5 * pixelSize;
+			row.dx = pixelSize;
+			row.y0 = variant.y + variant.radius - 0.5 * pixelSize;
+			row.dy = -pixelSize;
+			row.x = 0;
+			row.count = width;
+			row.vertical = false;
+			row.stride = 1;
+			row.maxIters = maxIters;
+			row.cardioid = false;
+			row.periodEpsilon = 0;
+			row.distance = nullptr;
+			row.formula = variant.formula;
+			row.power = variant.power;
+			row.juliaX = -0.123;
+			row.juliaY = 0.745;
+
+			RowKernel kernel = GetRowKernel(isa);
+			IterationBuffer buffer(width, height);
+			KernelStats stats;
+			Timer timer;
+			for (uint32_t j = 0; j < height; j++)
+			{
+				row.y = j;
+				row.iters = buffer.GetRow(j);
+				row.smooth = buffer.GetSmoothRow(j);
+				kernel(row, stats);
+			}
+			double ms = timer.GetElapsedTime<Timer::milliseconds>();
+
+			uint64_t iterations = 0;
+			for (uint32_t i : buffer.GetData())
+				iterations += i;
+			double rate = iterations / (ms * 1e6);
+			if (variant.formula == Formula::Mandelbrot)
+				mandelbrotRate[k] = rate;
+
+			size_t mismatch = 0;
+			if (reference.GetWidth() == 0)
+				reference = buffer;
+			else
+				for (size_t i = 0; i < buffer.GetData().size(); i++)
+					mismatch += buffer.GetData()[i] != reference.GetData()[i];
+
+			printf("%-14s %-10s %12.1f %14.3f %10.2f %10zu\n", name, GetKernelIsaName(isa), ms, rate, rate / mandelbrotRate[k], mismatch);
+		}
+	}
+}
+
+// Perturbation with and without linear approximation on deep views
+static void BenchmarkBla()
+{
+	struct Location
+	{
+		const char* x;
+		const char* y;
+		const char* radius;
+	};
+
+	const Location locations[] =
+	{
+		{ "-1.25223118015508028122", "0.03755885941558481655", "3.6e-8" },
+		{ "-0.74656412896776469523", "0.098865810107694587772", "8.2212188006580699331e-12" },
+		{ "-1.7497591451303665", "0.0000000000000001", "1e-40" },
+	};
+
+	CpuRenderer renderer;
+	renderer.SetPrecision(Precision::Perturbation);
+
+	printf("\n%-28s %12s %12s %16s %10s\n", "radius", "plain [ms]", "BLA [ms]", "skipped iters", "mismatch");
+	for (const Location& l : locations)
+	{
+		RenderView view;
+		view.centerX = BigFixed(l.x);
+		view.centerY = BigFixed(l.y);
+		view.radius = BigFixed(l.radius);
+		view.width = 512;
+		view.height = 512;
+		view.maxIters = 20000;
+
+		IterationBuffer plain;
+		IterationBuffer approx;
+
+		renderer.SetBlaEnabled(false);
+		Timer timer;
+		renderer.Render(view, plain);
+		double plainMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		renderer.SetBlaEnabled(true);
+		timer.Restart();
+		renderer.Render(view, approx);
+		double blaMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		size_t mismatch = 0;
+		for (size_t i = 0; i < plain.GetData().size(); i++)
+			mismatch += plain.GetData()[i] != approx.GetData()[i];
+
+		printf("%-28s %12.1f %12.1f %16llu %10zu\n", l.radius, plainMs, blaMs, (unsigned long long)renderer.GetStats().skippedIters, mismatch);
+	}
+}
+
+// Cost of an iteration in every precision tier. The row kernels run on one
+// thread inside the set like in BenchmarkFormulas, relative is to double on
+// the same ISA. Then deep views rendered on one thread in the tiers that
+// reach them, perturbation with and without BLA. Its ns/iter divides by
+// the escape counts, skipped iterations are free. mismatch is against the
+// first row of the view.
+static void BenchmarkPrecision()
+{
+	const uint32_t width = 128;
+	const uint32_t height = 128;
+	const int maxIters = 256;
+	const double pixelSize = 0.2 / height;
+
+	KernelIsa isas[] = { KernelIsa::Scalar, KernelIsa::AVX2, KernelIsa::AVX512 };
+	KernelPrecision precisions[] = { KernelPrecision::Double, KernelPrecision::DoubleDouble, KernelPrecision::QuadDouble };
+
+	printf("\n%-14s %-10s %12s %12s %10s %10s\n", "precision", "kernel", "time [ms]", "ns/iter", "relative", "mismatch");
+	for (KernelIsa isa : isas)
+	{
+		if (!IsKernelIsaSupported(isa))
+			continue;
+
+		IterationBuffer reference;
+		double doubleCost = 0;
+		for (KernelPrecision precision : precisions)
+		{
+			KernelRow row;
+			row.x0 = -0.2 - 0.5 * width * pixelSize + 0.5 * pixelSize;
+			row.dx = pixelSize;
+			row.y0 = 0.1 - 0.5 * pixelSize;
+			row.dy = -pixelSize;
+			row.x = 0;
+			row.count = width;
+			row.vertical = false;
+			row.stride = 1;
+			row.maxIters = maxIters;
+			row.cardioid = false;
+			row.periodEpsilon = 0;
+			row.distance = nullptr;
+
+			RowKernel kernel = GetRowKernel(isa, precision);
+			IterationBuffer buffer(width, height);
+			KernelStats stats;
+			Timer timer;
+			for (uint32_t j = 0; j < height; j++)
+			{
+				row.y = j;
+				row.iters = buffer.GetRow(j);
+				row.smooth = buffer.GetSmoothRow(j);
+				kernel(row, stats);
+			}
+			double ms = timer.GetElapsedTime<Timer::milliseconds>();
+
+			uint64_t iterations = 0;
+			for (uint32_t i : buffer.GetData())
+				iterations += i;
+			double cost = ms * 1e6 / iterations;
+			if (precision == KernelPrecision::Double)
+				doubleCost = cost;
+
+			size_t mismatch = 0;
+			if (reference.GetWidth() == 0)
+				reference = buffer;
+			else
+				for (size_t i = 0; i < buffer.GetData().size(); i++)
+					mismatch += buffer.GetData()[i] != reference.GetData()[i];
+
+			printf("%-14s %-10s %12.1f %12.2f %10.2f %10zu\n", GetKernelPrecisionName(precision), GetKernelIsaName(isa), ms, cost, cost / doubleCost, mismatch);
+		}
+	}
+
+	struct Location
+	{
+		Formula formula;
+		const char* x;
+		const char* y;
+		const char* radius;
+		int maxIters;
+	};
+
+	const Location locations[] =
+	{
+		{ Formula::Mandelbrot, "-1.74975914513036646", "0", "1e-20", 3000 },
+		{ Formula::Tricorn, "-1.999985869918", "0", "1e-25", 3000 },
+	};
+
+	CpuRenderer renderer(1);
+	printf("\n%-14s %-8s %-18s %12s %12s %10s\n", "formula", "radius", "precision", "time [ms]", "ns/iter", "mismatch");
+	for (const Location& l : locations)
+	{
+		RenderView view;
+		view.centerX = BigFixed(l.x);
+		view.centerY = BigFixed(l.y);
+		view.radius = BigFixed(l.radius);
+		view.width = 128;
+		view.height = 128;
+		view.maxIters = l.maxIters;
+
+		uint32_t bits = std::max({ GetPrecisionForScale(view.GetPixelSize()), view.centerX.GetPrecision(), view.centerY.GetPrecision() });
+		view.centerX.SetPrecision(bits);
+		view.centerY.SetPrecision(bits);
+		view.radius.SetPrecision(bits);
+
+		struct Tier
+		{
+			Precision precision;
+			bool bla;
+		};
+		const Tier tiers[] = { { Precision::QuadDouble, false }, { Precision::DoubleDouble, false }, { Precision::Perturbation, false }, { Precision::Perturbation, true } };
+
+		renderer.SetFormula(l.formula);
+		IterationBuffer reference;
+		for (const Tier& tier : tiers)
+		{
+			if (tier.precision == Precision::Perturbation && l.formula != Formula::Mandelbrot)
+				continue;
+
+			renderer.SetPrecision(tier.precision);
+			renderer.SetBlaEnabled(tier.bla);
+			IterationBuffer buffer;
+			Timer timer;
+			renderer.Render(view, buffer);
+			double ms = timer.GetElapsedTime<Timer::milliseconds>();
+
+			uint64_t iterations = 0;
+			for (uint32_t i : buffer.GetData())
+				iterations += i;
+
+			size_t mismatch = 0;
+			if (reference.GetWidth() == 0)
+				reference = buffer;
+			else
+				for (size_t i = 0; i < buffer.GetData().size(); i++)
+					mismatch += buffer.GetData()[i] != reference.GetData()[i];
+
+			char name[32];
+			snprintf(name, sizeof(name), "%s%s", GetPrecisionName(tier.precision), tier.bla ? " + BLA" : "");
+			printf("%-14s %-8s %-18s %12.1f %12.2f %10zu\n", GetFormulaName(l.formula), l.radius, name, ms, ms * 1e6 / iterations, mismatch);
+		}
+	}
+}
+
+// Cardioid/bulb test and periodicity checking against plain iteration
+static void BenchmarkInterior()
+{
+	struct Location
+	{
+		const char* x;
+		const char* y;
+		const char* radius;
+		int maxIters;
+	};
+
+	const Location locations[] =
+	{
+		{ "-0.5", "0", "1.1", 1500 },
+		{ "-0.5", "0", "1.1", 20000 },
+		{ "-0.743643887037151", "0.13182590420533", "0.00002", 5000 },
+		{ "-1.7497591451303665", "0.0000000000000001", "1e-40", 20000 },
+		{ "-1.7548776662466927600495", "0", "1e-18", 4000 },
+	};
+
+	CpuRenderer renderer;
+
+	printf("\n%-22s %8s %12s %12s %10s %10s %10s\n", "radius", "iters", "plain [ms]", "checks [ms]", "cardioid", "periodic", "mismatch");
+	for (const Location& l : locations)
+	{
+		RenderView view;
+		view.centerX = BigFixed(l.x);
+		view.centerY = BigFixed(l.y);
+		view.radius = BigFixed(l.radius);
+		view.width = 512;
+		view.height = 512;
+		view.maxIters = l.maxIters;
+
+		IterationBuffer plain;
+		IterationBuffer checked;
+
+		renderer.SetInteriorChecks(false);
+		Timer timer;
+		renderer.Render(view, plain);
+		double plainMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		renderer.SetInteriorChecks(true);
+		timer.Restart();
+		renderer.Render(view, checked);
+		double checkedMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		size_t mismatch = 0;
+		for (size_t i = 0; i < plain.GetData().size(); i++)
+			mismatch += plain.GetData()[i] != checked.GetData()[i];
+
+		const RenderStats& stats = renderer.GetStats();
+		printf("%-22s %8d %12.1f %12.1f %10llu %10llu %10zu\n", l.radius, l.maxIters, plainMs, checkedMs,
+			(unsigned long long)stats.cardioidRejected, (unsigned long long)stats.periodRejected, mismatch);
+	}
+}
+
+// Mariani-Silver against brute force, the counts have to match exactly
+static void BenchmarkMarianiSilver()
+{
+	struct Location
+	{
+		const char* x;
+		const char* y;
+		const char* radius;
+		int maxIters;
+	};
+
+	const Location locations[] =
+	{
+		{ "-0.5", "0", "1.1", 1500 },
+		{ "-0.75", "0.1", "1.5", 500 },
+		{ "0", "0", "4", 256 },
+		{ "-0.743643887037151", "0.13182590420533", "0.00002", 5000 },
+		{ "-0.16070135", "1.0375665", "0.0001", 3000 },
+		{ "-1.7497591451303665", "0.0000000000000001", "1e-40", 20000 },
+		{ "-1.7548776662466927600495", "0", "1e-18", 4000 },
+	};
+
+	CpuRenderer renderer;
+
+	printf("\n%-22s %8s %12s %12s %10s %10s\n", "radius", "iters", "brute [ms]", "MS [ms]", "filled", "mismatch");
+	for (const Location& l : locations)
+	{
+		RenderView view;
+		view.centerX = BigFixed(l.x);
+		view.centerY = BigFixed(l.y);
+		view.radius = BigFixed(l.radius);
+		view.width = 512;
+		view.height = 512;
+		view.maxIters = l.maxIters;
+
+		IterationBuffer brute;
+		IterationBuffer filled;
+
+		renderer.SetRenderMode(RenderMode::BruteForce);
+		Timer timer;
+		renderer.Render(view, brute);
+		double bruteMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		renderer.SetRenderMode(RenderMode::MarianiSilver);
+		timer.Restart();
+		renderer.Render(view, filled);
+		double filledMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		size_t mismatch = 0;
+		for (size_t i = 0; i < brute.GetData().size(); i++)
+			mismatch += brute.GetData()[i] != filled.GetData()[i];
+
+		double fraction = (double)renderer.GetStats().filledPixels / ((double)view.width * view.height);
+		printf("%-22s %8d %12.1f %12.1f %9.1f%% %10zu\n", l.radius, l.maxIters, bruteMs, filledMs, 100 * fraction, mismatch);
+	}
+}
+
+// Raising maxIters of a finished image continues the kept orbits, against
+// rendering it again at the higher limit. The counts have to match exactly.
+// Mariani-Silver keeps the orbits of filled pixels its own way, so both
+// modes are raised.
+static void BenchmarkRaiseIters()
+{
+	struct Location
+	{
+		const char* x;
+		const char* y;
+		const char* radius;
+		int maxIters;
+		int raisedIters;
+	};
+
+	const Location locations[] =
+	{
+		{ "-0.5", "0", "1.1", 1500, 5000 },
+		{ "-0.743643887037151", "0.13182590420533", "0.00002", 1500, 5000 },
+		{ "-0.7453", "0.1127", "0.0065", 1500, 5000 },
+		{ "-0.16070135", "1.0375665", "0.0001", 1500, 10000 },
+	};
+
+	const RenderMode modes[] = { RenderMode::BruteForce, RenderMode::MarianiSilver };
+
+	CpuRenderer renderer;
+	OrbitState state;
+
+	printf("\n%-22s %-6s %8s %8s %10s %10s %12s %12s %10s\n", "radius", "mode", "iters", "raised", "orbits", "kept [MB]", "render [ms]", "raise [ms]", "mismatch");
+	for (RenderMode mode : modes)
+	{
+		renderer.SetRenderMode(mode);
+		for (const Location& l : locations)
+		{
+			RenderView view;
+			view.centerX = BigFixed(l.x);
+			view.centerY = BigFixed(l.y);
+			view.radius = BigFixed(l.radius);
+			view.width = 512;
+			view.height = 512;
+			view.maxIters = l.maxIters;
+
+			IterationBuffer raised;
+			IterationBuffer rendered;
+
+			renderer.SetOrbitState(&state);
+			renderer.Render(view, raised);
+			size_t orbits = state.GetSize();
+			double keptMB = state.GetMemory() / (1024.0 * 1024.0);
+
+			view.maxIters = l.raisedIters;
+			Timer timer;
+			bool ok = renderer.RaiseMaxIters(view, raised);
+			double raiseMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+			renderer.SetOrbitState(nullptr);
+			timer.Restart();
+			renderer.Render(view, rendered);
+			double renderMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+			size_t mismatch = 0;
+			for (size_t i = 0; i < rendered.GetData().size(); i++)
+				mismatch += !ok || rendered.GetData()[i] != raised.GetData()[i] || rendered.GetSmoothData()[i] != raised.GetSmoothData()[i];
+
+			const char* modeName = mode == RenderMode::MarianiSilver ? "MS" : "brute";
+			printf("%-22s %-6s %8d %8d %10zu %10.2f %12.1f %12.1f %10zu\n", l.radius, modeName, l.maxIters, l.raisedIters, orbits, keptMB, renderMs, raiseMs, mismatch);
+		}
+	}
+}
+
+// Zooms in by wheel sized steps and back out again, the way out should
+// come from the cache
+static void BenchmarkTileCache()
+{
+	const double x = -0.743643887037151;
+	const double y = 0.13182590420533;
+	const uint32_t size = 512;
+	const int steps = 24;
+
+	TileCache cache((size_t)512 << 20);
+	CpuRenderer renderer;
+	renderer.SetTileCache(&cache);
+
+	auto render = [&](int level, IterationBuffer& buffer)
+	{
+		// Centered on the location as far as the level's grid allows
+		double pixelSize = TileCache::GetLevelPixelSize(level);
+		double left = std::round(x / pixelSize - 0.5 * size);
+		double top = std::round(-y / pixelSize - 0.5 * size);
+
+		RenderView view;
+		view.centerX = BigFixed((left + 0.5 * size) * pixelSize);
+		view.centerY = BigFixed(-(top + 0.5 * size) * pixelSize);
+		view.radius = BigFixed(0.5 * size * pixelSize);
+		view.width = size;
+		view.height = size;
+		view.maxIters = 5000;
+
+		Timer timer;
+		renderer.Render(view, buffer);
+		return timer.GetElapsedTime<Timer::milliseconds>();
+	};
+
+	const int firstLevel = -8;
+	std::vector<IterationBuffer> zoomIn(steps);
+	double inMs = 0;
+	for (int i = 0; i < steps; i++)
+	{
+		inMs += render(firstLevel + i, zoomIn[i]);
+	}
+
+	double outMs = 0;
+	uint64_t outHits = 0;
+	uint64_t outTiles = 0;
+	size_t mismatch = 0;
+	for (int i = steps - 1; i >= 0; i--)
+	{
+		IterationBuffer buffer;
+		outMs += render(firstLevel + i, buffer);
+		outHits += renderer.GetStats().cacheHits;
+		outTiles += renderer.GetStats().cacheHits + renderer.GetStats().cacheMisses;
+		for (size_t p = 0; p < buffer.GetData().size(); p++)
+			mismatch += buffer.GetData()[p] != zoomIn[i].GetData()[p];
+	}
+
+	printf("\n%-10s %12s %12s %12s %10s\n", "steps", "in [ms]", "out [ms]", "tiles", "mismatch");
+	printf("%-10d %12.1f %12.1f %5llu/%-6llu %10zu\n", steps, inMs, outMs, (unsigned long long)outHits, (unsigned long long)outTiles, mismatch);
+}
+
+// Colors a 4K buffer from every palette's table, on one thread with each
+// ISA and then with the whole pool
+static void BenchmarkColoring()
+{
+	RenderView view;
+	view.centerX = BigFixed(-0.745428);
+	view.centerY = BigFixed(0.113009);
+	view.radius = BigFixed(0.05);
+	view.width = 3840;
+	view.height = 2160;
+	view.maxIters = 5000;
+
+	CpuRenderer renderer;
+	IterationBuffer buffer;
+	renderer.Render(view, buffer);
+
+	const size_t pixels = (size_t)view.width * view.height;
+	std::vector<uint8_t> reference(pixels * 3);
+	std::vector<uint8_t> rgb(pixels * 3);
+
+	const Palette palettes[] = { Palette::Gradient, Palette::Hsv, Palette::Exponential, Palette::Waves };
+
+	printf("\n%-12s %12s %12s %12s %12s %10s\n", "palette", "table [ms]", "scalar [ms]", "AVX2 [ms]", "pool [ms]", "mismatch");
+	for (Palette palette : palettes)
+	{
+		CpuColorFunction colors = CpuColorFunction::Create(palette);
+
+		Timer timer;
+		colors.Prepare(view.maxIters);
+		double tableMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		colors.SetIsa(KernelIsa::Scalar);
+		timer.Restart();
+		colors.Colorize(buffer.GetRow(0), (uint32_t)pixels, reference.data());
+		double scalarMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		double avx2Ms = 0;
+		size_t mismatch = 0;
+		if (IsKernelIsaSupported(KernelIsa::AVX2))
+		{
+			colors.SetIsa(KernelIsa::AVX2);
+			timer.Restart();
+			colors.Colorize(buffer.GetRow(0), (uint32_t)pixels, rgb.data());
+			avx2Ms = timer.GetElapsedTime<Timer::milliseconds>();
+			for (size_t i = 0; i < rgb.size(); i++)
+				mismatch += rgb[i] != reference[i];
+		}
+
+		colors.SetIsa(GetBestKernelIsa());
+		timer.Restart();
+		renderer.GetPool().ParallelFor(view.height, [&](size_t j)
+		{
+			colors.Colorize(buffer.GetRow((uint32_t)j), view.width, rgb.data() + j * view.width * 3);
+		});
+		double poolMs = timer.GetElapsedTime<Timer::milliseconds>();
+		for (size_t i = 0; i < rgb.size(); i++)
+			mismatch += rgb[i] != reference[i];
+
+		printf("%-12s %12.2f %12.2f %12.2f %12.2f %10zu\n", GetPaletteName(palette), tableMs, scalarMs, avx2Ms, poolMs, mismatch);
+	}
+}
+
+// Anti aliased renders of mostly exterior views, every pixel sampled
+// against the samples placed by distance. The error is the mean difference
+// per channel to the uniform image.
+static void BenchmarkSampling()
+{
+	struct View
+	{
+		const char* name;
+		double x, y, radius;
+		int maxIters;
+	};
+
+	const View views[] =
+	{
+		{ "full", -0.5, 0, 1.3, 1000 },
+		{ "filaments", -0.10109636384562, 0.95628651080914, 0.01, 2000 },
+		{ "antenna", -1.76, 0.0, 0.05, 2000 },
+	};
+
+	const uint32_t width = 640;
+	const uint32_t height = 360;
+	const uint32_t samples = 16;
+
+	CpuRenderer renderer;
+
+	printf("\n%-10s %12s %12s %12s %10s %10s\n", "view", "uniform [ms]", "adaptive [ms]", "samples/px", "filled", "error");
+	for (const View& v : views)
+	{
+		RenderView view;
+		view.centerX = BigFixed(v.x);
+		view.centerY = BigFixed(v.y);
+		view.radius = BigFixed(v.radius);
+		view.width = width;
+		view.height = height;
+		view.maxIters = v.maxIters;
+
+		CpuColorFunction colors = CpuColorFunction::Create(Palette::Gradient);
+		colors.Prepare(view.maxIters);
+
+		SamplingOptions options;
+		options.maxSamples = samples;
+
+		std::vector<uint8_t> uniform;
+		options.adaptive = false;
+		Timer timer;
+		RenderAntialiased(renderer, view, 0, 0, width, height, colors, options, uniform);
+		double uniformMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		std::vector<uint8_t> adaptive;
+		options.adaptive = true;
+		timer.Restart();
+		SamplingStats stats = RenderAntialiased(renderer, view, 0, 0, width, height, colors, options, adaptive);
+		double adaptiveMs = timer.GetElapsedTime<Timer::milliseconds>();
+
+		double error = 0;
+		for (size_t i = 0; i < uniform.size(); i++)
+			error += std::abs((int)uniform[i] - (int)adaptive[i]);
+		error /= uniform.size();
+
+		double pixels = (double)width * height;
+		printf("%-10s %12.1f %12.1f %12.2f %9.1f%% %10.3f\n", v.name, uniformMs, adaptiveMs, stats.samples / pixels, 100 * stats.filledPixels / pixels, error);
+	}
+}
+
+// Canonical views rendered the way the viewer does, reported as JSON so
+// runs of different builds can be compared
+struct SuiteOptions
+{
+	std::string jsonPath;
+	size_t threads = 0;
+	int repeat = 3;
+	bool quick = false;
+};
+
+struct SuiteResult
+{
+	const char* view;
+	uint32_t width;
+	uint32_t height;
+	int maxIters;
+	Precision precision;
+	double wallSeconds;
+	// Escape counts summed over the pixels, what a plain renderer iterates
+	uint64_t iterations;
+	std::vector<double> utilization;
+};
+
+static std::vector<SuiteResult> RunSuite(const SuiteOptions& options)
+{
+	struct View
+	{
+		const char* name;
+		const char* x;
+		const char* y;
+		const char* radius;
+	};
+
+	const View views[] =
+	{
+		{ "full", "-0.5", "0", "1.1" },
+		{ "seahorse", "-0.745428", "0.113009", "3.0e-5" },
+		{ "deep", "-0.74656412896776469523", "0.098865810107694587772", "8.2212188006580699331e-12" },
+		{ "interior", "-0.2", "0.05", "0.25" },
+	};
+
+	struct Size
+	{
+		uint32_t width;
+		uint32_t height;
+	};
+
+	std::vector<Size> sizes = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+	std::vector<int> maxIters = { 1000, 10000 };
+	if (options.quick)
+	{
+		sizes.resize(1);
+		maxIters.resize(1);
+	}
+
+	CpuRenderer renderer(options.threads);
+	IterationBuffer buffer;
+	std::vector<SuiteResult> results;
+
+	printf("\n%-10s %11s %8s %13s %12s %14s %14s %8s\n", "view", "size", "iters", "precision", "wall [ms]", "Giters/s", "Mpixels/s", "busy");
+	for (const View& v : views)
+	{
+		for (const Size& size : sizes)
+		{
+			for (int iters : maxIters)
+			{
+				RenderView view;
+				view.centerX = BigFixed(v.x);
+				view.centerY = BigFixed(v.y);
+				view.radius = BigFixed(v.radius);
+				view.width = size.width;
+				view.height = size.height;
+				view.maxIters = iters;
+
+				uint32_t bits = std::max({ GetPrecisionForScale(view.GetPixelSize()), view.centerX.GetPrecision(), view.centerY.GetPrecision() });
+				view.centerX.SetPrecision(bits);
+				view.centerY.SetPrecision(bits);
+				view.radius.SetPrecision(bits);
+
+				// Best of the repeats, the first one also pays for the
+				// reference orbit
+				SuiteResult result{ v.name, size.width, size.height, iters, renderer.ResolvePrecision(view), 0, 0, {} };
+				for (int r = 0; r < options.repeat; r++)
+				{
+					renderer.GetPool().ResetBusyTimes();
+					Timer timer;
+					renderer.Render(view, buffer);
+					double seconds = timer.GetElapsedTime<Timer::seconds>();
+
+					if (r > 0 && seconds >= result.wallSeconds)
+						continue;
+
+					result.wallSeconds = seconds;
+					result.utilization.clear();
+					for (double busy : renderer.GetPool().GetBusyTimes())
+						result.utilization.push_back(busy / seconds);
+				}
+
+				for (uint32_t i : buffer.GetData())
+					result.iterations += i;
+
+				// Of the workers, the calling thread mostly waits
+				double busy = 0;
+				for (size_t t = 0; t + 1 < result.utilization.size(); t++)
+					busy += result.utilization[t];
+
+				char sizeText[32];
+				snprintf(sizeText, sizeof(sizeText), "%ux%u", size.width, size.height);
+				printf("%-10s %11s %8d %13s %12.1f %14.3f %14.2f %7.0f%%\n", v.name, sizeText, iters,
+					GetPrecisionName(result.precision), result.wallSeconds * 1e3,
+					result.iterations / result.wallSeconds * 1e-9, (double)size.width * size.height / result.wallSeconds * 1e-6,
+					100 * busy / renderer.GetPool().GetThreadCount());
+				results.push_back(result);
+			}
+		}
+	}
+	return results;
+}
+
+static bool WriteSuiteJson(const std::string& path, const std::vector<SuiteResult>& results, size_t threads)
+{
+	FILE* file = path == "-" ? stdout : fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "{\n  \"threads\": %zu,\n  \"isa\": \"%s\",\n  \"results\": [\n", threads, GetKernelIsaName(GetBestKernelIsa()));
+	for (size_t r = 0; r < results.size(); r++)
+	{
+		const SuiteResult& result = results[r];
+		double pixels = (double)result.width * result.height;
+		fprintf(file, "    { \"view\": \"%s\", \"width\": %u, \"height\": %u, \"maxIters\": %d, \"precision\": \"%s\", ",
+			result.view, result.width, result.height, result.maxIters, GetPrecisionName(result.precision));
+		fprintf(file, "\"wallSeconds\": %.6f, \"iterations\": %llu, \"itersPerSecond\": %.0f, \"pixelsPerSecond\": %.0f, \"threadUtilization\": [",
+			result.wallSeconds, (unsigned long long)result.iterations, result.iterations / result.wallSeconds, pixels / result.wallSeconds);
+		for (size_t t = 0; t < result.utilization.size(); t++)
+			fprintf(file, "%s%.3f", t > 0 ? ", " : "", result.utilization[t]);
+		fprintf(file, "] }%s\n", r + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+
+	bool ok = !ferror(file);
+	if (file != stdout)
+		ok = fclose(file) == 0 && ok;
+	return ok;
+}
+
+static void PrintUsage()
+{
+	printf(
+		"usage: Benchmark [options]\n"
+		"  without options the renderer's techniques are compared against each other\n"
+		"  --suite             render the canonical views instead\n"
+		"  --json FILE         write the suite's results as JSON, - for stdout. Thread\n"
+		"                      utilization lists the workers, then the calling thread\n"
+		"  --threads N         render threads, 0 for all (0)\n"
+		"  --repeat N          renders per view, the fastest counts (3)\n"
+		"  --quick             only the smallest size and maxIters\n");
+}
+
+int main(int argc, char** argv)
+{
+	bool suite = false;
+	SuiteOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--suite")
+			suite = true;
+		else if (arg == "--json" && i + 1 < argc)
+			options.jsonPath = argv[++i];
+		else if (arg == "--threads" && i + 1 < argc)
+			options.threads = (size_t)std::atoi(argv[++i]);
+		else if (arg == "--repeat" && i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+			options.repeat = std::atoi(argv[++i]);
+		else if (arg == "--quick")
+			options.quick = true;
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (suite || !options.jsonPath.empty())
+	{
+		std::vector<SuiteResult> results = RunSuite(options);
+		size_t threads = results.empty() ? 0 : results[0].utilization.size() - 1;
+		if (!options.jsonPath.empty() && !WriteSuiteJson(options.jsonPath, results, threads))
+		{
+			fprintf(stderr, "Writing %s failed\n", options.jsonPath.c_str());
+			return 1;
+		}
+		return 0;
+	}
+
+	BenchmarkKernels();
+	BenchmarkFormulas();
+	BenchmarkBla();
+	BenchmarkPrecision();
+	BenchmarkInterior();
+	BenchmarkMarianiSilver();
+	BenchmarkRaiseIters();
+	BenchmarkTileCache();
+	BenchmarkColoring();
+	BenchmarkSampling();
+}
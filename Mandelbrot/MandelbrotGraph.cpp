@@ -3,43 +3,182 @@
 #include <string>
 #include <fstream>
 #include <streambuf>
+#include <algorithm>
+
+// How often the render thread hands finished rows to Draw
+static const std::chrono::milliseconds PublishInterval(10);
+// Of the CPU anti aliasing, the center one included
+static const uint32_t MaxCpuSamples = 100;
 
 static const sf::BlendMode BlendAlpha(sf::BlendMode::SrcAlpha, sf::BlendMode::OneMinusSrcAlpha, sf::BlendMode::Add,
 	sf::BlendMode::Zero, sf::BlendMode::One, sf::BlendMode::Add);
 static const sf::BlendMode BlendIgnoreAlpha(sf::BlendMode::One, sf::BlendMode::Zero, sf::BlendMode::Add,
 	sf::BlendMode::Zero, sf::BlendMode::One, sf::BlendMode::Add);
 
+static void CopyRow(const IterationBuffer& from, IterationBuffer& to, uint32_t y)
+{
+	std::copy_n(from.GetRow(y), from.GetWidth(), to.GetRow(y));
+	std::copy_n(from.GetSmoothRow(y), from.GetWidth(), to.GetSmoothRow(y));
+	if (from.HasDistance() && to.HasDistance())
+		std::copy_n(from.GetDistanceRow(y), from.GetWidth(), to.GetDistanceRow(y));
+}
+
+// The nearest pixel of from for every pixel of to, which is resized to its
+// view. Pixels past the edges of from take the closest ones it has.
+static void Resample(const IterationBuffer& from, const RenderView& fromView, IterationBuffer& to, const RenderView& toView)
+{
+	// Only the difference of the centers has to be exact, it is small where
+	// the centers are not
+	double fromPixel = fromView.GetPixelSize();
+	double scale = toView.GetPixelSize() / fromPixel;
+	double offsetX = (toView.centerX - fromView.centerX).ToDouble() / fromPixel;
+	double offsetY = (toView.centerY - fromView.centerY).ToDouble() / fromPixel;
+
+	to.Resize(toView.width, toView.height);
+	for (uint32_t y = 0; y < toView.height; y++)
+	{
+		// Rows go down while y goes up
+		double fy = 0.5 * fromView.height - offsetY + (y + 0.5 - 0.5 * toView.height) * scale;
+		uint32_t sy = (uint32_t)std::clamp(fy, 0.0, fromView.height - 1.0);
+		for (uint32_t x = 0; x < toView.width; x++)
+		{
+			double fx = 0.5 * fromView.width + offsetX + (x + 0.5 - 0.5 * toView.width) * scale;
+			uint32_t sx = (uint32_t)std::clamp(fx, 0.0, fromView.width - 1.0);
+			to.At(x, y) = from.At(sx, sy);
+			to.SmoothAt(x, y) = from.SmoothAt(sx, sy);
+		}
+	}
+}
+
 
 MandelbrotGraph::MandelbrotGraph()
 	: m_pos(0, 0)
 	, m_size(100, 100)
-	, m_radius(2)
-	, m_center(0, 0)
+	, m_radius(2.0)
+	, m_centerX(0.0)
+	, m_centerY(0.0)
 	, m_mousePressed(false)
 	, m_maxIters(2048)
+	, m_autoIters(false)
+	, m_itersPending(false)
+	, m_raiseIters(0)
+	, m_level(LevelCount)
+	, m_progressive(true)
+	, m_frameBudget(8.0)
+	, m_gpuNsPerPixel(1.0)
+	, m_mask(0)
+	, m_minSamples(8)
+	, m_cpuIterations(false)
+	, m_recolor(false)
+	, m_shift(0, 0)
+	, m_panRemainder(0, 0)
+	, m_backend(Backend::GPU)
+	, m_distanceSampling(false)
+	, m_pendingShift(0, 0)
+	, m_generation(0)
+	, m_jobComputedPixels(0)
+	, m_shiftDone(0, 0)
+	, m_chosenIters(0)
+	, m_raisedIters(0)
+	, m_samplePass(0)
+	, m_sampleActive(0)
+	, m_frameCount(0)
+	, m_stage(Stage::Other)
+	, m_lastDrawEnd(std::chrono::steady_clock::now())
+	, m_overlayFont(nullptr)
+	, m_showOverlay(false)
 {
 	printf("OpenGL version supported by this platform (%s): \n", glGetString(GL_VERSION));
+	m_cpuRenderer.SetCancelFlag(&m_renderThread.GetCancelFlag());
 
 	std::ifstream file("rsc/mandelbrot.frag");
 	m_coreShader = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 
+	std::ifstream colorFile("rsc/color.frag");
+	m_colorShaderCore = std::string((std::istreambuf_iterator<char>(colorFile)), std::istreambuf_iterator<char>());
+
+	LoadIterationShader();
+
+	glGenBuffers(1, &m_statsBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+	SetInteriorChecks(true);
+
+	std::ifstream maskFile("rsc/mask.frag");
+	std::string maskShader((std::istreambuf_iterator<char>(maskFile)), std::istreambuf_iterator<char>());
+	if (!m_maskShader.loadFromMemory("#version 460\n\n" + maskShader, sf::Shader::Fragment))
+		std::cout << "Error loading shader\n";
+
 	SetColorFunc(ColorFunction("vec3 get_color(int i) { return vec3(1, 1, 1); }"));
+
+	// Set default uniforms
+	SetSize(m_size);
+	SetMaxIters(m_maxIters);
 }
 
 MandelbrotGraph::MandelbrotGraph(const ColorFunction& colorFunc)
 	: m_pos(0, 0)
 	, m_size(100, 100)
-	, m_radius(2)
-	, m_center(0, 0)
+	, m_radius(2.0)
+	, m_centerX(0.0)
+	, m_centerY(0.0)
 	, m_mousePressed(false)
 	, m_maxIters(2048)
+	, m_autoIters(false)
+	, m_itersPending(false)
+	, m_raiseIters(0)
+	, m_level(LevelCount)
+	, m_progressive(true)
+	, m_frameBudget(8.0)
+	, m_gpuNsPerPixel(1.0)
+	, m_mask(0)
+	, m_minSamples(8)
+	, m_cpuIterations(false)
+	, m_recolor(false)
+	, m_shift(0, 0)
+	, m_panRemainder(0, 0)
+	, m_backend(Backend::GPU)
+	, m_distanceSampling(false)
+	, m_pendingShift(0, 0)
+	, m_generation(0)
+	, m_jobComputedPixels(0)
+	, m_shiftDone(0, 0)
+	, m_chosenIters(0)
+	, m_raisedIters(0)
+	, m_samplePass(0)
+	, m_sampleActive(0)
+	, m_frameCount(0)
+	, m_stage(Stage::Other)
+	, m_lastDrawEnd(std::chrono::steady_clock::now())
+	, m_overlayFont(nullptr)
+	, m_showOverlay(false)
 {
 	printf("OpenGL version supported by this platform (%s): \n", glGetString(GL_VERSION));
+	m_cpuRenderer.SetCancelFlag(&m_renderThread.GetCancelFlag());
 
 	std::ifstream file("rsc/mandelbrot.frag");
 	m_coreShader = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 
+	std::ifstream colorFile("rsc/color.frag");
+	m_colorShaderCore = std::string((std::istreambuf_iterator<char>(colorFile)), std::istreambuf_iterator<char>());
+
+	LoadIterationShader();
+
+	glGenBuffers(1, &m_statsBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+	SetInteriorChecks(true);
+
+	std::ifstream maskFile("rsc/mask.frag");
+	std::string maskShader((std::istreambuf_iterator<char>(maskFile)), std::istreambuf_iterator<char>());
+	if (!m_maskShader.loadFromMemory("#version 460\n\n" + maskShader, sf::Shader::Fragment))
+		std::cout << "Error loading shader\n";
+
 	SetColorFunc(colorFunc);
+
+	// Set default uniforms
+	SetSize(m_size);
+	SetMaxIters(m_maxIters);
 }
 
 void MandelbrotGraph::Resize()
@@ -51,8 +190,12 @@ void MandelbrotGraph::UpdateRange()
 {
 	double aspect = (double)m_size.x / (double)m_size.y;
 
-	m_yRange = { m_center.y - m_radius, m_center.y + m_radius };
-	m_xRange = { m_center.x - aspect * m_radius, m_center.x + aspect * m_radius };
+	double centerX = m_centerX.ToDouble();
+	double centerY = m_centerY.ToDouble();
+	double radius = m_radius.ToDouble();
+
+	m_yRange = { centerY - radius, centerY + radius };
+	m_xRange = { centerX - aspect * radius, centerX + aspect * radius };
 
 	uint shader_handle = m_shader.getNativeHandle();
 	glUseProgram(shader_handle);
@@ -63,7 +206,68 @@ void MandelbrotGraph::UpdateRange()
 	glUniform2d(xRange_loc, m_xRange.x, m_xRange.y);
 	glUniform2d(yRange_loc, m_yRange.x, m_yRange.y);
 
-	m_frame = 0;
+	GLint eps_loc = glGetUniformLocation(shader_handle, "periodEpsilon");
+	glUniform1d(eps_loc, CpuRenderer::GetPeriodEpsilon(GetPixelSize()));
+}
+
+// The formula goes into the source, a new shader needs every uniform again
+void MandelbrotGraph::LoadIterationShader()
+{
+	Formula formula = m_cpuRenderer.GetFormula();
+
+	std::stringstream ss;
+	ss << "#version 460\n\n";
+	ss << "#define FORMULA " << (int)formula << '\n';
+	ss << "#define POWER " << (formula == Formula::Multibrot ? m_cpuRenderer.GetMultibrotPower() : 2) << "\n\n";
+	ss << m_coreShader;
+
+	if (!m_shader.loadFromMemory(ss.str(), sf::Shader::Fragment))
+		std::cout << "Error loading shader\n";
+
+	uint shader_handle = m_shader.getNativeHandle();
+	glUseProgram(shader_handle);
+
+	GLint size_loc = glGetUniformLocation(shader_handle, "size");
+	glUniform2ui(size_loc, m_size.x, m_size.y);
+
+	GLint julia_loc = glGetUniformLocation(shader_handle, "juliaC");
+	glUniform2d(julia_loc, m_cpuRenderer.GetJuliaX(), m_cpuRenderer.GetJuliaY());
+
+	m_shader.setUniform("maxIters", m_maxIters);
+	m_shader.setUniform("interiorChecks", m_cpuRenderer.GetInteriorChecks());
+	UpdateRange();
+}
+
+// Enough bits for the center to address single pixels
+void MandelbrotGraph::UpdatePrecision()
+{
+	uint32_t bits = GetPrecisionForScale(GetPixelSize());
+	m_centerX.SetPrecision(bits);
+	m_centerY.SetPrecision(bits);
+	m_radius.SetPrecision(bits);
+}
+
+// Moves the view onto the nearest level of the tile cache, only whole
+// pixels away from the tile corners
+void MandelbrotGraph::SnapToCacheGrid()
+{
+	if (!IsTileCacheEnabled() || m_cpuRenderer.ResolvePrecision(GetRenderView()) != Precision::Double)
+		return;
+
+	int level = (int)std::lround(-std::log2(GetPixelSize()) * TileCache::LevelsPerOctave);
+	double pixelSize = TileCache::GetLevelPixelSize(level);
+	double left = std::round((m_centerX.ToDouble() - 0.5 * m_size.x * GetPixelSize()) / pixelSize);
+	double top = std::round(-(m_centerY.ToDouble() + m_radius.ToDouble()) / pixelSize);
+
+	uint32_t bits = GetPrecisionForScale(pixelSize);
+	m_radius = BigFixed(0.5 * m_size.y * pixelSize, bits);
+	m_centerX = BigFixed((left + 0.5 * m_size.x) * pixelSize, bits);
+	m_centerY = BigFixed(-(top + 0.5 * m_size.y) * pixelSize, bits);
+}
+
+double MandelbrotGraph::GetPixelSize() const
+{
+	return 2.0 * m_radius.ToDouble() / m_size.y;
 }
 
 std::pair<ui::Vec2d, ui::Vec2d> MandelbrotGraph::GetRange()
@@ -97,11 +301,27 @@ void MandelbrotGraph::SetPosition(const ui::Vec2d& pos)
 
 void MandelbrotGraph::SetSize(const ui::Vec2u& size)
 {
+	StopCpuJob();
 	m_size = size;
 
 	m_target.create(m_size.x, m_size.y);
+	m_sampleTarget.create(m_size.x, m_size.y);
+	m_maskTargets[0].create(m_size.x, m_size.y);
+	m_maskTargets[1].create(m_size.x, m_size.y);
+	m_sampleTexture.create(m_size.x, m_size.y);
+	m_sampleMaskTexture.create(m_size.x, m_size.y);
 	m_frame = 0;
 
+	for (int i = 0; i < LevelCount; i++)
+	{
+		Level& level = m_levels[i];
+		level.scale = 1 << (LevelCount - 1 - i);
+		level.size = ui::Vec2u((m_size.x + level.scale - 1) / level.scale, (m_size.y + level.scale - 1) / level.scale);
+		level.target.create(level.size.x, level.size.y);
+		level.texture.create(level.size.x, level.size.y);
+		level.rows.assign(level.size.y, RowPending);
+	}
+
 	m_shape.setSize((ui::Vec2f)m_size);
 
 	uint shader_handle = m_shader.getNativeHandle();
@@ -110,50 +330,109 @@ void MandelbrotGraph::SetSize(const ui::Vec2u& size)
 	GLint size_loc = glGetUniformLocation(shader_handle, "size");
 	glUniform2ui(size_loc, m_size.x, m_size.y);
 
+	SnapToCacheGrid();
 	UpdateRange();
 }
 
 void MandelbrotGraph::SetMaxIters(int maxIters)
+{
+	bool finished = m_cpuIterations && m_level == LevelCount && m_pendingShift == sf::Vector2i(0, 0) && !m_itersPending;
+	if (finished && maxIters > m_maxIters && m_raiseIters == 0 && !m_distanceSampling)
+	{
+		SubmitRaise(maxIters);
+		return;
+	}
+
+	m_raiseIters = 0;
+	ApplyMaxIters(maxIters);
+	m_frame = 0;
+}
+
+int MandelbrotGraph::GetMaxIters() const
+{
+	return m_maxIters;
+}
+
+void MandelbrotGraph::SetAutoIters(bool enabled)
+{
+	// The limit stays as it is when turned off
+	if (enabled == m_autoIters)
+		return;
+
+	m_autoIters = enabled;
+	if (enabled)
+		m_frame = 0;
+}
+
+bool MandelbrotGraph::IsAutoIters() const
+{
+	return m_autoIters;
+}
+
+// Without starting over, for a limit picked for the render in progress
+void MandelbrotGraph::ApplyMaxIters(int maxIters)
 {
 	m_maxIters = maxIters;
 	m_shader.setUniform("maxIters", m_maxIters);
-	m_frame = 0;
+	m_colorShader.setUniform("maxIters", m_maxIters);
 }
 
 void MandelbrotGraph::Update(const sf::RenderWindow& window)
 {
 	if (m_mousePressed)
 	{
-		ui::Vec2d mousePos = MapCoordsToPos((ui::Vec2d)sf::Mouse::getPosition(window));
-		ui::Vec2d delta = MapCoordsToPos(m_startPos) - mousePos;
+		ui::Vec2d mousePos = (ui::Vec2d)sf::Mouse::getPosition(window);
+		Pan(m_startPos - mousePos);
 
-		m_center += delta;
+		m_startPos = mousePos;
+	}
+}
 
-		m_startPos = (ui::Vec2d)sf::Mouse::getPosition(window);
+void MandelbrotGraph::Pan(const ui::Vec2d& pixels)
+{
+	// Only whole pixels are applied, that keeps the existing image aligned
+	// with the new view and deep views do not lose precision
+	m_panRemainder.x += pixels.x;
+	m_panRemainder.y += pixels.y;
+	double dx = std::round(m_panRemainder.x);
+	double dy = std::round(m_panRemainder.y);
+	m_panRemainder.x -= dx;
+	m_panRemainder.y -= dy;
+
+	if (dx == 0 && dy == 0)
+		return;
+
+	double pixelSize = GetPixelSize();
+	uint32_t bits = m_centerX.GetPrecision();
+	m_centerX += BigFixed(dx * pixelSize, bits);
+	m_centerY -= BigFixed(dy * pixelSize, bits);
 
-		UpdateRange();
+	UpdateRange();
 
-		m_frame = 0;
-	}
+	// The image moves against the view
+	m_shift.x -= (int)dx;
+	m_shift.y -= (int)dy;
 }
 
 void MandelbrotGraph::CheckInput(const sf::RenderWindow& window, ui::Event& e)
 {
 	if (e.type == sf::Event::MouseWheelMoved)
 	{
-		m_radius /= std::pow(1.1f, e.mouseWheel.delta);
-
-		// Zoom where the mouse is
-		ui::Vec2d iMousePos = MapCoordsToPos((ui::Vec2d)sf::Mouse::getPosition(window));
-
-		UpdateRange();
+		double oldPixelSize = GetPixelSize();
 
-		ui::Vec2d fMousePos = MapCoordsToPos((ui::Vec2d)sf::Mouse::getPosition(window));
+		m_radius /= std::pow(1.1, e.mouseWheel.delta);
+		UpdatePrecision();
 
-		ui::Vec2d delta = fMousePos - iMousePos;
+		// Zoom where the mouse is
+		ui::Vec2d mouseOffset = (ui::Vec2d)sf::Mouse::getPosition(window) - m_pos - ui::Vec2d(m_size.x, m_size.y) / 2.0;
+		double shift = oldPixelSize - GetPixelSize();
 
-		m_center -= delta;
+		uint32_t bits = m_centerX.GetPrecision();
+		m_centerX += BigFixed(mouseOffset.x * shift, bits);
+		m_centerY -= BigFixed(mouseOffset.y * shift, bits);
 
+		// A step of 1.1 is about one cache level
+		SnapToCacheGrid();
 		UpdateRange();
 
 		m_frame = 0;
@@ -168,49 +447,1085 @@ void MandelbrotGraph::CheckInput(const sf::RenderWindow& window, ui::Event& e)
 	if (e.type == sf::Event::MouseButtonReleased && e.key.code == sf::Mouse::Left)
 	{
 		m_mousePressed = false;
-		m_frame = 0;
 	}
 }
 
 void MandelbrotGraph::SetRadius(double radius)
+{
+	SetRadius(BigFixed(radius, GetPrecisionForScale(2.0 * radius / m_size.y)));
+}
+
+void MandelbrotGraph::SetRadius(const BigFixed& radius)
 {
 	m_radius = radius;
+	UpdatePrecision();
+	SnapToCacheGrid();
 	UpdateRange();
+	m_frame = 0;
 }
 
 void MandelbrotGraph::SetCenter(const ui::Vec2d& center)
 {
-	m_center = center;
+	uint32_t bits = m_centerX.GetPrecision();
+	SetCenter(BigFixed(center.x, bits), BigFixed(center.y, bits));
+}
+
+void MandelbrotGraph::SetCenter(const BigFixed& x, const BigFixed& y)
+{
+	m_centerX = x;
+	m_centerY = y;
+	UpdatePrecision();
+	SnapToCacheGrid();
 	UpdateRange();
+	m_frame = 0;
 }
 
-void MandelbrotGraph::Draw(sf::RenderWindow& window)
+RenderView MandelbrotGraph::GetRenderView() const
+{
+	RenderView view;
+	view.centerX = m_centerX;
+	view.centerY = m_centerY;
+	view.radius = m_radius;
+	view.width = m_size.x;
+	view.height = m_size.y;
+	view.maxIters = m_maxIters;
+	return view;
+}
+
+RenderView MandelbrotGraph::GetLevelView(const Level& level) const
+{
+	RenderView view = GetRenderView();
+	if (level.scale == 1)
+		return view;
+
+	// The pixel grid the shader uses for the level: pixels scale times as
+	// large starting at the bottom left corner, so the last row and column
+	// may reach past the screen
+	double pixelSize = GetPixelSize();
+	double extraX = (double)level.size.x * level.scale - m_size.x;
+	double extraY = (double)level.size.y * level.scale - m_size.y;
+
+	uint32_t bits = m_centerX.GetPrecision();
+	view.centerX += BigFixed(0.5 * extraX * pixelSize, bits);
+	view.centerY += BigFixed(0.5 * extraY * pixelSize, bits);
+	view.radius = m_radius * ((double)level.size.y * level.scale / m_size.y);
+	view.width = level.size.x;
+	view.height = level.size.y;
+	return view;
+}
+
+void MandelbrotGraph::BeginRender()
+{
+	m_cpuIterations = UseCpu();
+	m_level = m_progressive ? 0 : LevelCount - 1;
+
+	// Loaded rows count as iterated, Refine only shows them
+	Level& full = m_levels[LevelCount - 1];
+	bool loaded = m_loaded.GetWidth() == full.size.x && m_loaded.GetHeight() == full.size.y;
+	if (loaded)
+	{
+		m_cpuIterations = true;
+		m_level = LevelCount - 1;
+		m_frameStats.reusedPixels += (uint64_t)full.size.x * full.size.y;
+	}
+
+	// Whatever limit was still being raised to applies to the new render
+	if (m_raiseIters != 0)
+		ApplyMaxIters(m_raiseIters);
+	m_raiseIters = 0;
+
+	// The render thread starts with the level after a preview
+	Level& coarse = m_levels[0];
+	bool preview = !loaded && m_cpuIterations && m_progressive && m_preview.GetWidth() > 0 && m_previewView.maxIters == m_maxIters;
+	if (preview)
+		m_frameStats.reusedPixels += (uint64_t)coarse.size.x * coarse.size.y;
+
+	m_stats = RenderStats();
+	GLuint zero[2] = { 0, 0 };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+
+	{
+		// Whatever the render thread still does belongs to the old view
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		m_generation++;
+		m_jobStats = RenderStats();
+		m_jobFrameStats = RenderStats();
+		m_jobComputedPixels = 0;
+		m_pendingShift = sf::Vector2i(0, 0);
+		m_shiftDone = sf::Vector2i(0, 0);
+		m_chosenIters = 0;
+		m_raisedIters = 0;
+		m_samplePass = 0;
+
+		for (auto& level : m_levels)
+		{
+			std::fill(level.rows.begin(), level.rows.end(), RowPending);
+			if (!m_cpuIterations)
+				continue;
+
+			level.iterations.SetDistanceEnabled(m_distanceSampling);
+			if (level.iterations.GetWidth() != level.size.x || level.iterations.GetHeight() != level.size.y)
+				level.iterations.Resize(level.size.x, level.size.y);
+		}
+
+		if (loaded)
+		{
+			full.iterations = std::move(m_loaded);
+			std::fill(full.rows.begin(), full.rows.end(), RowIterated);
+		}
+		if (preview)
+		{
+			Resample(m_preview, m_previewView, coarse.iterations, GetLevelView(coarse));
+			std::fill(coarse.rows.begin(), coarse.rows.end(), RowIterated);
+		}
+	}
+	m_loaded = IterationBuffer();
+	m_preview = IterationBuffer();
+
+	// Loaded counts come with the limit they were rendered with
+	m_itersPending = m_autoIters && !loaded;
+	if (!m_itersPending && (!m_cpuIterations || loaded))
+	{
+		// Stops the job in flight, the kept orbits are not of these counts
+		m_renderThread.Submit([this](const std::atomic<bool>&) { m_orbitState.Clear(); });
+		return;
+	}
+
+	std::array<RenderView, LevelCount> views;
+	for (int i = 0; i < LevelCount; i++)
+		views[i] = GetLevelView(m_levels[i]);
+
+	uint64_t generation = m_generation;
+	int first = preview ? 1 : m_level;
+	bool autoIters = m_itersPending;
+	bool cpu = m_cpuIterations;
+	m_renderThread.Submit([this, generation, first, views, autoIters, cpu](const std::atomic<bool>& cancelled) mutable
+	{
+		// The GPU only waits for the limit
+		if (autoIters)
+		{
+			m_cpuRenderer.SetOrbitState(nullptr);
+			int maxIters = ChooseMaxIters(m_cpuRenderer, views[LevelCount - 1], AutoItersOptions());
+			if (cancelled)
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(m_resultMutex);
+				if (generation != m_generation)
+					return;
+				m_chosenIters = maxIters;
+			}
+
+			for (RenderView& view : views)
+				view.maxIters = maxIters;
+		}
+
+		if (cpu)
+			RenderLevels(generation, first, views, cancelled);
+	});
+}
+
+// True once maxIters is known, rows are only published after it
+bool MandelbrotGraph::TakeAutoIters()
+{
+	int maxIters;
+	{
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		maxIters = m_chosenIters;
+	}
+
+	if (maxIters == 0)
+		return false;
+
+	ApplyMaxIters(maxIters);
+	m_itersPending = false;
+	return true;
+}
+
+// Runs on the render thread, finished rows are handed over in slices so
+// the coarse levels show while the finer ones are still iterated
+void MandelbrotGraph::RenderLevels(uint64_t generation, int first, const std::array<RenderView, LevelCount>& views, const std::atomic<bool>& cancelled)
+{
+	// Coarse levels are slower than copying the cached tiles
+	if (first < LevelCount - 1 && m_cpuRenderer.IsCached(views[LevelCount - 1]))
+	{
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		if (generation != m_generation)
+			return;
+
+		for (int i = first; i < LevelCount - 1; i++)
+			std::fill(m_levels[i].rows.begin(), m_levels[i].rows.end(), RowSkipped);
+		first = LevelCount - 1;
+	}
+
+	for (int i = first; i < LevelCount; i++)
+	{
+		Level& level = m_levels[i];
+		level.workRows.assign(views[i].height, 0);
+		m_cpuRenderer.SetOrbitState(i == LevelCount - 1 ? &m_orbitState : nullptr);
+
+		bool done = false;
+		while (!done)
+		{
+			done = m_cpuRenderer.RenderRows(views[i], level.work, level.workRows, std::chrono::steady_clock::now() + PublishInterval);
+			if (cancelled || !PublishRows(generation, i))
+				return;
+		}
+	}
+}
+
+// Copies the rows RenderRows finished since the last call to the level
+bool MandelbrotGraph::PublishRows(uint64_t generation, int index)
+{
+	Level& level = m_levels[index];
+	const RenderStats& stats = m_cpuRenderer.GetStats();
+
+	std::lock_guard<std::mutex> lock(m_resultMutex);
+	if (generation != m_generation)
+		return false;
+
+	uint64_t rendered = 0;
+	for (uint y = 0; y < level.size.y; y++)
+	{
+		if (level.workRows[y] != 1)
+			continue;
+
+		CopyRow(level.work, level.iterations, y);
+		level.workRows[y] = 2;
+		level.rows[y] = RowIterated;
+		rendered++;
+	}
+
+	if (index == LevelCount - 1)
+		m_jobStats += stats;
+	if (rendered > 0)
+	{
+		m_jobFrameStats += stats;
+		m_jobComputedPixels += rendered * level.size.x - stats.cachedPixels;
+	}
+	return true;
+}
+
+// True once the full resolution is done
+bool MandelbrotGraph::Refine(std::chrono::steady_clock::time_point deadline)
+{
+	if (m_itersPending && !TakeAutoIters())
+		return false;
+
+	while (m_level < LevelCount)
+	{
+		bool done = m_cpuIterations ? RefineCpu(m_level) : RefineGpu(m_level, deadline);
+		if (!done)
+			return false;
+
+		m_level++;
+	}
+
+	return true;
+}
+
+// Shows what the render thread finished, it never waits for more
+bool MandelbrotGraph::RefineCpu(int index)
+{
+	Level& level = m_levels[index];
+	std::lock_guard<std::mutex> lock(m_resultMutex);
+	TakeJobStats();
+
+	// Upload and show every run of rows finished by this call
+	uint y = 0;
+	while (y < level.size.y)
+	{
+		if (level.rows[y] != RowIterated)
+		{
+			y++;
+			continue;
+		}
+
+		uint end = y;
+		while (end < level.size.y && level.rows[end] == RowIterated)
+			end++;
+
+		UploadRows(level, y, end);
+		ShowRows(index, y, end);
+		y = end;
+	}
+
+	return std::find(level.rows.begin(), level.rows.end(), RowPending) == level.rows.end();
+}
+
+bool MandelbrotGraph::RefineGpu(int index, std::chrono::steady_clock::time_point deadline)
+{
+	Level& level = m_levels[index];
+
+	uint y = 0;
+	while (y < level.size.y && level.rows[y] != RowPending)
+		y++;
+
+	// Top to bottom in bands sized by what a pixel cost so far, with room
+	// to spare since the cost changes across the image
+	while (y < level.size.y)
+	{
+		auto start = std::chrono::steady_clock::now();
+		double remaining = std::chrono::duration<double, std::nano>(deadline - start).count();
+		if (remaining <= 0)
+			return false;
+
+		double fit = 0.5 * remaining / (m_gpuNsPerPixel * level.size.x);
+		uint rows = (uint)std::clamp(fit, 1.0, (double)(level.size.y - y));
+
+		{
+			StageScope scope(*this, Stage::Iterate);
+			sf::RectangleShape band(sf::Vector2f((float)level.size.x, (float)rows));
+			band.setPosition(0, (float)y);
+			IterateGpu(level.target, band, (float)level.scale, nullptr, index == LevelCount - 1);
+
+			// Wait for the band, otherwise the time is only spent later
+			glFinish();
+		}
+		m_frameStats.computedPixels += (uint64_t)rows * level.size.x;
+		double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		m_gpuNsPerPixel = std::max(elapsed / ((double)rows * level.size.x), 0.001);
+
+		ShowRows(index, y, y + rows);
+		y += rows;
+	}
+
+	if (index == LevelCount - 1)
+	{
+		GLuint counts[2];
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffer);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), counts);
+		m_stats.cardioidRejected = counts[0];
+		m_stats.periodRejected = counts[1];
+	}
+
+	return true;
+}
+
+void MandelbrotGraph::UploadRows(Level& level, uint first, uint last)
+{
+	// Same layout the iteration shader writes: count + fraction as float
+	// bits, bottom row first
+	StageScope scope(*this, Stage::Upload);
+
+	uint width = level.size.x;
+	uint count = last - first;
+	m_packed.resize((size_t)width * count);
+	uint64_t totalIters = 0;
+	uint64_t interior = 0;
+	uint32_t maxIters = m_frameStats.maxIters;
+	for (uint i = 0; i < count; i++)
+	{
+		const uint32_t* iters = level.iterations.GetRow(last - 1 - i);
+		const float* smooth = level.iterations.GetSmoothRow(last - 1 - i);
+		float* out = m_packed.data() + (size_t)i * width;
+		for (uint x = 0; x < width; x++)
+		{
+			out[x] = (float)iters[x] + smooth[x];
+			totalIters += iters[x];
+			maxIters = std::max(maxIters, iters[x]);
+			interior += iters[x] >= (uint32_t)m_maxIters;
+		}
+	}
+
+	m_frameStats.totalIters += totalIters;
+	m_frameStats.maxIters = maxIters;
+	m_frameStats.interior += interior;
+	m_frameStats.escaped += (uint64_t)width * count - interior;
+
+	level.texture.update(reinterpret_cast<const sf::Uint8*>(m_packed.data()), width, count, 0, level.size.y - last);
+}
+
+void MandelbrotGraph::ShowRows(int index, uint first, uint last)
+{
+	Level& level = m_levels[index];
+
+	// Levels are aligned to the bottom of the screen
+	float top = std::max((float)m_size.y - (float)(level.size.y - first) * level.scale, 0.0f);
+	float bottom = (float)m_size.y - (float)(level.size.y - last) * level.scale;
+
+	StageScope scope(*this, Stage::Color);
+	sf::RectangleShape band(sf::Vector2f((float)m_size.x, bottom - top));
+	band.setPosition(0, top);
+	Colorize(GetLevelTexture(level), BlendIgnoreAlpha, 1.0f, band, (float)level.scale);
+
+	std::fill(level.rows.begin() + first, level.rows.begin() + last, RowShown);
+}
+
+void MandelbrotGraph::ColorizeLevels()
+{
+	// Coarse to fine, like they were refined
+	for (int i = 0; i <= m_level && i < LevelCount; i++)
+	{
+		Level& level = m_levels[i];
+
+		uint y = 0;
+		while (y < level.size.y)
+		{
+			if (level.rows[y] != RowShown)
+			{
+				y++;
+				continue;
+			}
+
+			uint end = y;
+			while (end < level.size.y && level.rows[end] == RowShown)
+				end++;
+
+			ShowRows(i, y, end);
+			y = end;
+		}
+	}
+}
+
+void MandelbrotGraph::RenderShifted()
+{
+	Level& level = m_levels[LevelCount - 1];
+	uint sx = (uint)std::abs(m_shift.x);
+	uint sy = (uint)std::abs(m_shift.y);
+
+	// Full width rows on top or bottom, then the columns beside the rest
+	std::vector<sf::RectangleShape> strips;
+	if (sy > 0)
+	{
+		sf::RectangleShape& rows = strips.emplace_back(sf::Vector2f((float)m_size.x, (float)sy));
+		rows.setPosition(0, m_shift.y > 0 ? 0.0f : (float)(m_size.y - sy));
+	}
+	if (sx > 0)
+	{
+		sf::RectangleShape& cols = strips.emplace_back(sf::Vector2f((float)sx, (float)(m_size.y - sy)));
+		cols.setPosition(m_shift.x > 0 ? 0.0f : (float)(m_size.x - sx), m_shift.y > 0 ? (float)sy : 0.0f);
+	}
+
+	uint64_t uncovered = (uint64_t)sy * m_size.x + (uint64_t)sx * (m_size.y - sy);
+	m_frameStats.reusedPixels += (uint64_t)m_size.x * m_size.y - uncovered;
+	if (m_cpuIterations)
+	{
+		// The strips stay black until the render thread filled them, see
+		// TakeShift
+		m_pendingShift += m_shift;
+		SubmitShift();
+
+		StageScope scope(*this, Stage::Color);
+		ShiftTarget(m_target, m_shift);
+		for (auto& strip : strips)
+		{
+			strip.setFillColor(sf::Color::Black);
+			m_target.draw(strip, sf::RenderStates(sf::BlendNone));
+		}
+
+		// Panned back to the counts there are
+		if (m_pendingShift == sf::Vector2i(0, 0))
+			Colorize(GetIterationTexture(), BlendIgnoreAlpha, 1.0f, m_shape, 1.0f);
+		m_target.display();
+		return;
+	}
+
+	{
+		StageScope scope(*this, Stage::Iterate);
+		ShiftTarget(level.target, m_shift);
+		for (const auto& strip : strips)
+			IterateGpu(level.target, strip, 1.0f);
+	}
+	m_frameStats.computedPixels += uncovered;
+
+	// What was accumulated so far moves along, only the strips start over
+	StageScope scope(*this, Stage::Color);
+	ShiftTarget(m_target, m_shift);
+	for (const auto& strip : strips)
+		Colorize(GetIterationTexture(), BlendIgnoreAlpha, 1.0f, strip, 1.0f);
+}
+
+// The render thread moves a copy of the counts by all of the pending
+// shift they do not have yet. A newer pan replaces the job, the one after
+// it covers both.
+void MandelbrotGraph::SubmitShift()
+{
+	uint64_t generation;
+	sf::Vector2i shift;
+	{
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		generation = ++m_generation;
+		shift = m_pendingShift - m_shiftDone;
+	}
+	if (shift == sf::Vector2i(0, 0))
+		return;
+
+	RenderView view = GetRenderView();
+	m_renderThread.Submit([this, generation, view, shift](const std::atomic<bool>& cancelled)
+	{
+		Level& level = m_levels[LevelCount - 1];
+		{
+			std::lock_guard<std::mutex> lock(m_resultMutex);
+			if (generation != m_generation)
+				return;
+			level.work = level.iterations;
+		}
+
+		// The kept orbits move along. A shift that is dropped leaves them
+		// ahead of the counts, they are of no use then.
+		m_cpuRenderer.SetOrbitState(&m_orbitState);
+		m_cpuRenderer.RenderShifted(view, level.work, shift.x, shift.y);
+		if (cancelled)
+		{
+			m_orbitState.Clear();
+			return;
+		}
+
+		const RenderStats& stats = m_cpuRenderer.GetStats();
+		uint sx = (uint)std::abs(shift.x);
+		uint sy = (uint)std::abs(shift.y);
+		uint64_t uncovered = (uint64_t)sy * view.width + (uint64_t)sx * (view.height - sy);
+
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		if (generation != m_generation)
+		{
+			m_orbitState.Clear();
+			return;
+		}
+
+		std::swap(level.iterations, level.work);
+		m_shiftDone += shift;
+		m_jobStats += stats;
+		m_jobFrameStats += stats;
+		m_jobComputedPixels += uncovered - stats.cachedPixels;
+	});
+}
+
+// The render thread continues the orbits kept from the full resolution on
+// a copy of its counts, the image stays at the old limit until TakeRaise
+void MandelbrotGraph::SubmitRaise(int maxIters)
+{
+	uint64_t generation;
+	{
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		generation = ++m_generation;
+		m_raisedIters = 0;
+	}
+	m_raiseIters = maxIters;
+
+	RenderView view = GetRenderView();
+	view.maxIters = maxIters;
+	m_renderThread.Submit([this, generation, view](const std::atomic<bool>& cancelled)
+	{
+		Level& level = m_levels[LevelCount - 1];
+		{
+			std::lock_guard<std::mutex> lock(m_resultMutex);
+			if (generation != m_generation)
+				return;
+			level.work = level.iterations;
+		}
+
+		m_cpuRenderer.SetOrbitState(&m_orbitState);
+		bool raised = m_cpuRenderer.RaiseMaxIters(view, level.work);
+		const RenderStats& stats = m_cpuRenderer.GetStats();
+
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		if (cancelled || generation != m_generation)
+		{
+			// The counts stay at the old limit, the orbits moved on
+			if (raised)
+				m_orbitState.Clear();
+			return;
+		}
+
+		if (!raised)
+		{
+			m_raisedIters = -1;
+			return;
+		}
+
+		std::swap(level.iterations, level.work);
+		m_raisedIters = view.maxIters;
+		m_jobStats += stats;
+		m_jobFrameStats += stats;
+		m_jobComputedPixels += stats.continuedOrbits;
+	});
+}
+
+// Shows the counts at the raised limit once the render thread has them,
+// or starts over when it could not raise it. False before.
+bool MandelbrotGraph::TakeRaise()
+{
+	if (m_raiseIters == 0)
+		return false;
+
+	Level& level = m_levels[LevelCount - 1];
+	std::lock_guard<std::mutex> lock(m_resultMutex);
+	if (m_raisedIters == 0)
+		return false;
+
+	ApplyMaxIters(m_raiseIters);
+	m_raiseIters = 0;
+	if (m_raisedIters < 0)
+	{
+		m_frame = 0;
+		return false;
+	}
+
+	m_raisedIters = 0;
+	TakeJobStats();
+
+	// The continued pixels are anywhere in it
+	UploadRows(level, 0, level.size.y);
+	StageScope scope(*this, Stage::Color);
+	Colorize(GetIterationTexture(), BlendIgnoreAlpha, 1.0f, m_shape, 1.0f);
+	return true;
+}
+
+// Under m_resultMutex, what the jobs did since the last Draw goes into its
+// stats
+void MandelbrotGraph::TakeJobStats()
+{
+	m_stats = m_jobStats;
+	AddRendererStats(m_jobFrameStats);
+	m_frameStats.computedPixels += m_jobComputedPixels;
+	m_jobFrameStats = RenderStats();
+	m_jobComputedPixels = 0;
+}
+
+// Shows the counts once they caught up with every pan, false before
+bool MandelbrotGraph::TakeShift()
+{
+	if (m_pendingShift == sf::Vector2i(0, 0))
+		return false;
+
+	Level& level = m_levels[LevelCount - 1];
+	std::lock_guard<std::mutex> lock(m_resultMutex);
+	if (m_shiftDone != m_pendingShift)
+		return false;
+
+	m_pendingShift = sf::Vector2i(0, 0);
+	m_shiftDone = sf::Vector2i(0, 0);
+	TakeJobStats();
+
+	// The strips of every pan since the last one taken are in it, all of
+	// it is colored again. Anti aliasing starts over anyway.
+	UploadRows(level, 0, level.size.y);
+	StageScope scope(*this, Stage::Color);
+	Colorize(GetIterationTexture(), BlendIgnoreAlpha, 1.0f, m_shape, 1.0f);
+	return true;
+}
+
+// For changes to the CPU renderer, which only a job may use. Waits for
+// the row or tile in flight.
+void MandelbrotGraph::StopCpuJob()
+{
+	m_renderThread.Cancel();
+	m_renderThread.Wait();
+}
+
+void MandelbrotGraph::ShiftTarget(sf::RenderTexture& target, const sf::Vector2i& shift)
+{
+	// A render texture cannot draw itself, go through the sample target
+	// which is overwritten by every anti aliasing pass anyway
+	sf::Sprite sprite(target.getTexture());
+	sprite.setPosition((float)shift.x, (float)shift.y);
+	m_sampleTarget.draw(sprite, sf::RenderStates(sf::BlendNone));
+	m_sampleTarget.display();
+
+	target.draw(sf::Sprite(m_sampleTarget.getTexture()), sf::RenderStates(sf::BlendNone));
+	target.display();
+}
+
+void MandelbrotGraph::UpdateMask(bool init)
+{
+	m_maskShader.setUniform("init", init);
+	m_maskShader.setUniform("frame", m_frame);
+	m_maskShader.setUniform("minSamples", m_minSamples);
+	m_maskShader.setUniform("mask", m_maskTargets[m_mask].getTexture());
+	m_maskShader.setUniform("base", GetIterationTexture());
+	m_maskShader.setUniform("samples", m_sampleTarget.getTexture());
+
+	sf::RenderStates states = sf::RenderStates::Default;
+	states.blendMode = sf::BlendNone;
+	states.shader = &m_maskShader;
+
+	m_mask = 1 - m_mask;
+	m_maskTargets[m_mask].draw(m_shape, states);
+	m_maskTargets[m_mask].display();
+}
+
+// Passes come back from the render thread, each one is blended in on
+// the first Draw after it finished
+void MandelbrotGraph::AccumulateCpu()
+{
+	const Level& level = m_levels[LevelCount - 1];
+	const uint width = level.size.x;
+	const uint height = level.size.y;
+	const size_t pixels = (size_t)width * height;
+	if (m_frame == 1)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_resultMutex);
+			m_generation++;
+			m_samplePass = 0;
+
+			// Loaded counts come without distances
+			if (!level.iterations.HasDistance())
+				return;
+
+			SamplingOptions options;
+			options.maxSamples = MaxCpuSamples;
+			m_samplingStats = PlanSamples(level.iterations, m_maxIters, options, m_extraSamples);
+			m_samplingStats.samples = pixels;
+		}
+
+		SubmitSamples(1);
+		return;
+	}
+
+	uint32_t pass;
+	uint64_t active;
+	{
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		pass = m_samplePass;
+		active = m_sampleActive;
+		m_samplePass = 0;
+	}
+
+	if (pass == 0)
+		return;
+
+	m_frameStats.computedPixels += active;
+	m_samplingStats.samples += active;
+
+	{
+		// Bottom row first like the iteration textures
+		StageScope scope(*this, Stage::Upload);
+		m_packed.resize(pixels);
+		m_maskPixels.resize(pixels * 4);
+		for (uint j = 0; j < height; j++)
+		{
+			const uint32_t* iters = m_samples.GetRow(height - 1 - j);
+			const float* smooth = m_samples.GetSmoothRow(height - 1 - j);
+			const uint8_t* mask = m_sampleMask.data() + (size_t)(height - 1 - j) * width;
+			for (uint i = 0; i < width; i++)
+			{
+				size_t p = (size_t)j * width + i;
+				m_packed[p] = (float)iters[i] + smooth[i];
+				m_maskPixels[4 * p] = mask[i] ? 255 : 0;
+				m_maskPixels[4 * p + 1] = 0;
+				m_maskPixels[4 * p + 2] = 0;
+				m_maskPixels[4 * p + 3] = 255;
+			}
+		}
+		m_sampleTexture.update(reinterpret_cast<const sf::Uint8*>(m_packed.data()));
+		m_sampleMaskTexture.update(m_maskPixels.data());
+	}
+
+	Colorize(m_sampleTexture, BlendAlpha, 1.0f / (pass + 1.0f), m_shape, 1.0f, &m_sampleMaskTexture);
+
+	if (pass + 1 < MaxCpuSamples)
+		SubmitSamples(pass + 1);
+}
+
+// Sample pass to every pixel that takes at least that many extra ones
+void MandelbrotGraph::SubmitSamples(uint32_t pass)
+{
+	m_sampleMask.resize(m_extraSamples.size());
+	uint64_t active = 0;
+	for (size_t p = 0; p < m_extraSamples.size(); p++)
+	{
+		m_sampleMask[p] = m_extraSamples[p] >= pass;
+		active += m_sampleMask[p];
+	}
+
+	if (active == 0)
+		return;
+
+	// The job keeps its own mask, the next pass may be planned before a
+	// cancelled one returned
+	uint64_t generation = m_generation;
+	RenderView view = GetRenderView();
+	std::vector<uint8_t> mask = m_sampleMask;
+	m_renderThread.Submit([this, generation, pass, active, view, mask](const std::atomic<bool>& cancelled)
+	{
+		double offsetX, offsetY;
+		GetSampleOffset(pass, offsetX, offsetY);
+
+		// The samples themselves need no distances
+		bool distance = m_cpuRenderer.IsDistanceEstimation();
+		m_cpuRenderer.SetOrbitState(nullptr);
+		m_cpuRenderer.SetDistanceEstimation(false);
+		m_cpuRenderer.SetSampleOffset(offsetX, offsetY);
+		m_cpuRenderer.RenderMasked(view, m_samples, 0, 0, view.width, view.height, mask);
+		m_cpuRenderer.SetSampleOffset(0, 0);
+		m_cpuRenderer.SetDistanceEstimation(distance);
+		if (cancelled)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_resultMutex);
+		if (generation != m_generation)
+			return;
+
+		m_samplePass = pass;
+		m_sampleActive = active;
+	});
+}
+
+void MandelbrotGraph::IterateGpu(sf::RenderTexture& target, const sf::Shape& shape, float scale, const sf::Texture* mask, bool countStats)
 {
 	m_shader.setUniform("frame", m_frame);
+	m_shader.setUniform("scale", scale);
+	m_shader.setUniform("masked", mask != nullptr);
+	if (mask)
+		m_shader.setUniform("mask", *mask);
+	m_shader.setUniform("countStats", countStats);
+
+	// Buffer bindings belong to the context of the target
+	if (target.setActive(true))
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_statsBuffer);
 
 	sf::RenderStates states = sf::RenderStates::Default;
-	states.blendMode = (m_frame > 0 ? BlendAlpha : BlendIgnoreAlpha);
+	states.blendMode = sf::BlendNone;
 	states.shader = &m_shader;
 
+	target.draw(shape, states);
+	target.display();
+}
+
+void MandelbrotGraph::Colorize(const sf::Texture& iterations, const sf::BlendMode& blend, float alpha, const sf::Shape& shape, float scale, const sf::Texture* mask)
+{
+	m_colorShader.setUniform("iterations", iterations);
+	m_colorShader.setUniform("alpha", alpha);
+	m_colorShader.setUniform("scale", scale);
+	m_colorShader.setUniform("masked", mask != nullptr);
+	if (mask)
+		m_colorShader.setUniform("mask", *mask);
+
+	sf::RenderStates states = sf::RenderStates::Default;
+	states.blendMode = blend;
+	states.shader = &m_colorShader;
+
+	m_target.draw(shape, states);
+	m_target.display();
+}
+
+const sf::Texture& MandelbrotGraph::GetLevelTexture(const Level& level) const
+{
+	return m_cpuIterations ? level.texture : level.target.getTexture();
+}
+
+const sf::Texture& MandelbrotGraph::GetIterationTexture() const
+{
+	return GetLevelTexture(m_levels[LevelCount - 1]);
+}
+
+void MandelbrotGraph::Draw(sf::RenderWindow& window)
+{
+	m_frameStats = FrameStats();
+	m_stage = Stage::Other;
+	m_stageStart = std::chrono::steady_clock::now();
+	m_frameStats.uiMs = std::chrono::duration<double, std::milli>(m_stageStart - m_lastDrawEnd).count();
+
+	auto deadline = std::chrono::steady_clock::time_point::max();
+	if (m_progressive)
+		deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(m_frameBudget));
+
 	m_shape.setSize(sf::Vector2f((double)m_size.x, (double)m_size.y));
 	m_shape.setFillColor(sf::Color::Magenta);
 
-	m_target.draw(m_shape, states);
-	m_target.display();
+	// Only a finished image can be moved
+	bool shifted = m_shift.x != 0 || m_shift.y != 0;
+	sf::Vector2i shift = m_shift + m_pendingShift;
+	if (shifted && (m_level < LevelCount || m_raiseIters != 0 || (uint)std::abs(shift.x) >= m_size.x || (uint)std::abs(shift.y) >= m_size.y))
+		m_frame = 0;
+
+	// Before BeginRender, a limit that could not be raised starts over
+	bool raised = TakeRaise();
+
+	if (m_frame == 0)
+		BeginRender();
 
-	sf::Sprite sprite(m_target.getTexture());
-	window.clear();
-	window.draw(sprite, sf::RenderStates(BlendIgnoreAlpha));
+	bool moved = TakeShift();
 
-	m_frame += 1;
+	if (m_level < LevelCount)
+	{
+		if (m_recolor)
+		{
+			StageScope scope(*this, Stage::Color);
+			ColorizeLevels();
+		}
+
+		// Once finished the image is the first anti aliasing sample
+		if (Refine(deadline))
+			m_frame = 0;
+	}
+	else if (shifted || moved || raised || m_recolor)
+	{
+		if (shifted)
+			RenderShifted();
+
+		// Only the coloring changed, the stored iterations are still valid.
+		// They are not yet where the image is while a shift is pending.
+		if (m_recolor && m_pendingShift == sf::Vector2i(0, 0))
+		{
+			StageScope scope(*this, Stage::Color);
+			Colorize(GetIterationTexture(), BlendIgnoreAlpha, 1.0f, m_shape, 1.0f);
+		}
+
+		// Anti aliasing starts over with the current image as first sample
+		m_frame = 0;
+	}
+	else if (m_mousePressed)
+	{
+		// No samples while dragging, accumulation resumes on release
+		m_frame = 0;
+	}
+	else if (m_cpuIterations && m_distanceSampling && m_pendingShift == sf::Vector2i(0, 0) && m_raiseIters == 0)
+	{
+		StageScope scope(*this, Stage::Accumulate);
+		AccumulateCpu();
+	}
+	else if (!m_cpuIterations && m_frame < 100)
+	{
+		// Samples go only to pixels on an edge of the base image, and stop
+		// for those whose samples keep agreeing with it or disagree at a
+		// rate that has settled, see mask.frag
+		if (m_frame == 1)
+			UpdateMask(true);
+
+		// Accumulate jittered samples for anti aliasing, as long as a whole
+		// pass fits in the budget
+		double cost = m_gpuNsPerPixel * m_size.x * m_size.y * 1e-6;
+		if (!m_progressive || cost <= m_frameBudget)
+		{
+			StageScope scope(*this, Stage::Accumulate);
+			const sf::Texture* mask = &m_maskTargets[m_mask].getTexture();
+			IterateGpu(m_sampleTarget, m_shape, 1.0f, mask);
+			Colorize(m_sampleTarget.getTexture(), BlendAlpha, 1.0f / (m_frame + 1.0f), m_shape, 1.0f, mask);
+			UpdateMask(false);
+		}
+	}
+	m_recolor = false;
+	m_shift = sf::Vector2i(0, 0);
+
+	{
+		StageScope scope(*this, Stage::Present);
+		sf::Sprite sprite(m_target.getTexture());
+		window.clear();
+		window.draw(sprite, sf::RenderStates(BlendIgnoreAlpha));
+		if (m_showOverlay && m_overlayFont)
+			DrawOverlay(window);
+	}
+
+	m_frameStats.accumulation = m_frame;
+	m_frameStats.level = m_level;
+
+	// Frames only count as samples once the image is complete
+	if (m_level < LevelCount)
+		m_frame = 1;
+	else
+		m_frame += 1;
+
+	FinishFrameStats();
+}
+
+MandelbrotGraph::Stage MandelbrotGraph::SwitchStage(Stage stage)
+{
+	// Otherwise GPU work is only waited for by whatever stage comes next
+	if (IsProfiling())
+		glFinish();
+
+	auto now = std::chrono::steady_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(now - m_stageStart).count();
+	switch (m_stage)
+	{
+	case Stage::Iterate: m_frameStats.iterateMs += ms; break;
+	case Stage::Upload: m_frameStats.uploadMs += ms; break;
+	case Stage::Color: m_frameStats.colorMs += ms; break;
+	case Stage::Accumulate: m_frameStats.accumulateMs += ms; break;
+	case Stage::Present: m_frameStats.presentMs += ms; break;
+	case Stage::Other: m_frameStats.otherMs += ms; break;
+	}
+
+	Stage previous = m_stage;
+	m_stage = stage;
+	m_stageStart = now;
+	return previous;
+}
+
+bool MandelbrotGraph::IsProfiling() const
+{
+	return m_showOverlay || m_trace.is_open();
+}
+
+void MandelbrotGraph::AddRendererStats(const RenderStats& stats)
+{
+	m_frameStats.cacheHits += stats.cacheHits;
+	m_frameStats.cacheMisses += stats.cacheMisses;
+	m_frameStats.reusedPixels += stats.cachedPixels;
+}
+
+void MandelbrotGraph::FinishFrameStats()
+{
+	SwitchStage(Stage::Other);
+	m_frameStats.frame = m_frameCount++;
+	m_lastFrameStats = m_frameStats;
+	m_lastDrawEnd = std::chrono::steady_clock::now();
+
+	if (!m_trace.is_open())
+		return;
+
+	const FrameStats& f = m_lastFrameStats;
+	m_trace << f.frame << ',' << f.accumulation << ',' << f.level << ','
+		<< f.GetFrameMs() << ',' << f.uiMs << ',' << f.iterateMs << ',' << f.uploadMs << ',' << f.colorMs << ','
+		<< f.accumulateMs << ',' << f.presentMs << ',' << f.otherMs << ','
+		<< f.computedPixels << ',' << f.reusedPixels << ','
+		<< f.totalIters << ',' << f.maxIters << ',' << f.escaped << ',' << f.interior << ','
+		<< f.cacheHits << ',' << f.cacheMisses << '\n';
+}
+
+void MandelbrotGraph::DrawOverlay(sf::RenderWindow& window) const
+{
+	// The frame before, this one is still being drawn
+	const FrameStats& f = m_lastFrameStats;
+	uint64_t tiles = f.cacheHits + f.cacheMisses;
+
+	char text[512];
+	snprintf(text, sizeof(text),
+		"frame %llu  accumulation %d  level %d/%d\n"
+		"%.1f ms  ui %.1f  iterate %.1f  upload %.1f  color %.1f  accumulate %.1f  present %.1f  other %.1f\n"
+		"pixels computed %llu  reused %llu\n"
+		"iterations %llu  max %u  limit %d%s  escaped %llu  interior %llu\n"
+		"cache tiles %llu hit  %llu missed  %.0f%%",
+		(unsigned long long)f.frame, f.accumulation, std::min(f.level, LevelCount), LevelCount,
+		f.GetFrameMs(), f.uiMs, f.iterateMs, f.uploadMs, f.colorMs, f.accumulateMs, f.presentMs, f.otherMs,
+		(unsigned long long)f.computedPixels, (unsigned long long)f.reusedPixels,
+		(unsigned long long)f.totalIters, f.maxIters, m_maxIters, m_autoIters ? " auto" : "", (unsigned long long)f.escaped, (unsigned long long)f.interior,
+		(unsigned long long)f.cacheHits, (unsigned long long)f.cacheMisses, tiles > 0 ? 100.0 * f.cacheHits / tiles : 0.0);
+
+	sf::Text label(text, *m_overlayFont, 13);
+	label.setFillColor(sf::Color::White);
+	label.setPosition((float)m_pos.x + 8, (float)m_pos.y + 6);
+
+	sf::FloatRect bounds = label.getGlobalBounds();
+	sf::RectangleShape background(sf::Vector2f(bounds.width + 12, bounds.height + 12));
+	background.setPosition(bounds.left - 6, bounds.top - 6);
+	background.setFillColor(sf::Color(0, 0, 0, 160));
+
+	window.draw(background);
+	window.draw(label);
 }
 
 ui::Vec2d MandelbrotGraph::GetCenter()
 {
-	return m_center;
+	return { m_centerX.ToDouble(), m_centerY.ToDouble() };
 }
 
 double MandelbrotGraph::GetRadius()
+{
+	return m_radius.ToDouble();
+}
+
+std::pair<BigFixed, BigFixed> MandelbrotGraph::GetExactCenter() const
+{
+	return { m_centerX, m_centerY };
+}
+
+const BigFixed& MandelbrotGraph::GetExactRadius() const
 {
 	return m_radius;
 }
@@ -223,11 +1538,11 @@ void MandelbrotGraph::SetColorFunc(const ColorFunction& colorFunc)
 		ss << "uniform float " << u.name << ";\n";
 
 	ss << colorFunc.GetSource() << '\n';
-	ss << m_coreShader;
+	ss << m_colorShaderCore;
 
 	//std::cout << ss.str() << '\n';
 
-	if (!m_shader.loadFromMemory(ss.str(), sf::Shader::Fragment))
+	if (!m_colorShader.loadFromMemory(ss.str(), sf::Shader::Fragment))
 		std::cout << "Error loading shader\n";
 
 	for (const auto& u : colorFunc.GetUniforms())
@@ -235,25 +1550,284 @@ void MandelbrotGraph::SetColorFunc(const ColorFunction& colorFunc)
 		SetUniform(u.name, u.default_val);
 	}
 
-	// Set default uniforms
-	SetSize(m_size);
-	SetMaxIters(m_maxIters);
+	m_colorShader.setUniform("maxIters", m_maxIters);
+
+	m_recolor = true;
+}
 
+void MandelbrotGraph::SetProgressive(bool progressive)
+{
+	m_progressive = progressive;
 	m_frame = 0;
 }
 
-void MandelbrotGraph::SetUniform(const std::string& name, float val)
+bool MandelbrotGraph::IsProgressive() const
 {
-	m_shader.setUniform(name, val);
+	return m_progressive;
+}
 
+void MandelbrotGraph::SetFrameBudget(double milliseconds)
+{
+	m_frameBudget = milliseconds;
+}
+
+double MandelbrotGraph::GetFrameBudget() const
+{
+	return m_frameBudget;
+}
+
+void MandelbrotGraph::SetMinSamples(int minSamples)
+{
+	m_minSamples = minSamples;
 	m_frame = 0;
 }
 
-float MandelbrotGraph::GetUniform(const std::string& name)
+int MandelbrotGraph::GetMinSamples() const
+{
+	return m_minSamples;
+}
+
+void MandelbrotGraph::SetBackend(Backend backend)
+{
+	m_backend = backend;
+	m_frame = 0;
+}
+
+MandelbrotGraph::Backend MandelbrotGraph::GetBackend() const
+{
+	return m_backend;
+}
+
+void MandelbrotGraph::SetPrecision(Precision precision)
+{
+	StopCpuJob();
+	m_cpuRenderer.SetPrecision(precision);
+	m_frame = 0;
+}
+
+Precision MandelbrotGraph::GetPrecision() const
+{
+	return m_cpuRenderer.GetPrecision();
+}
+
+void MandelbrotGraph::SetInteriorChecks(bool enabled)
+{
+	StopCpuJob();
+	m_cpuRenderer.SetInteriorChecks(enabled);
+	m_shader.setUniform("interiorChecks", enabled);
+	m_frame = 0;
+}
+
+bool MandelbrotGraph::GetInteriorChecks() const
+{
+	return m_cpuRenderer.GetInteriorChecks();
+}
+
+void MandelbrotGraph::SetRenderMode(RenderMode mode)
+{
+	StopCpuJob();
+	m_cpuRenderer.SetRenderMode(mode);
+	m_frame = 0;
+}
+
+RenderMode MandelbrotGraph::GetRenderMode() const
+{
+	return m_cpuRenderer.GetRenderMode();
+}
+
+void MandelbrotGraph::SetFormula(Formula formula)
+{
+	StopCpuJob();
+	m_cpuRenderer.SetFormula(formula);
+	LoadIterationShader();
+	m_frame = 0;
+}
+
+Formula MandelbrotGraph::GetFormula() const
+{
+	return m_cpuRenderer.GetFormula();
+}
+
+void MandelbrotGraph::SetMultibrotPower(int power)
+{
+	StopCpuJob();
+	m_cpuRenderer.SetMultibrotPower(power);
+	LoadIterationShader();
+	m_frame = 0;
+}
+
+int MandelbrotGraph::GetMultibrotPower() const
+{
+	return m_cpuRenderer.GetMultibrotPower();
+}
+
+void MandelbrotGraph::SetJuliaC(double x, double y)
 {
+	StopCpuJob();
+	m_cpuRenderer.SetJuliaC(x, y);
+
 	uint shader_handle = m_shader.getNativeHandle();
 	glUseProgram(shader_handle);
 
+	GLint julia_loc = glGetUniformLocation(shader_handle, "juliaC");
+	glUniform2d(julia_loc, x, y);
+	m_frame = 0;
+}
+
+ui::Vec2d MandelbrotGraph::GetJuliaC() const
+{
+	return ui::Vec2d(m_cpuRenderer.GetJuliaX(), m_cpuRenderer.GetJuliaY());
+}
+
+void MandelbrotGraph::SetTileCacheEnabled(bool enabled)
+{
+	StopCpuJob();
+	m_cpuRenderer.SetTileCache(enabled ? &m_tileCache : nullptr);
+	SnapToCacheGrid();
+	UpdateRange();
+	m_frame = 0;
+}
+
+bool MandelbrotGraph::IsTileCacheEnabled() const
+{
+	return m_cpuRenderer.GetTileCache() != nullptr;
+}
+
+TileCache& MandelbrotGraph::GetTileCache()
+{
+	return m_tileCache;
+}
+
+void MandelbrotGraph::SetDistanceSampling(bool enabled)
+{
+	StopCpuJob();
+	m_distanceSampling = enabled;
+	m_cpuRenderer.SetDistanceEstimation(enabled);
+	m_frame = 0;
+}
+
+bool MandelbrotGraph::IsDistanceSampling() const
+{
+	return m_distanceSampling;
+}
+
+const SamplingStats& MandelbrotGraph::GetSamplingStats() const
+{
+	return m_samplingStats;
+}
+
+bool MandelbrotGraph::SaveIterations(const std::string& path, bool compressed) const
+{
+	const Level& full = m_levels[LevelCount - 1];
+	if (!m_cpuIterations || m_level < LevelCount || m_pendingShift != sf::Vector2i(0, 0))
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_resultMutex);
+	if (full.iterations.GetHeight() != m_size.y)
+		return false;
+
+	IterationFileWriter writer;
+	return writer.Open(path, GetRenderView(), compressed)
+		&& writer.WriteRows(full.iterations, m_size.y)
+		&& writer.Close();
+}
+
+bool MandelbrotGraph::LoadIterations(const std::string& path)
+{
+	IterationFileReader reader;
+	if (!reader.Open(path))
+		return false;
+
+	const RenderView& view = reader.GetView();
+	if (view.width != m_size.x || view.height != m_size.y)
+		return false;
+
+	IterationBuffer loaded;
+	if (!reader.ReadRows(0, view.height, loaded))
+		return false;
+
+	// Exactly the file's view, snapping to the cache grid would move the
+	// counts off their pixels
+	m_centerX = view.centerX;
+	m_centerY = view.centerY;
+	m_radius = view.radius;
+	m_raiseIters = 0;
+	ApplyMaxIters(view.maxIters);
+	UpdateRange();
+
+	m_loaded = std::move(loaded);
+	m_frame = 0;
+	return true;
+}
+
+void MandelbrotGraph::SetPreview(const IterationBuffer& counts, const RenderView& view)
+{
+	m_preview = counts;
+	m_previewView = view;
+	m_frame = 0;
+}
+
+const RenderStats& MandelbrotGraph::GetRenderStats() const
+{
+	return m_stats;
+}
+
+const FrameStats& MandelbrotGraph::GetFrameStats() const
+{
+	return m_lastFrameStats;
+}
+
+void MandelbrotGraph::SetStatsOverlay(bool show, const sf::Font& font)
+{
+	m_showOverlay = show;
+	m_overlayFont = &font;
+}
+
+bool MandelbrotGraph::IsStatsOverlayShown() const
+{
+	return m_showOverlay;
+}
+
+bool MandelbrotGraph::StartStatsTrace(const std::string& path)
+{
+	m_trace.close();
+	m_trace.open(path, std::ios::trunc);
+	if (!m_trace)
+		return false;
+
+	m_trace << "frame,accumulation,level,frame_ms,ui_ms,iterate_ms,upload_ms,color_ms,accumulate_ms,present_ms,other_ms,"
+		"computed_pixels,reused_pixels,total_iters,max_iters,escaped,interior,cache_hits,cache_misses\n";
+	return true;
+}
+
+void MandelbrotGraph::StopStatsTrace()
+{
+	m_trace.close();
+}
+
+bool MandelbrotGraph::IsTracingStats() const
+{
+	return m_trace.is_open();
+}
+
+// The shader only has doubles, views past that go through the CPU
+bool MandelbrotGraph::UseCpu() const
+{
+	return m_backend == Backend::CPU || m_cpuRenderer.ResolvePrecision(GetRenderView()) != Precision::Double;
+}
+
+void MandelbrotGraph::SetUniform(const std::string& name, float val)
+{
+	m_colorShader.setUniform(name, val);
+
+	m_recolor = true;
+}
+
+float MandelbrotGraph::GetUniform(const std::string& name)
+{
+	uint shader_handle = m_colorShader.getNativeHandle();
+	glUseProgram(shader_handle);
+
 	GLint loc = glGetUniformLocation(shader_handle, name.c_str());
 	if (loc == -1)
 	{
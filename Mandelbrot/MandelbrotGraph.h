@@ -2,6 +2,17 @@
 
 #include <src/Global.h>
 #include <src/Event.h>
+#include <AutoIters.h>
+#include <CpuRenderer.h>
+#include <IterationFile.h>
+#include <OrbitState.h>
+#include <RenderThread.h>
+#include <Sampling.h>
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <mutex>
 
 class ColorFunction
 {
@@ -51,13 +62,64 @@ public:
 	}
 };
 
+// What one Draw call spent and produced. Iteration counts only cover rows
+// the CPU iterated, the GPU keeps its counts in textures.
+struct FrameStats
+{
+	uint64_t frame = 0;
+	// Anti aliasing samples accumulated so far, m_frame
+	int accumulation = 0;
+	// Progressive level refined, the level count once the image is done
+	int level = 0;
+
+	// Since the last Draw returned: events, tools window, display
+	double uiMs = 0;
+	double iterateMs = 0;
+	double uploadMs = 0;
+	double colorMs = 0;
+	double accumulateMs = 0;
+	double presentMs = 0;
+	double otherMs = 0;
+
+	uint64_t computedPixels = 0;
+	// Kept from a pan, copied from the tile cache, loaded from a file or
+	// taken from a preview
+	uint64_t reusedPixels = 0;
+
+	uint64_t totalIters = 0;
+	uint32_t maxIters = 0;
+	uint64_t escaped = 0;
+	uint64_t interior = 0;
+
+	// Tiles
+	uint64_t cacheHits = 0;
+	uint64_t cacheMisses = 0;
+
+	double GetFrameMs() const { return uiMs + iterateMs + uploadMs + colorMs + accumulateMs + presentMs + otherMs; }
+};
+
 class MandelbrotGraph
 {
+public:
+	enum class Backend
+	{
+		GPU,
+		CPU
+	};
+
 private:
-	ui::Vec2d m_center;
-	double m_radius;
+	BigFixed m_centerX;
+	BigFixed m_centerY;
+	BigFixed m_radius;
 	int m_frame;
 	int m_maxIters;
+	// maxIters is picked for every render from a sample grid, Refine waits
+	// for it while m_itersPending is set
+	bool m_autoIters;
+	bool m_itersPending;
+	// Limit the render thread continues the full resolution to, 0 when it
+	// does not. The image stays at m_maxIters until TakeRaise.
+	int m_raiseIters;
 
 	ui::Vec2d m_xRange;
 	ui::Vec2d m_yRange;
@@ -70,11 +132,192 @@ private:
 	sf::RenderTexture m_target;
 	sf::RectangleShape m_shape;
 
+	enum RowState : uint8_t
+	{
+		RowPending,
+		RowIterated,
+		RowShown,
+		// Coarse rows not rendered since the view is in the tile cache
+		RowSkipped
+	};
+
+	// One resolution of the progressive render, a pixel of it covers scale
+	// x scale screen pixels. Iteration counts (plus smooth fraction) are
+	// packed as float bits in RGBA8 and kept so recoloring never has to
+	// iterate again.
+	struct Level
+	{
+		uint scale;
+		ui::Vec2u size;
+		sf::RenderTexture target;
+		sf::Texture texture;
+		// Rows are copied in from work once the render thread finished
+		// them, both iterations and rows are under m_resultMutex
+		IterationBuffer iterations;
+		std::vector<uint8_t> rows;
+		// Only touched by the render thread. Rows are 0 while pending, 1
+		// once rendered and 2 once copied out.
+		IterationBuffer work;
+		std::vector<uint8_t> workRows;
+	};
+
+	static constexpr int LevelCount = 3;
+	Level m_levels[LevelCount];
+	// Level being refined, LevelCount once the full resolution is done
+	int m_level;
+	bool m_progressive;
+	double m_frameBudget;
+	double m_gpuNsPerPixel;
+
+	sf::RenderTexture m_sampleTarget;
+
+	// Pixels that still take anti aliasing samples, ping-ponged
+	sf::Shader m_maskShader;
+	sf::RenderTexture m_maskTargets[2];
+	int m_mask;
+	int m_minSamples;
+	bool m_cpuIterations;
+	bool m_recolor;
+
+	// Whole pixels the image moved since the last draw and the part of the
+	// pan below a pixel that has not been applied yet
+	sf::Vector2i m_shift;
+	ui::Vec2d m_panRemainder;
+
+	sf::Shader m_colorShader;
+	std::string m_colorShaderCore;
+
+	Backend m_backend;
+	CpuRenderer m_cpuRenderer;
+	TileCache m_tileCache;
+	// Counts read from a file, shown instead of rendering once
+	IterationBuffer m_loaded;
+	// Counts of a small render of the view, taken for the coarsest level
+	// of the next render
+	IterationBuffer m_preview;
+	RenderView m_previewView;
+
+	// Anti aliasing of the CPU backend, only near the set by its distance
+	// estimates. Pixels take frames 1 ... m_extraSamples[pixel] like the
+	// GPU mask, so their average stays right.
+	bool m_distanceSampling;
+	std::vector<uint8_t> m_extraSamples;
+	std::vector<uint8_t> m_sampleMask;
+	std::vector<sf::Uint8> m_maskPixels;
+	// Pass of the CPU samples, only read once the render thread published
+	// it and until the next one is started
+	IterationBuffer m_samples;
+	sf::Texture m_sampleTexture;
+	sf::Texture m_sampleMaskTexture;
+	SamplingStats m_samplingStats;
+	// Of the full resolution since the last restart
+	RenderStats m_stats;
+	// Interior test counters of the iteration shader
+	uint m_statsBuffer;
+	std::vector<float> m_packed;
+
+	// Pan waiting for the render thread, the image on screen already moved
+	sf::Vector2i m_pendingShift;
+
+	// What the render thread hands over. Jobs carry the generation they
+	// were started in and drop their results once it changed.
+	mutable std::mutex m_resultMutex;
+	uint64_t m_generation;
+	// Of the full resolution, since the render began
+	RenderStats m_jobStats;
+	// Since Draw took them last
+	RenderStats m_jobFrameStats;
+	uint64_t m_jobComputedPixels;
+	sf::Vector2i m_shiftDone;
+	// Picked by the render thread, 0 until then
+	int m_chosenIters;
+	// Limit the full resolution was raised to, 0 until done and -1 when
+	// the kept orbits did not cover it
+	int m_raisedIters;
+	// Where the orbits of the full resolution stopped, only jobs touch it
+	OrbitState m_orbitState;
+	uint32_t m_samplePass;
+	uint64_t m_sampleActive;
+	// The CPU backend only runs here, so the event loop never waits for
+	// it. Declared after everything its jobs touch, it stops first.
+	RenderThread m_renderThread;
+
 	bool m_mousePressed;
 	ui::Vec2d m_startPos;
 
+	// The time between two stage switches goes to the stage that ran
+	enum class Stage
+	{
+		Iterate,
+		Upload,
+		Color,
+		Accumulate,
+		Present,
+		Other
+	};
+
+	// Switches to a stage for the rest of the scope
+	class StageScope
+	{
+	private:
+		MandelbrotGraph& m_graph;
+		Stage m_previous;
+
+	public:
+		StageScope(MandelbrotGraph& graph, Stage stage) : m_graph(graph), m_previous(graph.SwitchStage(stage)) {}
+		~StageScope() { m_graph.SwitchStage(m_previous); }
+	};
+
+	FrameStats m_frameStats;
+	FrameStats m_lastFrameStats;
+	uint64_t m_frameCount;
+	Stage m_stage;
+	std::chrono::steady_clock::time_point m_stageStart;
+	std::chrono::steady_clock::time_point m_lastDrawEnd;
+	const sf::Font* m_overlayFont;
+	bool m_showOverlay;
+	std::ofstream m_trace;
+
 	void Resize();
 	void UpdateRange();
+	void UpdatePrecision();
+	void LoadIterationShader();
+	void SnapToCacheGrid();
+	void BeginRender();
+	bool Refine(std::chrono::steady_clock::time_point deadline);
+	bool RefineCpu(int index);
+	bool RefineGpu(int index, std::chrono::steady_clock::time_point deadline);
+	Stage SwitchStage(Stage stage);
+	bool IsProfiling() const;
+	void AddRendererStats(const RenderStats& stats);
+	void FinishFrameStats();
+	void DrawOverlay(sf::RenderWindow& window) const;
+	void UploadRows(Level& level, uint first, uint last);
+	void ShowRows(int index, uint first, uint last);
+	void ColorizeLevels();
+	void RenderShifted();
+	bool TakeShift();
+	bool TakeAutoIters();
+	bool TakeRaise();
+	void TakeJobStats();
+	void ApplyMaxIters(int maxIters);
+	void StopCpuJob();
+	void RenderLevels(uint64_t generation, int first, const std::array<RenderView, LevelCount>& views, const std::atomic<bool>& cancelled);
+	bool PublishRows(uint64_t generation, int index);
+	void SubmitShift();
+	void SubmitRaise(int maxIters);
+	void SubmitSamples(uint32_t pass);
+	void ShiftTarget(sf::RenderTexture& target, const sf::Vector2i& shift);
+	void UpdateMask(bool init);
+	void AccumulateCpu();
+	void IterateGpu(sf::RenderTexture& target, const sf::Shape& shape, float scale, const sf::Texture* mask = nullptr, bool countStats = false);
+	void Colorize(const sf::Texture& iterations, const sf::BlendMode& blend, float alpha, const sf::Shape& shape, float scale, const sf::Texture* mask = nullptr);
+	const sf::Texture& GetLevelTexture(const Level& level) const;
+	const sf::Texture& GetIterationTexture() const;
+	RenderView GetLevelView(const Level& level) const;
+	bool UseCpu() const;
+	double GetPixelSize() const;
+	RenderView GetRenderView() const;
 
 public:
 	MandelbrotGraph();
@@ -84,16 +327,99 @@ public:
 	void CheckInput(const sf::RenderWindow& window, ui::Event& e);
 	void Draw(sf::RenderWindow& window);
 
+	// Moves the view by a screen space offset, keeping the pixels that stay
+	// visible
+	void Pan(const ui::Vec2d& pixels);
+
 	void SetRadius(double radius);
+	void SetRadius(const BigFixed& radius);
 	void SetPosition(const ui::Vec2d& pos);
 	void SetSize(const ui::Vec2u& size);
+	// A higher limit on a finished image of the CPU backend only continues
+	// the pixels that ran out of iterations, without distance sampling
 	void SetMaxIters(int maxIters);
+	int GetMaxIters() const;
+	// Picks maxIters whenever the render starts over, pans keep it. Both
+	// backends wait for the CPU to sample the view first.
+	void SetAutoIters(bool enabled);
+	bool IsAutoIters() const;
 	void SetCenter(const ui::Vec2d& center);
+	void SetCenter(const BigFixed& x, const BigFixed& y);
 	void SetColorFunc(const ColorFunction& colorFunc);
+	void SetBackend(Backend backend);
+	Backend GetBackend() const;
+	void SetPrecision(Precision precision);
+	Precision GetPrecision() const;
+	// Renders 1/16, then 1/4 and then all of the pixels. The GPU spends at
+	// most the frame budget per Draw, the CPU backend renders on a thread
+	// of its own and Draw shows the rows it finished.
+	void SetProgressive(bool progressive);
+	bool IsProgressive() const;
+	void SetFrameBudget(double milliseconds);
+	double GetFrameBudget() const;
+	// Anti aliasing samples a pixel takes before it may stop, when none of
+	// them differed from the base image
+	void SetMinSamples(int minSamples);
+	int GetMinSamples() const;
+	// Cardioid/bulb test and periodicity checking, in every backend
+	void SetInteriorChecks(bool enabled);
+	bool GetInteriorChecks() const;
+	// Mariani-Silver only applies to the CPU backend, the GPU one always
+	// computes every pixel
+	void SetRenderMode(RenderMode mode);
+	RenderMode GetRenderMode() const;
+	// Escape-time formula of both backends, compiled into the shader and
+	// into the CPU kernels. Formulas other than Mandelbrot go past the
+	// double precision limit in double-double and quad-double on the CPU.
+	void SetFormula(Formula formula);
+	Formula GetFormula() const;
+	void SetMultibrotPower(int power);
+	int GetMultibrotPower() const;
+	void SetJuliaC(double x, double y);
+	ui::Vec2d GetJuliaC() const;
+	// Keeps the iterations of the CPU backend in tiles, so views seen
+	// before do not have to be iterated again. Zoom steps and the center
+	// snap to the cache's pixel grid while it is on.
+	void SetTileCacheEnabled(bool enabled);
+	bool IsTileCacheEnabled() const;
+	TileCache& GetTileCache();
+	// Anti aliasing for the CPU backend, which has none otherwise. The
+	// renderer then estimates distances and does not use the tile cache.
+	void SetDistanceSampling(bool enabled);
+	bool IsDistanceSampling() const;
+	// Of the image being anti aliased, samples counts the center ones too
+	const SamplingStats& GetSamplingStats() const;
+	// Writes the full resolution counts of the finished image, only the CPU
+	// backend keeps them
+	bool SaveIterations(const std::string& path, bool compressed = true) const;
+	// Shows the counts of a file rendered at the graph's size and moves to
+	// its view, they are colored like rendered ones
+	bool LoadIterations(const std::string& path);
+	// Stands in for the coarsest level of the next render with counts of
+	// the view rendered at another size, such as a location's thumbnail,
+	// so something shows at once. Only the CPU backend rendering
+	// progressively takes it, and only at the same maxIters. Call it after
+	// moving to the view.
+	void SetPreview(const IterationBuffer& counts, const RenderView& view);
+	// Of the full resolution image, since it was last started over
+	const RenderStats& GetRenderStats() const;
+	// Of the last Draw
+	const FrameStats& GetFrameStats() const;
+	// Shows the frame stats over the image. While the overlay or a trace
+	// is on the stages wait for the GPU, so GPU work is timed where it is
+	// issued.
+	void SetStatsOverlay(bool show, const sf::Font& font);
+	bool IsStatsOverlayShown() const;
+	// Appends the stats of every frame to a CSV file
+	bool StartStatsTrace(const std::string& path);
+	void StopStatsTrace();
+	bool IsTracingStats() const;
 
 	std::pair<ui::Vec2d, ui::Vec2d> GetRange();
 	ui::Vec2d GetCenter();
 	double GetRadius();
+	std::pair<BigFixed, BigFixed> GetExactCenter() const;
+	const BigFixed& GetExactRadius() const;
 
 	void SetUniform(const std::string& name, float val);
 	float GetUniform(const std::string& name);
@@ -1,8 +1,53 @@
 #if 1
 #include <UITools.h>
+#include <deque>
 #include <iomanip>
+#include <mutex>
+#include <thread>
 
 #include "MandelbrotGraph.h"
+#include <LocationLibrary.h>
+#include <Palette.h>
+
+static const char* LocationsPath = "locations.txt";
+
+// What the next console line answers
+enum class ConsolePrompt
+{
+	None,
+	MaxIters,
+	LocationName,
+	GoToLocation
+};
+
+// The console is read on a thread of its own, a prompt never stops the
+// event loop
+static std::mutex g_consoleMutex;
+static std::deque<std::string> g_consoleLines;
+
+static void StartConsoleReader()
+{
+	std::thread([]()
+	{
+		std::string line;
+		while (std::getline(std::cin, line))
+		{
+			std::lock_guard<std::mutex> lock(g_consoleMutex);
+			g_consoleLines.push_back(line);
+		}
+	}).detach();
+}
+
+static bool TryGetConsoleLine(std::string& line)
+{
+	std::lock_guard<std::mutex> lock(g_consoleMutex);
+	if (g_consoleLines.empty())
+		return false;
+
+	line = std::move(g_consoleLines.front());
+	g_consoleLines.pop_front();
+	return true;
+}
 
 int main()
 {
@@ -14,6 +59,7 @@ int main()
 	sf::RenderWindow window({ windowSize.x, windowSize.y }, "Graph", sf::Style::Default, settings);
 	window.setFramerateLimit(120);
 
+	// In the order of Palette, locations refer to them by GetPaletteName
 	std::vector<ColorFunction> colors;
 
 	colors.push_back(ColorFunction(R"(
@@ -84,40 +130,40 @@ vec3 get_color(int i)
 	sf::Font font;
 	font.loadFromFile("rsc/Consolas.ttf");
 
-	{
-		graph.SetCenter({ -0.5, 0 });
-		graph.SetRadius(1.1);
-
-		//graph.SetCenter({ 0.270925, 0.004725 });
-		//graph.SetRadius(0.0001);
-
-		//graph.SetCenter({ -0.745428, 0.113009 });
-		//graph.SetRadius(3.0e-5);
-
-		//graph.SetCenter({ -1.25223118015508028122, 0.03755885941558481655 });
-		//graph.SetRadius(3.6e-8);
-
-		//graph.SetCenter({ -1.2519620871808931906, 0.037393550920969360896 });
-		//graph.SetRadius(1.45e-08);
-
-		//graph.SetCenter({-0.747747, 0.124517});
-		//graph.SetRadius(1.0e-4);
-
-		//graph.SetCenter({ -1.25066, 0.02012 });
-		//graph.SetRadius(1.7e-4);
-
-		//graph.SetCenter({ -0.748, 0.1 });
-		//graph.SetRadius(0.0014);
-
-		//graph.SetCenter({ -0.514814, 0.6111110539 });
-		//graph.SetRadius(0.1);
-
-		//graph.SetCenter({ -0.7461860152692163517, 0.095926522548036297078 });
-		//graph.SetRadius(0.0035131274618377607462);
+	graph.SetCenter({ -0.5, 0 });
+	graph.SetRadius(1.1);
 
-		//graph.SetCenter({ -0.74656412896776469523, 0.098865810107694587772 });
-		//graph.SetRadius(8.2212188006580699331e-12);
+	// Starts out with a few places worth a look
+	LocationLibrary library;
+	if (!library.Load(LocationsPath))
+	{
+		const char* defaults[][4] = {
+			{ "Overview", "-0.5", "0", "1.1" },
+			{ "Elephant valley", "0.270925", "0.004725", "0.0001" },
+			{ "Seahorse valley", "-0.745428", "0.113009", "3.0e-5" },
+			{ "Seahorse spirals", "-0.7461860152692163517", "0.095926522548036297078", "0.0035131274618377607462" },
+			{ "Seahorse valley, deep", "-0.74656412896776469523", "0.098865810107694587772", "8.2212188006580699331e-12" },
+			{ "Seahorse tail", "-0.747747", "0.124517", "1.0e-4" },
+			{ "Seahorse valley, wide", "-0.748", "0.1", "0.0014" },
+			{ "Period 2 bulb, tip", "-1.25066", "0.02012", "1.7e-4" },
+			{ "Period 2 bulb, deep", "-1.25223118015508028122", "0.03755885941558481655", "3.6e-8" },
+			{ "Period 2 bulb, deeper", "-1.2519620871808931906", "0.037393550920969360896", "1.45e-08" },
+			{ "Cardioid edge", "-0.514814", "0.6111110539", "0.1" }
+		};
+
+		for (const auto& d : defaults)
+		{
+			Location location;
+			location.name = d[0];
+			location.centerX = BigFixed(d[1]);
+			location.centerY = BigFixed(d[2]);
+			location.radius = BigFixed(d[3]);
+			location.uniforms.emplace_back("colorMult", GetDefaultColorMult(Palette::Gradient));
+			library.Add(location);
+		}
+		library.Save(LocationsPath);
 	}
+	library.EnableThumbnails();
 
 	ui::Vec2u toolsSize = { 600, 300 };
 	sf::RenderWindow toolsWindow({ toolsSize.x, toolsSize.y }, "Tools :)", sf::Style::Close);
@@ -226,6 +272,70 @@ void main()
 
 	sf::Clock c;
 
+	// The view and everything it is rendered and colored with
+	auto SaveLocation = [&](const std::string& name)
+	{
+		Location location;
+		location.name = name;
+		auto [x, y] = graph.GetExactCenter();
+		location.centerX = x;
+		location.centerY = y;
+		location.radius = graph.GetExactRadius();
+		location.maxIters = graph.GetMaxIters();
+		location.formula = graph.GetFormula();
+		location.power = graph.GetMultibrotPower();
+		location.juliaX = graph.GetJuliaC().x;
+		location.juliaY = graph.GetJuliaC().y;
+		location.color = GetPaletteName((Palette)currentColorIndex);
+		for (const auto& u : colors[currentColorIndex].GetUniforms())
+			location.uniforms.emplace_back(u.name, u.default_val);
+		location.aspect = (double)windowSize.x / windowSize.y;
+
+		size_t index = library.Add(location);
+		if (library.Save(LocationsPath))
+			std::cout << "Location " << index + 1 << " saved to " << LocationsPath << '\n';
+		else
+			std::cout << "Cannot write " << LocationsPath << '\n';
+	};
+
+	// The thumbnail shows until the render catches up, if it is done
+	auto GoToLocation = [&](size_t index)
+	{
+		Location location = library.Get(index);
+
+		Palette palette;
+		if (ParsePalette(location.color, palette) && (size_t)palette < colors.size())
+			currentColorIndex = (size_t)palette;
+		for (auto& u : colors[currentColorIndex].GetUniforms())
+		{
+			for (const auto& [name, value] : location.uniforms)
+			{
+				if (name == u.name)
+					u.default_val = value;
+			}
+		}
+		graph.SetColorFunc(colors[currentColorIndex]);
+		UpdateSliders();
+
+		graph.SetFormula(location.formula);
+		graph.SetMultibrotPower(location.power);
+		graph.SetJuliaC(location.juliaX, location.juliaY);
+		graph.SetAutoIters(false);
+		graph.SetMaxIters(location.maxIters);
+		graph.SetCenter(location.centerX, location.centerY);
+		graph.SetRadius(location.radius);
+
+		IterationBuffer thumbnail;
+		RenderView view;
+		if (library.GetThumbnail(index, thumbnail, view))
+			graph.SetPreview(thumbnail, view);
+
+		std::cout << "Location: " << location.name << '\n';
+	};
+
+	StartConsoleReader();
+	ConsolePrompt prompt = ConsolePrompt::None;
+
 	while (window.isOpen())
 	{
 		ui::Event e;
@@ -252,21 +362,163 @@ void main()
 			{
 				if (e.key.code == sf::Keyboard::Space)
 				{
-					auto [xRange, yRange] = graph.GetRange();
-
-					std::cout << std::setprecision(20) << "Center: " << graph.GetCenter() << " Radius: " << graph.GetRadius() << '\n';
+					// Every digit, a deep view needs them to be found again
+					auto [x, y] = graph.GetExactCenter();
+					std::cout << "Center: " << x.ToString() << ' ' << y.ToString() << " Radius: " << graph.GetExactRadius().ToString() << '\n';
 				}
 				if (e.key.code == sf::Keyboard::Return)
 				{
-					std::cout << "New max iters: ";
-					int maxIters;
-					std::cin >> maxIters;
-					graph.SetMaxIters(maxIters);
+					std::cout << "New max iters: " << std::flush;
+					prompt = ConsolePrompt::MaxIters;
+				}
+				if (e.key.code == sf::Keyboard::D)
+				{
+					std::cout << "Save location as: " << std::flush;
+					prompt = ConsolePrompt::LocationName;
+				}
+				if (e.key.code == sf::Keyboard::G)
+				{
+					for (size_t i = 0; i < library.GetCount(); i++)
+						std::cout << i + 1 << ". " << library.Get(i).name << '\n';
+					std::cout << "Go to location (number or name): " << std::flush;
+					prompt = ConsolePrompt::GoToLocation;
+				}
+				if (e.key.code >= sf::Keyboard::Num1 && e.key.code <= sf::Keyboard::Num9)
+				{
+					size_t index = e.key.code - sf::Keyboard::Num1;
+					if (index < library.GetCount())
+						GoToLocation(index);
 				}
 				if (e.key.code == sf::Keyboard::C)
 				{
 					graph.SetCenter({ 0, 0 });
 				}
+				if (e.key.code == sf::Keyboard::B)
+				{
+					bool cpu = graph.GetBackend() == MandelbrotGraph::Backend::GPU;
+					graph.SetBackend(cpu ? MandelbrotGraph::Backend::CPU : MandelbrotGraph::Backend::GPU);
+					std::cout << "Backend: " << (cpu ? "CPU" : "GPU") << '\n';
+				}
+				if (e.key.code == sf::Keyboard::P)
+				{
+					graph.SetProgressive(!graph.IsProgressive());
+					std::cout << "Progressive: " << (graph.IsProgressive() ? "on" : "off") << '\n';
+				}
+				if (e.key.code == sf::Keyboard::I)
+				{
+					graph.SetInteriorChecks(!graph.GetInteriorChecks());
+					std::cout << "Interior checks: " << (graph.GetInteriorChecks() ? "on" : "off") << '\n';
+				}
+				if (e.key.code == sf::Keyboard::M)
+				{
+					bool fill = graph.GetRenderMode() == RenderMode::BruteForce;
+					graph.SetRenderMode(fill ? RenderMode::MarianiSilver : RenderMode::BruteForce);
+					std::cout << "Render mode: " << (fill ? "Mariani-Silver" : "brute force") << '\n';
+				}
+				if (e.key.code == sf::Keyboard::K)
+				{
+					graph.SetTileCacheEnabled(!graph.IsTileCacheEnabled());
+					std::cout << "Tile cache: " << (graph.IsTileCacheEnabled() ? "on" : "off") << '\n';
+				}
+				if (e.key.code == sf::Keyboard::F)
+				{
+					Formula formula = (Formula)(((int)graph.GetFormula() + 1) % ((int)Formula::Julia + 1));
+					graph.SetFormula(formula);
+					std::cout << "Formula: " << GetFormulaName(formula) << '\n';
+				}
+				if (e.key.code == sf::Keyboard::N)
+				{
+					int power = graph.GetMultibrotPower() < MaxMultibrotPower ? graph.GetMultibrotPower() + 1 : MinMultibrotPower;
+					graph.SetMultibrotPower(power);
+					std::cout << "Multibrot power: " << power << '\n';
+				}
+				if (e.key.code == sf::Keyboard::J)
+				{
+					// The Julia set of the point under the mouse
+					ui::Vec2d c = graph.MapCoordsToPos((ui::Vec2d)sf::Mouse::getPosition(window));
+					graph.SetJuliaC(c.x, c.y);
+					graph.SetFormula(Formula::Julia);
+					graph.SetCenter({ 0, 0 });
+					graph.SetRadius(1.5);
+					std::cout << std::setprecision(10) << "Julia c: " << c.x << ' ' << c.y << '\n';
+				}
+				if (e.key.code == sf::Keyboard::A)
+				{
+					graph.SetDistanceSampling(!graph.IsDistanceSampling());
+					std::cout << "CPU anti aliasing by distance: " << (graph.IsDistanceSampling() ? "on" : "off") << '\n';
+				}
+				if (e.key.code == sf::Keyboard::U)
+				{
+					graph.SetAutoIters(!graph.IsAutoIters());
+					std::cout << "Auto max iters: " << (graph.IsAutoIters() ? "on" : "off") << '\n';
+				}
+				if (e.key.code == sf::Keyboard::O)
+				{
+					graph.SetStatsOverlay(!graph.IsStatsOverlayShown(), font);
+				}
+				if (e.key.code == sf::Keyboard::T)
+				{
+					if (graph.IsTracingStats())
+					{
+						graph.StopStatsTrace();
+						std::cout << "Frame stats trace stopped\n";
+					}
+					else if (graph.StartStatsTrace("frame_stats.csv"))
+					{
+						std::cout << "Tracing frame stats to frame_stats.csv\n";
+					}
+				}
+				if (e.key.code == sf::Keyboard::S)
+				{
+					if (graph.SaveIterations("iterations.mbi"))
+						std::cout << "Iterations saved to iterations.mbi\n";
+					else
+						std::cout << "Nothing to save, the image has to be finished on the CPU backend\n";
+				}
+				if (e.key.code == sf::Keyboard::L)
+				{
+					if (graph.LoadIterations("iterations.mbi"))
+						std::cout << "Iterations loaded from iterations.mbi\n";
+					else
+						std::cout << "Cannot load iterations.mbi, it has to exist and match the window size\n";
+				}
+			}
+		}
+
+		// Lines typed without a prompt are dropped
+		std::string line;
+		while (TryGetConsoleLine(line))
+		{
+			ConsolePrompt answered = prompt;
+			prompt = ConsolePrompt::None;
+
+			if (answered == ConsolePrompt::MaxIters)
+			{
+				int maxIters = std::atoi(line.c_str());
+				if (maxIters > 0)
+				{
+					// A limit typed in replaces the picked ones
+					graph.SetAutoIters(false);
+					graph.SetMaxIters(maxIters);
+				}
+				else
+					std::cout << "Not a max iters: " << line << '\n';
+			}
+			else if (answered == ConsolePrompt::LocationName)
+			{
+				if (!line.empty())
+					SaveLocation(line);
+			}
+			else if (answered == ConsolePrompt::GoToLocation)
+			{
+				int index = library.Find(line);
+				if (index < 0)
+					index = std::atoi(line.c_str()) - 1;
+
+				if (index >= 0 && (size_t)index < library.GetCount())
+					GoToLocation(index);
+				else
+					std::cout << "No location " << line << '\n';
 			}
 		}
 
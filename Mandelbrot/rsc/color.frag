@@ -0,0 +1,29 @@
+uniform int maxIters;
+uniform float alpha;
+// Screen pixels per texel of the iterations
+uniform float scale;
+uniform sampler2D iterations;
+// Skip the pixels whose mask is 0
+uniform bool masked;
+uniform sampler2D mask;
+
+out vec4 outColor;
+
+// Iteration count plus smooth fraction, stored as float bits in RGBA8
+float fetch_iterations()
+{
+    uvec4 b = uvec4(texelFetch(iterations, ivec2(gl_FragCoord.xy / scale), 0) * 255.0 + 0.5);
+    return uintBitsToFloat(b.r | (b.g << 8) | (b.b << 16) | (b.a << 24));
+}
+
+void main()
+{
+    if (masked && texelFetch(mask, ivec2(gl_FragCoord.xy), 0).r < 0.5)
+        discard;
+
+    int iter = int(fetch_iterations());
+    if (iter == maxIters)
+        outColor = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    else
+        outColor = vec4(get_color(iter).xyz, alpha);
+}
@@ -1,10 +1,38 @@
 //#version 450 core
 
+// FORMULA and POWER are defined in front of this file, FORMULA in the order
+// of Formula in Kernel.h. Each formula is its own shader, so the loop has
+// no branch on it.
+#define MANDELBROT 0
+#define MULTIBROT 1
+#define BURNING_SHIP 2
+#define TRICORN 3
+#define JULIA 4
+
 uniform uvec2 size;
 uniform highp dvec2 xRange;
 uniform dvec2 yRange;
 uniform int maxIters;
 uniform int frame;
+// c of JULIA, where z starts at the pixel instead
+uniform dvec2 juliaC;
+// Pixels of the level being rendered are scale x scale screen pixels
+uniform float scale;
+// Skip the pixels whose mask is 0
+uniform bool masked;
+uniform sampler2D mask;
+
+// Cardioid/bulb test and periodicity checking, rejected pixels are counted
+// when countStats is set
+uniform bool interiorChecks;
+uniform double periodEpsilon;
+uniform bool countStats;
+
+layout(std430, binding = 0) buffer InteriorStats
+{
+    uint cardioidRejected;
+    uint periodRejected;
+};
 
 out vec4 outColor;
 
@@ -17,44 +45,106 @@ double rand(float s) {
     return fract(sin(s * 12.9898) * 43758.5453);
 }
 
-int get_iterations()
+bool in_cardioid_or_bulb(double x, double y)
+{
+    double y2 = y * y;
+    double q = (x - 0.25) * (x - 0.25) + y2;
+    return q * (q + x - 0.25) <= 0.25 * y2 || (x + 1) * (x + 1) + y2 <= 0.0625;
+}
+
+float get_iterations()
 {
     dvec2 screen_pos = gl_FragCoord.xy;
-    dvec2 pos = screen_pos + dvec2(rand(frame), rand(frame));
+    dvec2 pos = screen_pos * scale + dvec2(rand(frame), rand(frame));
 
     double x0 = map(pos.x, 0, size.x, xRange.x, xRange.y);
     double y0 = map(pos.y, 0, size.y, yRange.x, yRange.y);
 
+#if FORMULA == MANDELBROT
+    if (interiorChecks && in_cardioid_or_bulb(x0, y0))
+    {
+        if (countStats)
+            atomicAdd(cardioidRejected, 1u);
+        return float(maxIters);
+    }
+#endif
+
+#if FORMULA == JULIA
+    double x = x0;
+    double y = y0;
+    double cx = juliaC.x;
+    double cy = juliaC.y;
+#else
     double x = 0;
     double y = 0;
-    double x2 = 0;
-    double y2 = 0;
+    double cx = x0;
+    double cy = y0;
+#endif
+    double x2 = x * x;
+    double y2 = y * y;
+
+    // Brent: compare with a point saved at every power of two iterations
+    dvec2 saved = dvec2(1e300lf);
+    int saveAt = 1;
 
     int i;
     for (i = 0; i < maxIters && x2 + y2 <= 4; i++)
     {
-        y = 2 * x * y + y0;
-        x = x2 - y2 + x0;
+        if (interiorChecks)
+        {
+            dvec2 e = dvec2(x, y) - saved;
+            if (dot(e, e) <= periodEpsilon * periodEpsilon)
+            {
+                if (countStats)
+                    atomicAdd(periodRejected, 1u);
+                return float(maxIters);
+            }
+
+            if (i == saveAt)
+            {
+                saved = dvec2(x, y);
+                saveAt *= 2;
+            }
+        }
+
+#if FORMULA == MULTIBROT
+        dvec2 p = dvec2(x, y);
+        for (int k = 1; k < POWER; k++)
+            p = dvec2(p.x * x - p.y * y, p.x * y + p.y * x);
+        x = p.x + cx;
+        y = p.y + cy;
+#elif FORMULA == BURNING_SHIP
+        y = abs(2 * x * y) + cy;
+        x = x2 - y2 + cx;
+#elif FORMULA == TRICORN
+        y = cy - 2 * x * y;
+        x = x2 - y2 + cx;
+#else
+        y = 2 * x * y + cy;
+        x = x2 - y2 + cx;
+#endif
         x2 = x * x;
         y2 = y * y;
     }
-    return i;
+
+    if (i == maxIters)
+        return float(i);
+
+    // Same fraction as GetSmoothFraction() on the CPU
+    float frac = 1.0 - log2(0.5 * log(float(x2 + y2)) / log(2.0)) / log2(float(POWER));
+    return float(i) + clamp(frac, 0.0, 0.999);
 }
 
-vec4 return_value()
+vec4 pack_float(float v)
 {
-    int iter = get_iterations();
-    if (iter == maxIters)
-    {
-        gl_FragDepth = 0.0f;
-        return vec4(0.0f, 0.0f, 0.0f, 0.0f);
-    }
-
-    return vec4(get_color(iter).xyz, 1.0 / (frame + 1.0));
+    uint b = floatBitsToUint(v);
+    return vec4(b & 0xffu, (b >> 8) & 0xffu, (b >> 16) & 0xffu, b >> 24) / 255.0;
 }
 
 void main()
 {
-    if (frame < 100)
-        outColor = return_value();
-}
\ No newline at end of file
+    if (masked && texelFetch(mask, ivec2(gl_FragCoord.xy), 0).r < 0.5)
+        discard;
+
+    outColor = pack_float(get_iterations());
+}
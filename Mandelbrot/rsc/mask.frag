@@ -0,0 +1,61 @@
+// Which pixels still get anti aliasing samples. r is 1 while a pixel is
+// active, g counts (in 255ths) its samples that landed on another iteration
+// count than the base image.
+
+// Standard error of that count's ratio to stop at. The ratio is what the
+// pixel's blend of the two colors converges to, a pixel split in half takes
+// 1 / (4 * maxError^2) = 64 samples, one mostly on either side far fewer.
+const float maxError = 1.0 / 16.0;
+
+uniform bool init;
+uniform int frame;
+uniform int minSamples;
+uniform sampler2D mask;
+uniform sampler2D base;
+uniform sampler2D samples;
+
+out vec4 outColor;
+
+int fetch_iterations(sampler2D tex, ivec2 pos)
+{
+    uvec4 b = uvec4(texelFetch(tex, pos, 0) * 255.0 + 0.5);
+    return int(uintBitsToFloat(b.r | (b.g << 8) | (b.b << 16) | (b.a << 24)));
+}
+
+void main()
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(base, 0);
+    int iter = fetch_iterations(base, pos);
+
+    if (init)
+    {
+        // Start with the pixels on an edge of the base image
+        bool edge = false;
+        for (int y = -1; y <= 1; y++)
+        {
+            for (int x = -1; x <= 1; x++)
+            {
+                ivec2 n = clamp(pos + ivec2(x, y), ivec2(0), size - 1);
+                edge = edge || fetch_iterations(base, n) != iter;
+            }
+        }
+        outColor = vec4(edge ? 1.0 : 0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    vec4 m = texelFetch(mask, pos, 0);
+    if (m.r < 0.5)
+    {
+        outColor = m;
+        return;
+    }
+
+    // Pixels whose samples all agree with the base stop after minSamples,
+    // the others once the ratio of those that did not has settled
+    float changed = floor(m.g * 255.0 + 0.5) + (fetch_iterations(samples, pos) != iter ? 1.0 : 0.0);
+    float ratio = (changed + 1.0) / (float(frame) + 2.0);
+    bool settled = ratio * (1.0 - ratio) <= float(frame) * maxError * maxError;
+    bool active = frame < minSamples || (changed > 0.0 && !settled);
+    outColor = vec4(active ? 1.0 : 0.0, changed / 255.0, 0.0, 1.0);
+}
@@ -0,0 +1,715 @@
+#include <CpuRenderer.h>
+#include <AutoIters.h>
+#include <ImageWriter.h>
+#include <IterationFile.h>
+#include <LocationLibrary.h>
+#include <Palette.h>
+#include <Sampling.h>
+#include <utility.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <string>
+#include <vector>
+
+// Renders views to images without a window, either one image of any size
+// or the frames of a zoom into the center
+struct Options
+{
+	std::string centerX = "-0.5";
+	std::string centerY = "0";
+	std::string radius = "1.1";
+	int maxIters = 1500;
+	// maxIters picked for every view from a sample grid instead
+	bool autoIters = false;
+	Palette palette = Palette::Gradient;
+	float colorMult = -1;
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	uint32_t stripRows = 256;
+	size_t threads = 0;
+	bool marianiSilver = false;
+	Formula formula = Formula::Mandelbrot;
+	int power = 3;
+	double juliaX = -0.123;
+	double juliaY = 0.745;
+	// Anti aliasing samples per pixel at most, 1 is off
+	uint32_t samples = 1;
+	bool uniformSamples = false;
+	std::string output = "mandelbrot.png";
+	// Iteration file to color instead of rendering
+	std::string recolor;
+	bool compress = false;
+
+	// Zoom sequence from radius down to finalRadius, off while frames is 0
+	uint32_t frames = 0;
+	std::string finalRadius;
+	double keyframeZoom = 2;
+};
+
+static void PrintUsage()
+{
+	printf(
+		"usage: MandelbrotCli [options]\n"
+		"  --location FILE NAME\n"
+		"                      view, limit, formula and color of a location the\n"
+		"                      viewer saved, options after it override them\n"
+		"  --center X Y        center, any number of digits (-0.5 0)\n"
+		"  --radius R          half the image height in the plane (1.1)\n"
+		"  --iters N           maxIters (1500), or auto to pick it for every view\n"
+		"  --color NAME        gradient, hsv, exponential or waves (gradient)\n"
+		"  --color-mult M      the palette's colorMult (its viewer default)\n"
+		"  --size WxH          output size in pixels (1920x1080)\n"
+		"  --strip ROWS        rows rendered and written at a time (256)\n"
+		"  --threads N         render threads, 0 for all (0)\n"
+		"  --mariani-silver    fill uniform rectangles instead of iterating them\n"
+		"  --formula NAME      mandelbrot, multibrot, burning-ship, tricorn or julia\n"
+		"                      (mandelbrot), deep views of all but mandelbrot render\n"
+		"                      in double-double and quad-double\n"
+		"  --power N           power of multibrot, 2 to 8 (3)\n"
+		"  --julia X Y         c of julia (-0.123 0.745), also selects julia\n"
+		"  --samples N         anti aliasing samples per pixel at most (1), pixels\n"
+		"                      far from the set by their distance estimate take one\n"
+		"  --uniform-samples   every pixel takes all --samples\n"
+		"  --out FILE          .png, .tif or .tiff (mandelbrot.png), or .mbi to only\n"
+		"                      iterate and keep the counts for --recolor\n"
+		"  --compress          compress the tiles of an .mbi file\n"
+		"  --recolor FILE      color the counts of an .mbi file instead of rendering,\n"
+		"                      the view and size come from the file\n"
+		"\n"
+		"zoom sequence, --out then needs a frame number such as frames/%%05d.png:\n"
+		"  --zoom FRAMES       number of frames, zooming from --radius\n"
+		"  --final-radius R    radius of the last frame\n"
+		"  --keyframe-zoom Z   zoom between rendered keyframes (2)\n");
+}
+
+static bool IsNumber(const std::string& str)
+{
+	char* end = nullptr;
+	std::strtod(str.c_str(), &end);
+	return !str.empty() && *end == '\0';
+}
+
+// Replaces the %d or %0Nd in pattern with frame, empty if there is none
+static std::string FormatFramePath(const std::string& pattern, uint32_t frame)
+{
+	size_t start = pattern.find('%');
+	if (start == std::string::npos)
+		return "";
+
+	size_t end = start + 1;
+	bool pad = end < pattern.size() && pattern[end] == '0';
+	int width = 0;
+	while (end < pattern.size() && isdigit((unsigned char)pattern[end]))
+		width = width * 10 + (pattern[end++] - '0');
+
+	if (end >= pattern.size() || pattern[end] != 'd' || pattern.find('%', end) != std::string::npos)
+		return "";
+
+	std::string number = std::to_string(frame);
+	if ((int)number.size() < width)
+		number.insert(0, width - number.size(), pad ? '0' : ' ');
+
+	return pattern.substr(0, start) + number + pattern.substr(end + 1);
+}
+
+static bool HasExtension(const std::string& path, const char* extension)
+{
+	size_t length = strlen(extension);
+	if (path.size() < length)
+		return false;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		if (tolower((unsigned char)path[path.size() - length + i]) != extension[i])
+			return false;
+	}
+	return true;
+}
+
+// Takes everything a location of the viewer's library keeps
+static bool ApplyLocation(const std::string& path, const std::string& name, Options& options)
+{
+	LocationLibrary library;
+	if (!library.Load(path) || library.Find(name) < 0)
+		return false;
+
+	Location location = library.Get(library.Find(name));
+	if (!ParsePalette(location.color, options.palette))
+		return false;
+
+	options.centerX = location.centerX.ToString(location.centerX.GetPrecision());
+	options.centerY = location.centerY.ToString(location.centerY.GetPrecision());
+	options.radius = location.radius.ToString(location.radius.GetPrecision());
+	options.maxIters = location.maxIters;
+	options.autoIters = false;
+	options.formula = location.formula;
+	options.power = location.power;
+	options.juliaX = location.juliaX;
+	options.juliaY = location.juliaY;
+	options.colorMult = -1;
+	for (const auto& [uniform, value] : location.uniforms)
+	{
+		if (uniform == "colorMult")
+			options.colorMult = value;
+	}
+	return true;
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		auto next = [&](int count) { return i + count < argc; };
+
+		if (arg == "--location" && next(2))
+		{
+			std::string path = argv[++i];
+			if (!ApplyLocation(path, argv[++i], options))
+			{
+				fprintf(stderr, "No location %s in %s\n", argv[i], path.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--center" && next(2))
+		{
+			options.centerX = argv[++i];
+			options.centerY = argv[++i];
+			if (!IsNumber(options.centerX) || !IsNumber(options.centerY))
+				return false;
+		}
+		else if (arg == "--radius" && next(1))
+		{
+			options.radius = argv[++i];
+			if (!IsNumber(options.radius) || std::strtod(options.radius.c_str(), nullptr) <= 0)
+				return false;
+		}
+		else if (arg == "--iters" && next(1))
+		{
+			options.autoIters = std::strcmp(argv[++i], "auto") == 0;
+			if (!options.autoIters)
+				options.maxIters = std::atoi(argv[i]);
+			if (options.maxIters <= 0)
+				return false;
+		}
+		else if (arg == "--color" && next(1))
+		{
+			if (!ParsePalette(argv[++i], options.palette))
+				return false;
+		}
+		else if (arg == "--color-mult" && next(1))
+		{
+			options.colorMult = (float)std::atof(argv[++i]);
+			if (options.colorMult <= 0)
+				return false;
+		}
+		else if (arg == "--size" && next(1))
+		{
+			if (sscanf(argv[++i], "%ux%u", &options.width, &options.height) != 2 || options.width == 0 || options.height == 0)
+				return false;
+		}
+		else if (arg == "--strip" && next(1))
+		{
+			options.stripRows = (uint32_t)std::atoi(argv[++i]);
+			if (options.stripRows == 0)
+				return false;
+		}
+		else if (arg == "--threads" && next(1))
+		{
+			options.threads = (size_t)std::atoi(argv[++i]);
+		}
+		else if (arg == "--mariani-silver")
+		{
+			options.marianiSilver = true;
+		}
+		else if (arg == "--formula" && next(1))
+		{
+			if (!FindFormula(argv[++i], options.formula))
+				return false;
+		}
+		else if (arg == "--power" && next(1))
+		{
+			options.power = std::atoi(argv[++i]);
+			if (options.power < 2 || options.power > MaxMultibrotPower)
+				return false;
+		}
+		else if (arg == "--julia" && next(2))
+		{
+			if (!IsNumber(argv[i + 1]) || !IsNumber(argv[i + 2]))
+				return false;
+			options.formula = Formula::Julia;
+			options.juliaX = std::atof(argv[++i]);
+			options.juliaY = std::atof(argv[++i]);
+		}
+		else if (arg == "--samples" && next(1))
+		{
+			options.samples = (uint32_t)std::atoi(argv[++i]);
+			if (options.samples == 0 || options.samples > 256)
+				return false;
+		}
+		else if (arg == "--uniform-samples")
+		{
+			options.uniformSamples = true;
+		}
+		else if (arg == "--out" && next(1))
+		{
+			options.output = argv[++i];
+		}
+		else if (arg == "--compress")
+		{
+			options.compress = true;
+		}
+		else if (arg == "--recolor" && next(1))
+		{
+			options.recolor = argv[++i];
+		}
+		else if (arg == "--zoom" && next(1))
+		{
+			options.frames = (uint32_t)std::atoi(argv[++i]);
+			if (options.frames < 2)
+				return false;
+		}
+		else if (arg == "--final-radius" && next(1))
+		{
+			options.finalRadius = argv[++i];
+			if (!IsNumber(options.finalRadius) || std::strtod(options.finalRadius.c_str(), nullptr) <= 0)
+				return false;
+		}
+		else if (arg == "--keyframe-zoom" && next(1))
+		{
+			options.keyframeZoom = std::atof(argv[++i]);
+			if (options.keyframeZoom <= 1)
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	if (options.colorMult < 0)
+		options.colorMult = GetDefaultColorMult(options.palette);
+
+	// A zoom has to go in and needs somewhere to put the frame number
+	if (options.frames > 0)
+	{
+		if (options.finalRadius.empty() || BigFixed(options.radius) < BigFixed(options.finalRadius))
+			return false;
+		if (FormatFramePath(options.output, 0).empty() || options.width < 2 || options.height < 2)
+			return false;
+		if (!options.recolor.empty())
+			return false;
+	}
+
+	// Samples need the plane, not stored counts
+	if (options.samples > 1 && (options.frames > 0 || !options.recolor.empty() || HasExtension(options.output, ".mbi")))
+		return false;
+
+	return true;
+}
+
+static RenderView MakeView(const Options& options, const std::string& radius)
+{
+	RenderView view;
+	view.centerX = BigFixed(options.centerX);
+	view.centerY = BigFixed(options.centerY);
+	view.radius = BigFixed(radius);
+	view.width = options.width;
+	view.height = options.height;
+	view.maxIters = options.maxIters;
+
+	// Enough bits to place every pixel, like the viewer does
+	uint32_t bits = std::max({ GetPrecisionForScale(view.GetPixelSize()), view.centerX.GetPrecision(), view.centerY.GetPrecision() });
+	view.centerX.SetPrecision(bits);
+	view.centerY.SetPrecision(bits);
+	view.radius.SetPrecision(bits);
+	return view;
+}
+
+static void SetupRenderer(CpuRenderer& renderer, const Options& options)
+{
+	renderer.SetRenderMode(options.marianiSilver ? RenderMode::MarianiSilver : RenderMode::BruteForce);
+	renderer.SetFormula(options.formula);
+	renderer.SetMultibrotPower(options.power);
+	renderer.SetJuliaC(options.juliaX, options.juliaY);
+}
+
+// With --iters auto, the view's maxIters comes from its samples
+static void ChooseIters(CpuRenderer& renderer, const Options& options, RenderView& view)
+{
+	if (!options.autoIters)
+		return;
+
+	Timer timer;
+	AutoItersStats stats;
+	view.maxIters = ChooseMaxIters(renderer, view, AutoItersOptions(), &stats);
+	printf("maxIters %d from %llu samples, %llu escaped by %d after %d passes, in %.0f ms\n", view.maxIters,
+		(unsigned long long)stats.samples, (unsigned long long)stats.escaped, stats.limit, stats.passes, timer.GetElapsedTime<Timer::milliseconds>());
+}
+
+static CpuColorFunction MakeColorFunction(const Options& options, int maxIters)
+{
+	CpuColorFunction colors = CpuColorFunction::Create(options.palette);
+	colors.SetUniform("colorMult", options.colorMult);
+	colors.Prepare(maxIters);
+	return colors;
+}
+
+// Only iterates, the counts go to an iteration file to be colored later
+static int SaveIterations(const Options& options)
+{
+	RenderView view = MakeView(options, options.radius);
+	CpuRenderer renderer(options.threads);
+	SetupRenderer(renderer, options);
+	ChooseIters(renderer, options, view);
+
+	IterationFileWriter writer;
+	if (!writer.Open(options.output, view, options.compress))
+	{
+		fprintf(stderr, "Cannot open %s\n", options.output.c_str());
+		return 1;
+	}
+
+	IterationBuffer buffer;
+	bool ok = true;
+	Timer timer;
+	for (uint32_t y = 0; y < view.height && ok; y += options.stripRows)
+	{
+		uint32_t rows = std::min(options.stripRows, view.height - y);
+		renderer.RenderRegion(view, buffer, 0, y, view.width, rows);
+		ok = writer.WriteRows(buffer, rows);
+
+		printf("\r%u / %u rows", y + rows, view.height);
+		fflush(stdout);
+	}
+	ok = writer.Close() && ok;
+
+	printf("\n");
+	if (!ok)
+	{
+		fprintf(stderr, "Writing %s failed\n", options.output.c_str());
+		return 1;
+	}
+
+	printf("%s: %ux%u in %.1f s\n", options.output.c_str(), view.width, view.height, timer.GetElapsedTime<Timer::seconds>());
+	return 0;
+}
+
+// The image goes out a strip of rows at a time, so only the strip is ever
+// held in memory. The strips are either rendered or, with --recolor, read
+// from an iteration file.
+static int RenderImage(const Options& options)
+{
+	if (options.recolor.empty() && HasExtension(options.output, ".mbi"))
+		return SaveIterations(options);
+
+	IterationFileReader reader;
+	RenderView view;
+	if (options.recolor.empty())
+	{
+		view = MakeView(options, options.radius);
+	}
+	else
+	{
+		if (!reader.Open(options.recolor))
+		{
+			fprintf(stderr, "Cannot read iterations from %s\n", options.recolor.c_str());
+			return 1;
+		}
+		view = reader.GetView();
+	}
+
+	std::unique_ptr<ImageWriter> writer = ImageWriter::Create(options.output);
+	if (!writer)
+	{
+		fprintf(stderr, "Unknown image format: %s\n", options.output.c_str());
+		return 1;
+	}
+
+	if (!writer->Open(options.output, view.width, view.height))
+	{
+		fprintf(stderr, "Cannot open %s\n", options.output.c_str());
+		return 1;
+	}
+
+	CpuRenderer renderer(options.threads);
+	SetupRenderer(renderer, options);
+	if (options.recolor.empty())
+		ChooseIters(renderer, options, view);
+
+	// Whole bands of tiles, so every tile of the file is decoded once
+	uint32_t stripRows = options.stripRows;
+	if (!options.recolor.empty())
+		stripRows = (stripRows + reader.GetTileSize() - 1) / reader.GetTileSize() * reader.GetTileSize();
+
+	CpuColorFunction colors = MakeColorFunction(options, view.maxIters);
+
+	// One strip is colored while the one before it is written
+	IterationBuffer buffer;
+	std::vector<uint8_t> rgb[2];
+	std::future<bool> written;
+	size_t current = 0;
+	bool ok = true;
+
+	SamplingOptions sampling;
+	sampling.maxSamples = options.samples;
+	sampling.adaptive = !options.uniformSamples;
+	uint64_t samples = 0;
+
+	RenderStats stats;
+	Timer timer;
+	for (uint32_t y = 0; y < view.height && ok; y += stripRows)
+	{
+		uint32_t rows = std::min(stripRows, view.height - y);
+		std::vector<uint8_t>& out = rgb[current];
+		if (options.samples > 1)
+		{
+			samples += RenderAntialiased(renderer, view, 0, y, view.width, rows, colors, sampling, out).samples;
+		}
+		else if (options.recolor.empty())
+		{
+			renderer.RenderRegion(view, buffer, 0, y, view.width, rows);
+			stats += renderer.GetStats();
+		}
+		else if (!reader.ReadRows(y, rows, buffer))
+		{
+			fprintf(stderr, "\n%s is damaged\n", options.recolor.c_str());
+			ok = false;
+			break;
+		}
+
+		if (options.samples == 1)
+		{
+			out.resize((size_t)view.width * rows * 3);
+			renderer.GetPool().ParallelFor(rows, [&](size_t j)
+			{
+				colors.Colorize(buffer.GetRow((uint32_t)j), view.width, out.data() + j * view.width * 3);
+			});
+		}
+
+		if (written.valid())
+			ok = written.get();
+
+		written = std::async(std::launch::async, [&writer, &out, rows]() { return writer->WriteRows(out.data(), rows); });
+		current ^= 1;
+
+		printf("\r%u / %u rows", y + rows, view.height);
+		fflush(stdout);
+	}
+
+	if (written.valid())
+		ok = written.get() && ok;
+	ok = writer->Close() && ok;
+
+	printf("\n");
+	if (!ok)
+	{
+		fprintf(stderr, "Writing %s failed\n", options.output.c_str());
+		return 1;
+	}
+
+	printf("%s: %ux%u in %.1f s", options.output.c_str(), view.width, view.height, timer.GetElapsedTime<Timer::seconds>());
+	if (options.marianiSilver && options.recolor.empty())
+		printf(", %.1f%% filled", 100.0 * stats.filledPixels / ((double)view.width * view.height));
+	if (options.samples > 1)
+		printf(", %.2f samples per pixel", samples / ((double)view.width * view.height));
+	printf("\n");
+	return 0;
+}
+
+// Bilinear lookup in a packed RGB image, (u, v) in pixel centers
+static void Sample(const std::vector<uint8_t>& image, uint32_t width, uint32_t height, double u, double v, uint8_t* out)
+{
+	u = std::min(std::max(u, 0.0), width - 1.0);
+	v = std::min(std::max(v, 0.0), height - 1.0);
+	uint32_t x0 = std::min((uint32_t)u, width - 2);
+	uint32_t y0 = std::min((uint32_t)v, height - 2);
+	double fx = u - x0;
+	double fy = v - y0;
+
+	const uint8_t* p00 = image.data() + ((size_t)y0 * width + x0) * 3;
+	const uint8_t* p10 = p00 + 3;
+	const uint8_t* p01 = p00 + (size_t)width * 3;
+	const uint8_t* p11 = p01 + 3;
+	for (int c = 0; c < 3; c++)
+	{
+		double top = p00[c] + (p10[c] - p00[c]) * fx;
+		double bottom = p01[c] + (p11[c] - p01[c]) * fx;
+		out[c] = (uint8_t)(top + (bottom - top) * fy + 0.5);
+	}
+}
+
+static bool WriteImage(const std::string& path, const std::vector<uint8_t>& rgb, uint32_t width, uint32_t height)
+{
+	// Written under another name first, a frame that exists is complete
+	std::string partial = path + ".part";
+	std::unique_ptr<ImageWriter> writer = ImageWriter::Create(path);
+	if (!writer || !writer->Open(partial, width, height))
+		return false;
+
+	bool ok = writer->WriteRows(rgb.data(), height);
+	ok = writer->Close() && ok;
+
+	std::error_code error;
+	if (ok)
+		std::filesystem::rename(partial, path, error);
+	return ok && !error;
+}
+
+// Keyframes are rendered every keyframeZoom times deeper, the frames
+// between two of them are resampled from both: the inner one where it
+// covers the frame, the outer one around it. Every keyframe has the same
+// center and precision, so the reference orbit of a deep zoom is computed
+// once. Frames already on disk are skipped, which resumes a stopped run.
+static int RenderZoom(const Options& options)
+{
+	const uint32_t width = options.width;
+	const uint32_t height = options.height;
+	const double logZoom = std::log(options.keyframeZoom);
+
+	// The deepest view sets the precision of all of them
+	RenderView deepest = MakeView(options, options.finalRadius);
+	RenderView view = MakeView(options, options.radius);
+	uint32_t bits = deepest.centerX.GetPrecision();
+	view.centerX.SetPrecision(bits);
+	view.centerY.SetPrecision(bits);
+	view.radius.SetPrecision(bits);
+
+	// Frames are evenly spaced in log(radius)
+	double depth = std::log(view.radius.ToDouble() / deepest.radius.ToDouble());
+	uint32_t lastKeyframe = std::max(1u, (uint32_t)std::ceil(depth / logZoom - 1e-9));
+	auto frameDepth = [&](uint32_t f) { return depth * f / (options.frames - 1); };
+	auto keyframeOf = [&](uint32_t f) { return std::min((uint32_t)(frameDepth(f) / logZoom), lastKeyframe); };
+
+	std::filesystem::path directory = std::filesystem::path(FormatFramePath(options.output, 0)).parent_path();
+	if (!directory.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+	}
+
+	CpuRenderer renderer(options.threads);
+	SetupRenderer(renderer, options);
+	CpuColorFunction colors = MakeColorFunction(options, options.maxIters);
+
+	IterationBuffer buffer;
+	std::map<uint32_t, std::vector<uint8_t>> keyframes;
+	auto getKeyframe = [&](uint32_t k) -> const std::vector<uint8_t>&
+	{
+		std::vector<uint8_t>& rgb = keyframes[k];
+		if (!rgb.empty())
+			return rgb;
+
+		RenderView key = view;
+		for (uint32_t i = 0; i < k; i++)
+			key.radius /= options.keyframeZoom;
+
+		// Every keyframe gets its own limit, deeper ones need more
+		ChooseIters(renderer, options, key);
+		CpuColorFunction keyColors = options.autoIters ? MakeColorFunction(options, key.maxIters) : colors;
+
+		renderer.Render(key, buffer);
+		rgb.resize((size_t)width * height * 3);
+		renderer.GetPool().ParallelFor(height, [&](size_t j)
+		{
+			keyColors.Colorize(buffer.GetRow((uint32_t)j), width, rgb.data() + j * width * 3);
+		});
+
+		printf("keyframe %u / %u%s\n", k, lastKeyframe, renderer.GetStats().referenceOrbits ? ", new reference orbit" : "");
+		return rgb;
+	};
+
+	uint32_t skipped = 0;
+	std::atomic<uint32_t> written(0);
+	std::atomic<bool> ok(true);
+	Timer timer;
+
+	for (uint32_t k = 0; k <= lastKeyframe && ok; k++)
+	{
+		std::vector<uint32_t> pending;
+		for (uint32_t f = 0; f < options.frames; f++)
+		{
+			if (keyframeOf(f) != k)
+				continue;
+
+			if (std::filesystem::exists(FormatFramePath(options.output, f)))
+				skipped++;
+			else
+				pending.push_back(f);
+		}
+
+		// Keyframes nobody needs any more
+		while (!keyframes.empty() && keyframes.begin()->first < k)
+			keyframes.erase(keyframes.begin());
+
+		if (pending.empty())
+			continue;
+
+		const std::vector<uint8_t>& outer = getKeyframe(k);
+		const std::vector<uint8_t>* inner = k < lastKeyframe ? &getKeyframe(k + 1) : nullptr;
+
+		// One frame per job, encoding is the slow part
+		renderer.GetPool().ParallelFor(pending.size(), [&](size_t n)
+		{
+			uint32_t f = pending[n];
+
+			// Size of the frame relative to the outer keyframe, in (1/zoom, 1]
+			double scale = std::exp(k * logZoom - frameDepth(f));
+			double innerScale = scale * options.keyframeZoom;
+
+			std::vector<uint8_t> rgb((size_t)width * height * 3);
+			uint8_t* out = rgb.data();
+			for (uint32_t j = 0; j < height; j++)
+			{
+				double dy = j + 0.5 - 0.5 * height;
+				for (uint32_t i = 0; i < width; i++, out += 3)
+				{
+					double dx = i + 0.5 - 0.5 * width;
+					double u = 0.5 * width + dx * innerScale - 0.5;
+					double v = 0.5 * height + dy * innerScale - 0.5;
+					if (inner && u >= 0 && v >= 0 && u <= width - 1 && v <= height - 1)
+						Sample(*inner, width, height, u, v, out);
+					else
+						Sample(outer, width, height, 0.5 * width + dx * scale - 0.5, 0.5 * height + dy * scale - 0.5, out);
+				}
+			}
+
+			if (!WriteImage(FormatFramePath(options.output, f), rgb, width, height))
+				ok = false;
+
+			written++;
+		});
+
+		printf("frames %u / %u\n", skipped + written.load(), options.frames);
+	}
+
+	if (!ok)
+	{
+		fprintf(stderr, "Writing frames failed\n");
+		return 1;
+	}
+
+	printf("%u frames in %.1f s, %u already done\n", written.load(), timer.GetElapsedTime<Timer::seconds>(), skipped);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	return options.frames > 0 ? RenderZoom(options) : RenderImage(options);
+}
@@ -0,0 +1,267 @@
+#include "AutoIters.h"
+#include "KernelImpl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace
+{
+	// Orbits a pass hands out at once
+	constexpr size_t ChunkSize = 64;
+
+	// The samples, one array per value. active lists the ones that neither
+	// escaped nor were found periodic yet and is compacted after every pass.
+	struct Orbits
+	{
+		std::vector<double> cx;
+		std::vector<double> cy;
+		std::vector<double> x;
+		std::vector<double> y;
+		std::vector<uint32_t> iters;
+		// Brent's saved point, taken at every power of two iterations
+		std::vector<double> savedX;
+		std::vector<double> savedY;
+		std::vector<uint8_t> periodic;
+		std::vector<uint32_t> active;
+		// 0 turns the periodicity check off
+		double eps2 = 0;
+	};
+
+	// Same counting and periodicity check as the row kernels, a step is
+	// counted while |z| <= 2
+	template<typename FormulaStep>
+	uint64_t ContinueOrbits(Orbits& orbits, size_t first, size_t last, uint32_t limit)
+	{
+		uint64_t total = 0;
+		for (size_t n = first; n < last; n++)
+		{
+			uint32_t k = orbits.active[n];
+			double x = orbits.x[k];
+			double y = orbits.y[k];
+			double x2 = x * x;
+			double y2 = y * y;
+			double savedX = orbits.savedX[k];
+			double savedY = orbits.savedY[k];
+			uint32_t i = orbits.iters[k];
+			uint32_t start = i;
+			while (i < limit && x2 + y2 <= 4.0)
+			{
+				if (orbits.eps2 > 0)
+				{
+					double ex = x - savedX;
+					double ey = y - savedY;
+					if (ex * ex + ey * ey <= orbits.eps2)
+					{
+						orbits.periodic[k] = 1;
+						break;
+					}
+
+					if ((i & (i - 1)) == 0)
+					{
+						savedX = x;
+						savedY = y;
+					}
+				}
+
+				FormulaStep::Step(x, y, x2, y2, orbits.cx[k], orbits.cy[k]);
+				x2 = x * x;
+				y2 = y * y;
+				i++;
+			}
+
+			orbits.x[k] = x;
+			orbits.y[k] = y;
+			orbits.savedX[k] = savedX;
+			orbits.savedY[k] = savedY;
+			orbits.iters[k] = i;
+			total += i - start;
+		}
+		return total;
+	}
+
+	using ContinueFunction = uint64_t(*)(Orbits& orbits, size_t first, size_t last, uint32_t limit);
+
+	template<int N = MinMultibrotPower>
+	ContinueFunction GetMultibrotFunction(int power)
+	{
+		if constexpr (N < MaxMultibrotPower)
+		{
+			if (power > N)
+				return GetMultibrotFunction<N + 1>(power);
+		}
+		return ContinueOrbits<MultibrotStep<ScalarOps, N>>;
+	}
+
+	ContinueFunction GetContinueFunction(Formula formula, int power)
+	{
+		switch (formula)
+		{
+		case Formula::Multibrot: return power > 2 ? GetMultibrotFunction(power) : ContinueOrbits<MandelbrotStep<ScalarOps>>;
+		case Formula::BurningShip: return ContinueOrbits<BurningShipStep<ScalarOps>>;
+		case Formula::Tricorn: return ContinueOrbits<TricornStep<ScalarOps>>;
+		case Formula::Julia: return ContinueOrbits<JuliaStep<ScalarOps>>;
+		default: return ContinueOrbits<MandelbrotStep<ScalarOps>>;
+		}
+	}
+
+	// A doubling that let hardly any sample escape after some did, or only
+	// a few samples left. Before the first escapes deep views are only
+	// still on their way out.
+	bool IsStable(int passes, uint64_t added, uint64_t escaped, uint64_t remaining, uint64_t allowed)
+	{
+		return remaining <= allowed || (passes > 1 && added <= allowed && escaped > allowed);
+	}
+
+	// Smallest count that at most allowed of the escape counts are above
+	int PickLimit(std::vector<uint32_t>& escapes, uint64_t allowed, const AutoItersOptions& options)
+	{
+		if (escapes.size() <= allowed)
+			return options.minIters;
+
+		auto nth = escapes.end() - 1 - allowed;
+		std::nth_element(escapes.begin(), nth, escapes.end());
+		double limit = std::ceil(*nth * options.margin);
+		return (int)std::min(std::max(limit, (double)options.minIters), (double)options.maxIters);
+	}
+}
+
+int ChooseMaxIters(CpuRenderer& renderer, const RenderView& view, const AutoItersOptions& options, AutoItersStats* stats)
+{
+	// Samples spread evenly over the pixels
+	double step = std::max(1.0, (double)std::max(view.width, view.height) / std::max(options.gridSize, 1u));
+	uint32_t width = std::max(1u, (uint32_t)std::lround(view.width / step));
+	uint32_t height = std::max(1u, (uint32_t)std::lround(view.height / step));
+	const uint64_t samples = (uint64_t)width * height;
+	const uint64_t allowed = (uint64_t)(options.tolerance * samples);
+
+	AutoItersStats result;
+	result.samples = samples;
+	std::vector<uint32_t> escapes;
+
+	if (renderer.ResolvePrecision(view) != Precision::Double)
+	{
+		RenderView probe = view;
+		probe.width = width;
+		probe.height = height;
+
+		bool distance = renderer.IsDistanceEstimation();
+		renderer.SetDistanceEstimation(false);
+
+		IterationBuffer buffer;
+		uint64_t escaped = 0;
+		for (int limit = options.minIters; !renderer.IsCancelled(); limit = std::min(2 * limit, options.maxIters))
+		{
+			probe.maxIters = limit;
+			renderer.Render(probe, buffer);
+			result.passes++;
+			result.limit = limit;
+
+			escapes.clear();
+			for (uint32_t j = 0; j < height; j++)
+			{
+				const uint32_t* iters = buffer.GetRow(j);
+				for (uint32_t i = 0; i < width; i++)
+				{
+					result.iterations += iters[i];
+					if (iters[i] < (uint32_t)limit)
+						escapes.push_back(iters[i]);
+				}
+			}
+
+			uint64_t added = escapes.size() - escaped;
+			escaped = escapes.size();
+			if (IsStable(result.passes, added, escaped, samples - escaped, allowed) || limit >= options.maxIters)
+				break;
+		}
+
+		renderer.SetDistanceEstimation(distance);
+		result.escaped = escapes.size();
+		if (stats)
+			*stats = result;
+		return PickLimit(escapes, allowed, options);
+	}
+
+	// The sample grid as pixels of the view, like the renderer maps them
+	const double pixelSize = view.GetPixelSize();
+	const double minX = view.GetMinX();
+	const double maxY = view.GetMaxY();
+	const Formula formula = renderer.GetFormula();
+	const bool julia = formula == Formula::Julia;
+
+	Orbits orbits;
+	orbits.cx.resize(samples);
+	orbits.cy.resize(samples);
+	orbits.x.resize(samples);
+	orbits.y.resize(samples);
+	orbits.iters.assign(samples, 0);
+	// Far from every orbit until the first save
+	orbits.savedX.assign(samples, 1e300);
+	orbits.savedY.assign(samples, 1e300);
+	orbits.periodic.assign(samples, 0);
+	orbits.active.reserve(samples);
+	if (renderer.GetInteriorChecks())
+	{
+		double epsilon = CpuRenderer::GetPeriodEpsilon(pixelSize);
+		orbits.eps2 = epsilon * epsilon;
+	}
+	for (uint32_t j = 0; j < height; j++)
+	{
+		for (uint32_t i = 0; i < width; i++)
+		{
+			size_t k = (size_t)j * width + i;
+			double px = minX + ((i + 0.5) * view.width / width) * pixelSize;
+			double py = maxY - ((j + 0.5) * view.height / height) * pixelSize;
+
+			// Known interior, it never escapes and is never iterated
+			if (formula == Formula::Mandelbrot && renderer.GetInteriorChecks() && IsInCardioidOrBulb(px, py))
+				continue;
+
+			orbits.cx[k] = julia ? renderer.GetJuliaX() : px;
+			orbits.cy[k] = julia ? renderer.GetJuliaY() : py;
+			orbits.x[k] = julia ? px : 0.0;
+			orbits.y[k] = julia ? py : 0.0;
+			orbits.active.push_back((uint32_t)k);
+		}
+	}
+
+	ContinueFunction continueOrbits = GetContinueFunction(formula, renderer.GetMultibrotPower());
+	for (int limit = options.minIters; !renderer.IsCancelled(); limit = std::min(2 * limit, options.maxIters))
+	{
+		std::atomic<uint64_t> iterations(0);
+		size_t chunks = (orbits.active.size() + ChunkSize - 1) / ChunkSize;
+		renderer.GetPool().ParallelFor(chunks, [&](size_t c)
+		{
+			size_t first = c * ChunkSize;
+			iterations += continueOrbits(orbits, first, std::min(first + ChunkSize, orbits.active.size()), (uint32_t)limit);
+		});
+		result.iterations += iterations;
+		result.passes++;
+		result.limit = limit;
+
+		// Escaped and periodic samples leave the active list for good
+		uint64_t added = 0;
+		size_t kept = 0;
+		for (uint32_t k : orbits.active)
+		{
+			if (orbits.x[k] * orbits.x[k] + orbits.y[k] * orbits.y[k] > 4.0)
+			{
+				escapes.push_back(orbits.iters[k]);
+				added++;
+			}
+			else if (!orbits.periodic[k])
+			{
+				orbits.active[kept++] = k;
+			}
+		}
+		orbits.active.resize(kept);
+
+		if (IsStable(result.passes, added, escapes.size(), kept, allowed) || limit >= options.maxIters)
+			break;
+	}
+
+	result.escaped = escapes.size();
+	if (stats)
+		*stats = result;
+	return PickLimit(escapes, allowed, options);
+}
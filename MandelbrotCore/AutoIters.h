@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CpuRenderer.h"
+
+#include <cstdint>
+
+// Picks maxIters for a view from a sparse grid of its pixels. The grid is
+// iterated to a limit that doubles as long as a doubling still lets more
+// than the tolerance of the samples escape. Samples that did not escape
+// continue from the z they stopped at, escaped ones are never iterated
+// again. maxIters is then the escape count that all but the tolerance of
+// the samples stay below, with a margin for the pixels between them.
+struct AutoItersOptions
+{
+	// Samples along the longer side of the view
+	uint32_t gridSize = 64;
+	int minIters = 256;
+	int maxIters = 1 << 20;
+	// Fraction of the samples that may escape past maxIters, and the one
+	// a doubling has to stay under to stop
+	double tolerance = 0.001;
+	// maxIters over the escape count that meets the tolerance
+	double margin = 1.5;
+};
+
+struct AutoItersStats
+{
+	uint64_t samples = 0;
+	uint64_t escaped = 0;
+	// Of every pass, samples the cardioid test rejected take none
+	uint64_t iterations = 0;
+	// Limit of the last pass
+	int limit = 0;
+	int passes = 0;
+};
+
+// Uses the renderer's formula and threads. Views past double precision
+// are rendered again for every limit as a view with one pixel per sample,
+// perturbation and the multi-double kernels keep no z to continue from.
+// Stops between passes once the renderer is cancelled and picks from what
+// it has.
+int ChooseMaxIters(CpuRenderer& renderer, const RenderView& view, const AutoItersOptions& options, AutoItersStats* stats = nullptr);
@@ -0,0 +1,385 @@
+#include "BigFixed.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Helpers on plain little endian magnitudes of any length
+
+static void MulSmall(std::vector<uint32_t>& n, uint32_t factor)
+{
+	uint64_t carry = 0;
+	for (uint32_t& limb : n)
+	{
+		uint64_t v = (uint64_t)limb * factor + carry;
+		limb = (uint32_t)v;
+		carry = v >> 32;
+	}
+	if (carry)
+		n.push_back((uint32_t)carry);
+}
+
+static void AddSmall(std::vector<uint32_t>& n, uint32_t value)
+{
+	uint64_t carry = value;
+	for (size_t i = 0; i < n.size() && carry; i++)
+	{
+		uint64_t v = (uint64_t)n[i] + carry;
+		n[i] = (uint32_t)v;
+		carry = v >> 32;
+	}
+	if (carry)
+		n.push_back((uint32_t)carry);
+}
+
+static uint32_t DivSmall(std::vector<uint32_t>& n, uint32_t divisor)
+{
+	uint64_t rem = 0;
+	for (size_t i = n.size(); i-- > 0;)
+	{
+		uint64_t v = (rem << 32) | n[i];
+		n[i] = (uint32_t)(v / divisor);
+		rem = v % divisor;
+	}
+	return (uint32_t)rem;
+}
+
+uint32_t GetPrecisionForScale(double scale)
+{
+	if (!(scale > 0))
+		return 64;
+
+	int bits = (int)std::ceil(-std::log2(scale)) + 64;
+	return (uint32_t)std::max(64, bits);
+}
+
+BigFixed::BigFixed()
+	: m_limbs(3, 0)
+	, m_negative(false)
+{
+}
+
+BigFixed::BigFixed(double value, uint32_t precisionBits)
+	: m_negative(false)
+{
+	SetPrecision(precisionBits);
+	std::fill(m_limbs.begin(), m_limbs.end(), 0);
+
+	if (value == 0 || !std::isfinite(value))
+		return;
+
+	m_negative = value < 0;
+
+	// value = mantissa * 2^exp with a 53 bit integer mantissa
+	int exp;
+	double frac = std::frexp(std::abs(value), &exp);
+	uint64_t mantissa = (uint64_t)std::ldexp(frac, 53);
+	exp -= 53;
+
+	// Bit position of the mantissa's lowest bit inside the limbs
+	int64_t shift = (int64_t)exp + 32 * (int64_t)GetFracLimbs();
+	if (shift < 0)
+	{
+		if (shift <= -64)
+			mantissa = 0;
+		else
+			mantissa >>= -shift;
+		shift = 0;
+	}
+
+	for (int b = 0; b < 64; b++)
+	{
+		if (!((mantissa >> b) & 1))
+			continue;
+
+		size_t bit = (size_t)shift + b;
+		if (bit / 32 < m_limbs.size())
+			m_limbs[bit / 32] |= 1u << (bit % 32);
+	}
+	Normalize();
+}
+
+BigFixed::BigFixed(const std::string& str, uint32_t precisionBits)
+	: m_negative(false)
+{
+	size_t pos = 0;
+	bool negative = false;
+	if (pos < str.size() && (str[pos] == '-' || str[pos] == '+'))
+		negative = str[pos++] == '-';
+
+	std::string digits;
+	int64_t exp10 = 0;
+	bool point = false;
+	for (; pos < str.size(); pos++)
+	{
+		char c = str[pos];
+		if (c >= '0' && c <= '9')
+		{
+			digits += c;
+			if (point)
+				exp10--;
+		}
+		else if (c == '.' && !point)
+			point = true;
+		else
+			break;
+	}
+	if (pos < str.size() && (str[pos] == 'e' || str[pos] == 'E'))
+		exp10 += std::atoll(str.c_str() + pos + 1);
+
+	if (precisionBits == 0)
+	{
+		int64_t fracDigits = std::max<int64_t>(0, -exp10);
+		precisionBits = (uint32_t)std::max<int64_t>(64, (int64_t)std::ceil(fracDigits * 3.3219280948873623) + 64);
+	}
+	SetPrecision(precisionBits);
+	size_t fracLimbs = GetFracLimbs();
+
+	// value = digits * 10^exp10, scaled by 2^(32 * fracLimbs)
+	std::vector<uint32_t> n(1, 0);
+	for (char c : digits)
+	{
+		MulSmall(n, 10);
+		AddSmall(n, (uint32_t)(c - '0'));
+	}
+	for (int64_t i = 0; i < exp10; i++)
+		MulSmall(n, 10);
+
+	// One guard limb to round the last kept limb to nearest
+	n.insert(n.begin(), fracLimbs + 1, 0);
+
+	for (int64_t i = 0; i < -exp10; i++)
+		DivSmall(n, 10);
+
+	bool roundUp = (n[0] & 0x80000000u) != 0;
+	n.erase(n.begin());
+	if (roundUp)
+		AddSmall(n, 1);
+
+	n.resize(fracLimbs + 1, 0);
+	m_limbs = n;
+	m_negative = negative;
+	Normalize();
+}
+
+void BigFixed::SetFracLimbs(size_t fracLimbs)
+{
+	size_t current = m_limbs.empty() ? 0 : GetFracLimbs();
+	if (m_limbs.empty())
+		m_limbs.assign(1, 0);
+
+	if (fracLimbs > current)
+		m_limbs.insert(m_limbs.begin(), fracLimbs - current, 0);
+	else if (fracLimbs < current)
+		m_limbs.erase(m_limbs.begin(), m_limbs.begin() + (current - fracLimbs));
+}
+
+void BigFixed::SetPrecision(uint32_t bits)
+{
+	SetFracLimbs(std::max<size_t>(1, (bits + 31) / 32));
+	Normalize();
+}
+
+void BigFixed::Normalize()
+{
+	if (IsZero())
+		m_negative = false;
+}
+
+bool BigFixed::IsZero() const
+{
+	for (uint32_t limb : m_limbs)
+		if (limb)
+			return false;
+	return true;
+}
+
+double BigFixed::ToDouble() const
+{
+	double out = 0;
+	int64_t fracLimbs = (int64_t)GetFracLimbs();
+	for (size_t i = 0; i < m_limbs.size(); i++)
+	{
+		if (m_limbs[i])
+			out += std::ldexp((double)m_limbs[i], (int)(32 * ((int64_t)i - fracLimbs)));
+	}
+	return m_negative ? -out : out;
+}
+
+std::string BigFixed::ToString(uint32_t digits) const
+{
+	std::vector<uint32_t> frac(m_limbs.begin(), m_limbs.end() - 1);
+	if (digits == 0)
+		digits = (uint32_t)(GetPrecision() * 0.30102999566398120);
+
+	// Multiplying the fraction by 10 pushes the next digit into the carry.
+	// One extra digit is produced to round the last one.
+	std::string fracDigits;
+	for (uint32_t d = 0; d <= digits; d++)
+	{
+		MulSmall(frac, 10);
+		uint32_t digit = 0;
+		if (frac.size() > GetFracLimbs())
+		{
+			digit = frac.back();
+			frac.pop_back();
+		}
+		fracDigits += (char)('0' + digit);
+	}
+
+	uint64_t integer = m_limbs.back();
+	bool roundUp = fracDigits.back() >= '5';
+	fracDigits.pop_back();
+	for (size_t i = fracDigits.size(); roundUp && i-- > 0;)
+	{
+		roundUp = fracDigits[i] == '9';
+		fracDigits[i] = roundUp ? '0' : fracDigits[i] + 1;
+	}
+	if (roundUp)
+		integer++;
+
+	while (!fracDigits.empty() && fracDigits.back() == '0')
+		fracDigits.pop_back();
+
+	std::string out = (m_negative && (integer || !fracDigits.empty())) ? "-" : "";
+	out += std::to_string(integer);
+	if (!fracDigits.empty())
+		out += "." + fracDigits;
+
+	return out;
+}
+
+int BigFixed::CompareMagnitude(const BigFixed& a, const BigFixed& b)
+{
+	size_t fa = a.GetFracLimbs();
+	size_t fb = b.GetFracLimbs();
+	size_t f = std::max(fa, fb);
+
+	// Walk both from the integer limb down, aligned on the binary point
+	for (size_t k = f + 1; k-- > 0;)
+	{
+		uint32_t la = (k + fa >= f) ? a.m_limbs[k + fa - f] : 0;
+		uint32_t lb = (k + fb >= f) ? b.m_limbs[k + fb - f] : 0;
+		if (la != lb)
+			return la < lb ? -1 : 1;
+	}
+	return 0;
+}
+
+BigFixed BigFixed::AddSigned(const BigFixed& a, const BigFixed& b, bool negateB)
+{
+	bool bNegative = b.m_negative != negateB;
+
+	size_t f = std::max(a.GetFracLimbs(), b.GetFracLimbs());
+	BigFixed x = a;
+	BigFixed y = b;
+	x.SetFracLimbs(f);
+	y.SetFracLimbs(f);
+	y.m_negative = bNegative;
+
+	BigFixed out;
+	out.m_limbs.assign(f + 1, 0);
+
+	if (x.m_negative == y.m_negative)
+	{
+		uint64_t carry = 0;
+		for (size_t i = 0; i <= f; i++)
+		{
+			uint64_t v = (uint64_t)x.m_limbs[i] + y.m_limbs[i] + carry;
+			out.m_limbs[i] = (uint32_t)v;
+			carry = v >> 32;
+		}
+		out.m_negative = x.m_negative;
+	}
+	else
+	{
+		if (CompareMagnitude(x, y) < 0)
+			std::swap(x, y);
+
+		int64_t borrow = 0;
+		for (size_t i = 0; i <= f; i++)
+		{
+			int64_t v = (int64_t)x.m_limbs[i] - y.m_limbs[i] - borrow;
+			borrow = v < 0;
+			out.m_limbs[i] = (uint32_t)(v + (borrow << 32));
+		}
+		out.m_negative = x.m_negative;
+	}
+
+	out.Normalize();
+	return out;
+}
+
+BigFixed BigFixed::operator-() const
+{
+	BigFixed out = *this;
+	out.m_negative = !m_negative;
+	out.Normalize();
+	return out;
+}
+
+BigFixed BigFixed::operator+(const BigFixed& other) const
+{
+	return AddSigned(*this, other, false);
+}
+
+BigFixed BigFixed::operator-(const BigFixed& other) const
+{
+	return AddSigned(*this, other, true);
+}
+
+BigFixed BigFixed::operator*(const BigFixed& other) const
+{
+	size_t fa = GetFracLimbs();
+	size_t fb = other.GetFracLimbs();
+	size_t f = std::max(fa, fb);
+
+	// The full product has fa + fb fractional limbs, keep the top f of them
+	// and the integer limb
+	size_t drop = fa + fb - f;
+	size_t na = m_limbs.size();
+	size_t nb = other.m_limbs.size();
+
+	std::vector<uint64_t> acc(na + nb + 1, 0);
+	for (size_t i = 0; i < na; i++)
+	{
+		if (!m_limbs[i])
+			continue;
+
+		uint64_t carry = 0;
+		for (size_t j = 0; j < nb; j++)
+		{
+			uint64_t v = (uint64_t)m_limbs[i] * other.m_limbs[j] + (acc[i + j] & 0xffffffff) + carry;
+			acc[i + j] = v & 0xffffffff;
+			carry = v >> 32;
+		}
+		acc[i + nb] += carry;
+	}
+
+	BigFixed out;
+	out.m_limbs.assign(f + 1, 0);
+	for (size_t i = 0; i <= f; i++)
+		out.m_limbs[i] = (uint32_t)acc[i + drop];
+
+	out.m_negative = m_negative != other.m_negative;
+	out.Normalize();
+	return out;
+}
+
+BigFixed BigFixed::operator*(double other) const
+{
+	return *this * BigFixed(other, GetPrecision());
+}
+
+bool BigFixed::operator==(const BigFixed& other) const
+{
+	return m_negative == other.m_negative && CompareMagnitude(*this, other) == 0;
+}
+
+bool BigFixed::operator<(const BigFixed& other) const
+{
+	if (m_negative != other.m_negative)
+		return m_negative;
+
+	int cmp = CompareMagnitude(*this, other);
+	return m_negative ? cmp > 0 : cmp < 0;
+}
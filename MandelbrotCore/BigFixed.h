@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Signed arbitrary-precision fixed point number. The magnitude is stored as
+// little endian 32 bit limbs, the last limb is the integer part and every
+// other limb holds 32 fractional bits. The integer part is plenty for
+// coordinates in the complex plane, so overflow past it is not handled.
+class BigFixed
+{
+private:
+	std::vector<uint32_t> m_limbs;
+	bool m_negative;
+
+	size_t GetFracLimbs() const { return m_limbs.size() - 1; }
+	void SetFracLimbs(size_t fracLimbs);
+	void Normalize();
+
+	static int CompareMagnitude(const BigFixed& a, const BigFixed& b);
+	static BigFixed AddSigned(const BigFixed& a, const BigFixed& b, bool negateB);
+
+public:
+	BigFixed();
+	BigFixed(double value, uint32_t precisionBits = 64);
+	// Accepts decimal and scientific notation such as "-1.25e-40". With
+	// precisionBits == 0 the precision is picked to hold every given digit.
+	explicit BigFixed(const std::string& str, uint32_t precisionBits = 0);
+
+	// Number of fractional bits, always a multiple of 32
+	uint32_t GetPrecision() const { return (uint32_t)GetFracLimbs() * 32; }
+	void SetPrecision(uint32_t bits);
+
+	bool IsNegative() const { return m_negative; }
+	bool IsZero() const;
+
+	double ToDouble() const;
+	// digits == 0 prints every digit the precision can represent
+	std::string ToString(uint32_t digits = 0) const;
+
+	BigFixed operator-() const;
+	BigFixed operator+(const BigFixed& other) const;
+	BigFixed operator-(const BigFixed& other) const;
+	BigFixed operator*(const BigFixed& other) const;
+	BigFixed operator*(double other) const;
+
+	BigFixed& operator+=(const BigFixed& other) { return *this = *this + other; }
+	BigFixed& operator-=(const BigFixed& other) { return *this = *this - other; }
+	BigFixed& operator*=(const BigFixed& other) { return *this = *this * other; }
+	BigFixed& operator*=(double other) { return *this = *this * other; }
+	BigFixed& operator/=(double other) { return *this = *this * (1.0 / other); }
+
+	bool operator==(const BigFixed& other) const;
+	bool operator!=(const BigFixed& other) const { return !(*this == other); }
+	bool operator<(const BigFixed& other) const;
+};
+
+// Fractional bits needed to resolve features of the given size, with guard
+// bits so a reference orbit stays accurate
+uint32_t GetPrecisionForScale(double scale);
@@ -0,0 +1,896 @@
+#include "CpuRenderer.h"
+
+#include "OrbitState.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Rounds towards negative infinity, tile indices go below 0
+	int64_t FloorDiv(int64_t a, int64_t b)
+	{
+		int64_t q = a / b;
+		return q * b > a ? q - 1 : q;
+	}
+
+	// value as the unevaluated sum of count doubles
+	void SplitParts(BigFixed value, double* parts, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			parts[i] = value.ToDouble();
+			value -= BigFixed(parts[i], value.GetPrecision());
+		}
+	}
+
+	KernelPrecision GetKernelPrecision(Precision precision)
+	{
+		switch (precision)
+		{
+		case Precision::DoubleDouble: return KernelPrecision::DoubleDouble;
+		case Precision::QuadDouble: return KernelPrecision::QuadDouble;
+		default: return KernelPrecision::Double;
+		}
+	}
+}
+
+const char* GetPrecisionName(Precision precision)
+{
+	switch (precision)
+	{
+	case Precision::Auto: return "auto";
+	case Precision::DoubleDouble: return "double-double";
+	case Precision::QuadDouble: return "quad-double";
+	case Precision::Perturbation: return "perturbation";
+	default: return "double";
+	}
+}
+
+CpuRenderer::CpuRenderer(size_t threadCount)
+	: m_pool(threadCount)
+	, m_tileSize(64)
+	, m_precision(Precision::Auto)
+	, m_blaEnabled(true)
+	, m_blaEpsilon(std::ldexp(1.0, -53))
+	, m_interiorChecks(true)
+	, m_mode(RenderMode::BruteForce)
+	, m_formula(Formula::Mandelbrot)
+	, m_power(MinMultibrotPower)
+	, m_juliaX(-0.123)
+	, m_juliaY(0.745)
+	, m_distanceEstimation(false)
+	, m_sampleOffsetX(0)
+	, m_sampleOffsetY(0)
+	, m_renderPrecision(Precision::Double)
+	, m_blaMaxDc(0)
+	, m_refOffsetX(0)
+	, m_refOffsetY(0)
+	, m_pixelX0()
+	, m_pixelY0()
+	, m_originX(0)
+	, m_originY(0)
+	, m_cache(nullptr)
+	, m_orbitState(nullptr)
+	, m_keepOrbits(false)
+	, m_cancel(nullptr)
+{
+	SetKernelIsa(GetBestKernelIsa());
+}
+
+void CpuRenderer::SetBlaEpsilon(double epsilon)
+{
+	m_blaEpsilon = epsilon;
+	m_bla.Clear();
+}
+
+void CpuRenderer::SetKernelIsa(KernelIsa isa)
+{
+	if (!IsKernelIsaSupported(isa))
+		isa = KernelIsa::Scalar;
+
+	m_isa = isa;
+	m_rowKernel = GetRowKernel(isa);
+	m_renderKernel = m_rowKernel;
+	m_orbitKernel = GetOrbitKernel(isa);
+}
+
+Precision CpuRenderer::ResolvePrecision(const RenderView& view) const
+{
+	// Below these the pixels are only a few ulps apart for |c| ~ 1, in
+	// double and double-double
+	double pixelSize = view.GetPixelSize();
+	bool deep = pixelSize < std::ldexp(1.0, -45);
+	bool deeper = pixelSize < std::ldexp(1.0, -98);
+
+	// The reference orbit and BLA only exist for z^2 + c
+	if (m_formula != Formula::Mandelbrot)
+	{
+		if (m_precision != Precision::Auto && m_precision != Precision::Perturbation)
+			return m_precision;
+		return deeper ? Precision::QuadDouble : deep ? Precision::DoubleDouble : Precision::Double;
+	}
+
+	if (m_precision != Precision::Auto)
+		return m_precision;
+
+	// Perturbation iterates in double with BLA skipping most iterations,
+	// it stays well ahead of the multi-double kernels at any depth
+	return deep ? Precision::Perturbation : Precision::Double;
+}
+
+void CpuRenderer::RenderTile(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats)
+{
+	double pixelSize = view.GetPixelSize();
+
+	KernelRow row;
+	row.x0 = view.GetMinX() + (0.5 + m_sampleOffsetX) * pixelSize;
+	row.dx = pixelSize;
+	row.y0 = view.GetMaxY() - (0.5 + m_sampleOffsetY) * pixelSize;
+	row.dy = -pixelSize;
+	if (m_renderPrecision == Precision::DoubleDouble || m_renderPrecision == Precision::QuadDouble)
+	{
+		row.x0 = m_pixelX0[0];
+		row.y0 = m_pixelY0[0];
+		std::copy(m_pixelX0 + 1, m_pixelX0 + 4, row.x0Tail);
+		std::copy(m_pixelY0 + 1, m_pixelY0 + 4, row.y0Tail);
+	}
+	row.maxIters = view.maxIters;
+	row.cardioid = m_interiorChecks;
+	row.periodEpsilon = m_interiorChecks ? GetPeriodEpsilon(pixelSize) : 0.0;
+	row.formula = m_formula;
+	row.power = m_power;
+	row.juliaX = m_juliaX;
+	row.juliaY = m_juliaY;
+
+	// The kernel leaves the stopped orbits of a run here, they are turned
+	// into entries after it
+	bool vertical = w == 1 && h > 1;
+	std::vector<uint8_t> stopped;
+	std::vector<double> stops[6];
+	OrbitArrays orbits;
+	uint64_t orbitPixels = 0;
+	if (m_keepOrbits)
+	{
+		uint32_t n = vertical ? h : w;
+		stopped.resize(n);
+		for (std::vector<double>& stop : stops)
+			stop.resize(n);
+		row.stops.stopped = stopped.data();
+		row.stops.cx = stops[0].data();
+		row.stops.cy = stops[1].data();
+		row.stops.x = stops[2].data();
+		row.stops.y = stops[3].data();
+		row.stops.savedX = stops[4].data();
+		row.stops.savedY = stops[5].data();
+	}
+
+	auto keepOrbits = [&]()
+	{
+		if (!m_keepOrbits)
+			return;
+
+		orbitPixels += row.count;
+		for (uint32_t p = 0; p < row.count; p++)
+		{
+			if (!stopped[p])
+				continue;
+
+			uint32_t px = row.vertical ? row.x : row.x + p;
+			uint32_t py = row.vertical ? row.y + p : row.y;
+			orbits.Add((uint64_t)py * view.width + px, stops[0][p], stops[1][p], stops[2][p], stops[3][p], stops[4][p], stops[5][p], (uint32_t)view.maxIters);
+		}
+	};
+
+	KernelStats kernelStats;
+	if (vertical)
+	{
+		// A single column, as in Mariani-Silver borders
+		row.x = x;
+		row.y = y;
+		row.count = h;
+		row.vertical = true;
+		row.iters = buffer.GetRow(y - m_originY) + (x - m_originX);
+		row.smooth = buffer.GetSmoothRow(y - m_originY) + (x - m_originX);
+		row.distance = DistanceRow(buffer, x, y);
+		row.stride = buffer.GetWidth();
+		m_renderKernel(row, kernelStats);
+		keepOrbits();
+	}
+	else
+	{
+		row.x = x;
+		row.count = w;
+		row.vertical = false;
+		row.stride = 1;
+		for (uint32_t j = y; j < y + h && !IsCancelled(); j++)
+		{
+			row.y = j;
+			row.iters = buffer.GetRow(j - m_originY) + (x - m_originX);
+			row.smooth = buffer.GetSmoothRow(j - m_originY) + (x - m_originX);
+			row.distance = DistanceRow(buffer, x, j);
+			m_renderKernel(row, kernelStats);
+			keepOrbits();
+		}
+	}
+
+	if (m_keepOrbits)
+		m_orbitState->Add(orbits, orbitPixels);
+
+	stats.cardioidRejected += kernelStats.cardioidRejected;
+	stats.periodRejected += kernelStats.periodRejected;
+}
+
+void CpuRenderer::RenderTilePerturbed(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats)
+{
+	double pixelSize = view.GetPixelSize();
+
+	// Offsets from the reference point
+	PerturbedRow row;
+	row.dx0 = m_refOffsetX + (0.5 + m_sampleOffsetX - 0.5 * view.width) * pixelSize;
+	row.ddx = pixelSize;
+	row.dy0 = m_refOffsetY + (0.5 * view.height - 0.5 - m_sampleOffsetY) * pixelSize;
+	row.ddy = -pixelSize;
+	row.maxIters = view.maxIters;
+	row.cardioid = m_interiorChecks;
+	row.refX = m_orbit.GetCenterX().ToDouble();
+	row.refY = m_orbit.GetCenterY().ToDouble();
+	row.periodEpsilon = m_interiorChecks ? GetPeriodEpsilon(pixelSize) : 0.0;
+
+	// Shallow views have deltas too large for any step, the table is only
+	// worth looking up once a pixel is within reach
+	const BlaTable* bla = m_blaEnabled && m_bla.MayApplyAt(pixelSize * pixelSize) ? &m_bla : nullptr;
+
+	PerturbationStats perturbationStats;
+	if (w == 1 && h > 1)
+	{
+		row.x = x;
+		row.y = y;
+		row.count = h;
+		row.vertical = true;
+		row.iters = buffer.GetRow(y - m_originY) + (x - m_originX);
+		row.smooth = buffer.GetSmoothRow(y - m_originY) + (x - m_originX);
+		row.distance = DistanceRow(buffer, x, y);
+		row.stride = buffer.GetWidth();
+		IteratePerturbedRow(m_orbit, bla, row, perturbationStats);
+	}
+	else
+	{
+		row.x = x;
+		row.count = w;
+		row.vertical = false;
+		row.stride = 1;
+		for (uint32_t j = y; j < y + h && !IsCancelled(); j++)
+		{
+			row.y = j;
+			row.iters = buffer.GetRow(j - m_originY) + (x - m_originX);
+			row.smooth = buffer.GetSmoothRow(j - m_originY) + (x - m_originX);
+			row.distance = DistanceRow(buffer, x, j);
+			IteratePerturbedRow(m_orbit, bla, row, perturbationStats);
+		}
+	}
+
+	stats.rebases += perturbationStats.rebases;
+	stats.skippedIters += perturbationStats.skippedIters;
+	stats.cardioidRejected += perturbationStats.cardioidRejected;
+	stats.periodRejected += perturbationStats.periodRejected;
+}
+
+void CpuRenderer::RenderPixels(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats)
+{
+	if (m_renderPrecision == Precision::Perturbation)
+		RenderTilePerturbed(view, buffer, x, y, w, h, stats);
+	else
+		RenderTile(view, buffer, x, y, w, h, stats);
+}
+
+void CpuRenderer::RenderTileMarianiSilver(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats)
+{
+	if (w <= 2 || h <= 2)
+	{
+		RenderPixels(view, buffer, x, y, w, h, stats);
+		return;
+	}
+
+	RenderPixels(view, buffer, x, y, w, 1, stats);
+	RenderPixels(view, buffer, x, y + h - 1, w, 1, stats);
+	RenderPixels(view, buffer, x, y + 1, 1, h - 2, stats);
+	RenderPixels(view, buffer, x + w - 1, y + 1, 1, h - 2, stats);
+
+	FillOrSplit(view, buffer, x, y, w, h, stats);
+}
+
+// The border of the rectangle is done. The escape time level sets are
+// connected and have no holes, so a border of one count encloses only that
+// count unless the rectangle holds the whole set.
+void CpuRenderer::FillOrSplit(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats)
+{
+	if (w <= 2 || h <= 2)
+		return;
+
+	uint32_t count = IterAt(buffer, x, y);
+	bool uniform = true;
+	for (uint32_t i = x; i < x + w && uniform; i++)
+		uniform = IterAt(buffer, i, y) == count && IterAt(buffer, i, y + h - 1) == count;
+	for (uint32_t j = y + 1; j < y + h - 1 && uniform; j++)
+		uniform = IterAt(buffer, x, j) == count && IterAt(buffer, x + w - 1, j) == count;
+
+	// [-2, 0.5] x [-1.25, 1.25] holds the set
+	double pixelSize = view.GetPixelSize();
+	double minX = view.GetMinX() + x * pixelSize;
+	double maxY = view.GetMaxY() - y * pixelSize;
+	bool holdsSet = minX < -2 && minX + w * pixelSize > 0.5 && maxY > 1.25 && maxY - h * pixelSize < -1.25;
+
+	if (uniform && !holdsSet)
+	{
+		// Counts are exact, the smooth fraction and distance are blended from
+		// the border
+		for (uint32_t j = y + 1; j < y + h - 1; j++)
+		{
+			float v = (float)(j - y) / (h - 1);
+			for (uint32_t i = x + 1; i < x + w - 1; i++)
+			{
+				float u = (float)(i - x) / (w - 1);
+				IterAt(buffer, i, j) = count;
+				SmoothAt(buffer, i, j) = 0.5f * ((1 - u) * SmoothAt(buffer, x, j) + u * SmoothAt(buffer, x + w - 1, j)
+					+ (1 - v) * SmoothAt(buffer, i, y) + v * SmoothAt(buffer, i, y + h - 1));
+				if (m_distanceEstimation)
+				{
+					DistanceAt(buffer, i, j) = 0.5f * ((1 - u) * DistanceAt(buffer, x, j) + u * DistanceAt(buffer, x + w - 1, j)
+						+ (1 - v) * DistanceAt(buffer, i, y) + v * DistanceAt(buffer, i, y + h - 1));
+				}
+			}
+		}
+
+		stats.filledPixels += (uint64_t)(w - 2) * (h - 2);
+
+		if (m_keepOrbits)
+		{
+			// Filled interior pixels have no orbit yet, they start at z = 0.
+			// The cardioid and bulb stay interior at any limit.
+			OrbitArrays orbits;
+			if (count >= (uint32_t)view.maxIters)
+			{
+				double x0 = view.GetMinX() + 0.5 * pixelSize;
+				double y0 = view.GetMaxY() - 0.5 * pixelSize;
+				for (uint32_t j = y + 1; j < y + h - 1; j++)
+				{
+					for (uint32_t i = x + 1; i < x + w - 1; i++)
+					{
+						double cx = x0 + i * pixelSize;
+						double cy = y0 + j * -pixelSize;
+						if (!(m_interiorChecks && IsInCardioidOrBulb(cx, cy)))
+							orbits.Add((uint64_t)j * view.width + i, cx, cy, 0, 0, 1e300, 1e300, 0);
+					}
+				}
+			}
+			m_orbitState->Add(orbits, (uint64_t)(w - 2) * (h - 2));
+		}
+		return;
+	}
+
+	// Not worth another border
+	if (w <= 16 || h <= 16)
+	{
+		RenderPixels(view, buffer, x + 1, y + 1, w - 2, h - 2, stats);
+		return;
+	}
+
+	// Split the longer side, the new line is the border of both halves
+	if (w >= h)
+	{
+		uint32_t mid = x + w / 2;
+		RenderPixels(view, buffer, mid, y + 1, 1, h - 2, stats);
+		FillOrSplit(view, buffer, x, y, mid - x + 1, h, stats);
+		FillOrSplit(view, buffer, mid, y, x + w - mid, h, stats);
+	}
+	else
+	{
+		uint32_t mid = y + h / 2;
+		RenderPixels(view, buffer, x + 1, mid, w - 2, 1, stats);
+		FillOrSplit(view, buffer, x, y, w, mid - y + 1, stats);
+		FillOrSplit(view, buffer, x, mid, w, y + h - mid, stats);
+	}
+}
+
+OrbitSettings CpuRenderer::GetOrbitSettings() const
+{
+	OrbitSettings settings;
+	settings.formula = m_formula;
+	settings.power = m_power;
+	settings.juliaX = m_juliaX;
+	settings.juliaY = m_juliaY;
+	settings.interiorChecks = m_interiorChecks;
+	return settings;
+}
+
+void CpuRenderer::MergeStats(RenderStats stats)
+{
+	// Tiles only count, the precision is the one the render resolved
+	stats.precision = m_renderPrecision;
+
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats += stats;
+}
+
+void CpuRenderer::Render(const RenderView& view, IterationBuffer& buffer)
+{
+	if (buffer.GetWidth() != view.width || buffer.GetHeight() != view.height)
+		buffer.Resize(view.width, view.height);
+
+	if (m_orbitState)
+		m_orbitState->Reset(view, GetOrbitSettings());
+	RenderRect(view, buffer, 0, 0, view.width, view.height);
+}
+
+void CpuRenderer::RenderRect(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+	buffer.SetDistanceEnabled(m_distanceEstimation);
+	PrepareRender(view);
+	RenderTiles(view, buffer, x, y, w, h);
+}
+
+void CpuRenderer::RenderRegion(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+	if (buffer.GetWidth() != w || buffer.GetHeight() != h)
+		buffer.Resize(w, h);
+
+	m_originX = x;
+	m_originY = y;
+	RenderRect(view, buffer, x, y, w, h);
+	m_originX = 0;
+	m_originY = 0;
+}
+
+bool CpuRenderer::RenderRows(const RenderView& view, IterationBuffer& buffer, std::vector<uint8_t>& rowDone, std::chrono::steady_clock::time_point deadline)
+{
+	if (buffer.GetWidth() != view.width || buffer.GetHeight() != view.height)
+		buffer.Resize(view.width, view.height);
+	buffer.SetDistanceEnabled(m_distanceEstimation);
+
+	// Mariani-Silver needs rectangles to subdivide and cache tiles are only
+	// stored whole, both work on bands of tiles instead of single rows.
+	// Cached bands follow the tile rows of the level, so the first one may
+	// be cut short.
+	CacheGrid grid;
+	bool cached = GetCacheGrid(view, grid);
+	uint32_t band = cached ? TileCache::TileSize : UseMarianiSilver() ? m_tileSize : 1;
+	uint32_t first = band;
+	if (cached)
+		first = band - (uint32_t)(grid.y - FloorDiv(grid.y, band) * band);
+	auto bandEnd = [&](uint32_t y) { return std::min(y == 0 ? first : y + band, view.height); };
+
+	std::vector<uint32_t> pending;
+	for (uint32_t y = 0; y < view.height; y = bandEnd(y))
+	{
+		if (!rowDone[y])
+			pending.push_back(y);
+	}
+
+	if (pending.empty())
+		return true;
+
+	// Nothing done yet is a new render
+	if (m_orbitState && std::find(rowDone.begin(), rowDone.end(), (uint8_t)1) == rowDone.end())
+		m_orbitState->Reset(view, GetOrbitSettings());
+	PrepareRender(view);
+
+	// A band is only started if one as slow as the last one still fits,
+	// neighbouring bands cost about the same
+	std::atomic<size_t> remaining(pending.size());
+	std::atomic<int64_t> lastBandTime(0);
+	m_pool.ParallelFor(pending.size(), [&](size_t i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (IsCancelled() || start + std::chrono::steady_clock::duration(lastBandTime.load()) >= deadline)
+			return;
+
+		uint32_t y = pending[i];
+		uint32_t h = bandEnd(y) - y;
+
+		RenderStats stats;
+		if (cached)
+		{
+			RenderCached(view, grid, buffer, 0, y, view.width, h);
+		}
+		else if (UseMarianiSilver())
+		{
+			for (uint32_t x = 0; x < view.width && !IsCancelled(); x += m_tileSize)
+				RenderTileMarianiSilver(view, buffer, x, y, std::min(m_tileSize, view.width - x), h, stats);
+		}
+		else
+		{
+			RenderPixels(view, buffer, 0, y, view.width, h, stats);
+		}
+		MergeStats(stats);
+		if (IsCancelled())
+			return;
+
+		lastBandTime = (std::chrono::steady_clock::now() - start).count();
+		std::fill(rowDone.begin() + y, rowDone.begin() + y + h, (uint8_t)1);
+		remaining--;
+	});
+
+	return remaining == 0;
+}
+
+void CpuRenderer::RenderMasked(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const std::vector<uint8_t>& mask)
+{
+	if (buffer.GetWidth() != w || buffer.GetHeight() != h)
+		buffer.Resize(w, h);
+	buffer.SetDistanceEnabled(m_distanceEstimation);
+
+	m_originX = x;
+	m_originY = y;
+	PrepareRender(view);
+
+	m_pool.ParallelFor(h, [&](size_t j)
+	{
+		const uint8_t* row = mask.data() + j * w;
+		if (IsCancelled())
+			return;
+
+		RenderStats stats;
+		uint32_t i = 0;
+		while (i < w)
+		{
+			if (!row[i])
+			{
+				i++;
+				continue;
+			}
+
+			uint32_t end = i;
+			while (end < w && row[end])
+				end++;
+
+			RenderPixels(view, buffer, x + i, y + (uint32_t)j, end - i, 1, stats);
+			i = end;
+		}
+		MergeStats(stats);
+	});
+
+	m_originX = 0;
+	m_originY = 0;
+}
+
+void CpuRenderer::RenderShifted(const RenderView& view, IterationBuffer& buffer, int dx, int dy)
+{
+	uint32_t ax = (uint32_t)std::abs(dx);
+	uint32_t ay = (uint32_t)std::abs(dy);
+	if (buffer.GetWidth() != view.width || buffer.GetHeight() != view.height || ax >= view.width || ay >= view.height
+		|| buffer.HasDistance() != m_distanceEstimation)
+	{
+		Render(view, buffer);
+		return;
+	}
+
+	buffer.Shift(dx, dy);
+	if (m_orbitState)
+		m_orbitState->Shift(view, dx, dy);
+	PrepareRender(view);
+
+	// Full width rows on top or bottom, then the columns beside the rest
+	uint32_t rowsY = dy > 0 ? 0 : view.height - ay;
+	uint32_t colsX = dx > 0 ? 0 : view.width - ax;
+	uint32_t colsY = dy > 0 ? ay : 0;
+
+	if (ay > 0)
+		RenderTiles(view, buffer, 0, rowsY, view.width, ay);
+	if (ax > 0)
+		RenderTiles(view, buffer, colsX, colsY, ax, view.height - ay);
+}
+
+bool CpuRenderer::RaiseMaxIters(const RenderView& view, IterationBuffer& buffer)
+{
+	OrbitState* state = m_orbitState;
+	if (!state || !state->Matches(view, GetOrbitSettings()) || !state->IsComplete() || view.maxIters < state->GetMaxIters()
+		|| buffer.GetWidth() != view.width || buffer.GetHeight() != view.height || buffer.HasDistance())
+		return false;
+
+	m_stats = RenderStats();
+	m_renderPrecision = Precision::Double;
+	m_stats.precision = m_renderPrecision;
+
+	// Pixels at the old limit without an entry were rejected by an interior
+	// test, which holds at any limit. The others are overwritten below.
+	const uint32_t oldIters = (uint32_t)state->GetMaxIters();
+	m_pool.ParallelFor(view.height, [&](size_t j)
+	{
+		uint32_t* iters = buffer.GetRow((uint32_t)j);
+		for (uint32_t i = 0; i < view.width; i++)
+		{
+			if (iters[i] >= oldIters)
+				iters[i] = (uint32_t)view.maxIters;
+		}
+	});
+
+	OrbitArrays& orbits = state->GetOrbits();
+	const size_t count = orbits.GetSize();
+	const size_t chunk = 1024;
+	std::vector<uint8_t> stopped(count);
+	std::vector<float> smooth(count);
+
+	m_pool.ParallelFor((count + chunk - 1) / chunk, [&](size_t c)
+	{
+		if (IsCancelled())
+			return;
+
+		size_t first = c * chunk;
+		KernelOrbits run;
+		run.cx = orbits.cx.data() + first;
+		run.cy = orbits.cy.data() + first;
+		run.x = orbits.x.data() + first;
+		run.y = orbits.y.data() + first;
+		run.savedX = orbits.savedX.data() + first;
+		run.savedY = orbits.savedY.data() + first;
+		run.iters = orbits.iters.data() + first;
+		run.smooth = smooth.data() + first;
+		run.stopped = stopped.data() + first;
+		run.count = (uint32_t)std::min(chunk, count - first);
+		run.maxIters = view.maxIters;
+		run.periodEpsilon = m_interiorChecks ? GetPeriodEpsilon(view.GetPixelSize()) : 0.0;
+		run.formula = m_formula;
+		run.power = m_power;
+
+		KernelStats kernelStats;
+		m_orbitKernel(run, kernelStats);
+
+		for (size_t k = first; k < first + run.count; k++)
+		{
+			uint32_t i = (uint32_t)(orbits.pixel[k] % view.width);
+			uint32_t j = (uint32_t)(orbits.pixel[k] / view.width);
+			buffer.At(i, j) = orbits.iters[k];
+			buffer.SmoothAt(i, j) = smooth[k];
+		}
+
+		RenderStats stats;
+		stats.periodRejected = kernelStats.periodRejected;
+		stats.continuedOrbits = run.count;
+		MergeStats(stats);
+	});
+
+	if (IsCancelled())
+	{
+		state->Clear();
+		return false;
+	}
+
+	// Only the ones that ran out again are worth keeping
+	orbits.Keep(stopped);
+	state->SetMaxIters(view.maxIters);
+	return true;
+}
+
+void CpuRenderer::PrepareRender(const RenderView& view)
+{
+	m_stats = RenderStats();
+	m_renderPrecision = ResolvePrecision(view);
+	m_stats.precision = m_renderPrecision;
+
+	// Other pixels would have no entries, the state could never be complete
+	CacheGrid grid;
+	m_keepOrbits = m_orbitState && m_renderPrecision == Precision::Double && !m_distanceEstimation && !HasSampleOffset()
+		&& !GetCacheGrid(view, grid);
+	if (m_orbitState && !m_keepOrbits)
+		m_orbitState->Clear();
+	else if (m_keepOrbits && (!m_orbitState->Matches(view, GetOrbitSettings()) || m_orbitState->GetMaxIters() != view.maxIters))
+		m_orbitState->Reset(view, GetOrbitSettings());
+
+	m_renderKernel = GetRowKernel(m_isa, GetKernelPrecision(m_renderPrecision));
+	if (m_renderPrecision == Precision::DoubleDouble || m_renderPrecision == Precision::QuadDouble)
+	{
+		// The kernels add the steps from pixel (0, 0) in double, only it
+		// needs every bit of the center
+		double pixelSize = view.GetPixelSize();
+		uint32_t bits = std::max({ GetPrecisionForScale(pixelSize), view.centerX.GetPrecision(), view.centerY.GetPrecision() });
+		BigFixed x0 = view.centerX;
+		BigFixed y0 = view.centerY;
+		x0.SetPrecision(bits);
+		y0.SetPrecision(bits);
+		x0 += BigFixed((0.5 + m_sampleOffsetX - 0.5 * view.width) * pixelSize, bits);
+		y0 += BigFixed((0.5 * view.height - 0.5 - m_sampleOffsetY) * pixelSize, bits);
+		SplitParts(x0, m_pixelX0, 4);
+		SplitParts(y0, m_pixelY0, 4);
+	}
+
+	if (m_stats.precision != Precision::Perturbation)
+		return;
+
+	// Keep the reference while it is still near the view, a pan then only
+	// costs the new pixels instead of a new full precision orbit
+	double pixelSize = view.GetPixelSize();
+	double halfDiagonal = 0.5 * std::hypot((double)view.width, (double)view.height) * pixelSize;
+
+	bool reuse = m_orbit.GetMaxIters() == view.maxIters
+		&& m_orbit.GetCenterX().GetPrecision() == view.centerX.GetPrecision()
+		&& m_orbit.GetCenterY().GetPrecision() == view.centerY.GetPrecision();
+	if (reuse)
+	{
+		m_refOffsetX = (view.centerX - m_orbit.GetCenterX()).ToDouble();
+		m_refOffsetY = (view.centerY - m_orbit.GetCenterY()).ToDouble();
+		reuse = std::hypot(m_refOffsetX, m_refOffsetY) <= halfDiagonal;
+	}
+
+	if (!reuse)
+	{
+		m_orbit.Compute(view.centerX, view.centerY, view.maxIters);
+		m_stats.referenceOrbits = 1;
+		m_bla.Clear();
+		m_refOffsetX = 0;
+		m_refOffsetY = 0;
+	}
+
+	// The table's validity radii depend on the largest |dc| in the view
+	double maxDc = halfDiagonal + std::hypot(m_refOffsetX, m_refOffsetY);
+	if (m_blaEnabled && (m_bla.IsEmpty() || maxDc != m_blaMaxDc))
+	{
+		m_bla.Build(m_orbit, maxDc, m_blaEpsilon);
+		m_blaMaxDc = maxDc;
+	}
+}
+
+void CpuRenderer::RenderTiles(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+	CacheGrid grid;
+	if (GetCacheGrid(view, grid))
+	{
+		RenderCached(view, grid, buffer, x, y, w, h);
+		return;
+	}
+
+	uint32_t tilesX = (w + m_tileSize - 1) / m_tileSize;
+	uint32_t tilesY = (h + m_tileSize - 1) / m_tileSize;
+
+	m_pool.ParallelFor((size_t)tilesX * tilesY, [&](size_t t)
+	{
+		if (IsCancelled())
+			return;
+
+		uint32_t tx = x + (uint32_t)(t % tilesX) * m_tileSize;
+		uint32_t ty = y + (uint32_t)(t / tilesX) * m_tileSize;
+		uint32_t tw = std::min(m_tileSize, x + w - tx);
+		uint32_t th = std::min(m_tileSize, y + h - ty);
+
+		RenderStats stats;
+		if (UseMarianiSilver())
+			RenderTileMarianiSilver(view, buffer, tx, ty, tw, th, stats);
+		else
+			RenderPixels(view, buffer, tx, ty, tw, th, stats);
+		MergeStats(stats);
+	});
+}
+
+bool CpuRenderer::GetCacheGrid(const RenderView& view, CacheGrid& grid) const
+{
+	if (!m_cache || m_formula != Formula::Mandelbrot || m_distanceEstimation || HasSampleOffset() || ResolvePrecision(view) != Precision::Double)
+		return false;
+
+	if (!TileCache::FindLevel(view.GetPixelSize(), grid.level))
+		return false;
+	grid.pixelSize = TileCache::GetLevelPixelSize(grid.level);
+
+	// Off by a few ulps is still aligned, the difference is far below a
+	// pixel and the tiles all use the exact grid
+	double x = view.GetMinX() / grid.pixelSize;
+	double y = -view.GetMaxY() / grid.pixelSize;
+	double limit = std::ldexp(1.0, 52);
+	if (!(std::abs(x) < limit && std::abs(y) < limit))
+		return false;
+
+	grid.x = (int64_t)std::llround(x);
+	grid.y = (int64_t)std::llround(y);
+	return std::abs(x - (double)grid.x) < 1e-2 && std::abs(y - (double)grid.y) < 1e-2;
+}
+
+bool CpuRenderer::IsCached(const RenderView& view) const
+{
+	CacheGrid grid;
+	if (!GetCacheGrid(view, grid))
+		return false;
+
+	const int64_t size = TileCache::TileSize;
+	for (int64_t ty = FloorDiv(grid.y, size); ty <= FloorDiv(grid.y + view.height - 1, size); ty++)
+	{
+		for (int64_t tx = FloorDiv(grid.x, size); tx <= FloorDiv(grid.x + view.width - 1, size); tx++)
+		{
+			if (!m_cache->Contains({ grid.level, tx, ty, view.maxIters, m_interiorChecks }))
+				return false;
+		}
+	}
+	return true;
+}
+
+void CpuRenderer::RenderCacheTile(const CacheGrid& grid, int64_t tileX, int64_t tileY, int maxIters, IterationBuffer& tile, RenderStats& stats)
+{
+	const uint32_t size = TileCache::TileSize;
+	tile.Resize(size, size);
+
+	// Only the tile's position goes into the pixel coordinates, so a tile
+	// comes out the same whatever view it was rendered for
+	KernelRow row;
+	row.x0 = ((double)(tileX * size) + 0.5) * grid.pixelSize;
+	row.dx = grid.pixelSize;
+	row.y0 = -((double)(tileY * size) + 0.5) * grid.pixelSize;
+	row.dy = -grid.pixelSize;
+	row.maxIters = maxIters;
+	row.cardioid = m_interiorChecks;
+	row.periodEpsilon = m_interiorChecks ? GetPeriodEpsilon(grid.pixelSize) : 0.0;
+	row.x = 0;
+	row.count = size;
+	row.vertical = false;
+	row.stride = 1;
+
+	KernelStats kernelStats;
+	for (uint32_t j = 0; j < size && !IsCancelled(); j++)
+	{
+		row.y = j;
+		row.iters = tile.GetRow(j);
+		row.smooth = tile.GetSmoothRow(j);
+		row.distance = nullptr;
+		m_rowKernel(row, kernelStats);
+	}
+
+	stats.cardioidRejected += kernelStats.cardioidRejected;
+	stats.periodRejected += kernelStats.periodRejected;
+}
+
+void CpuRenderer::RenderCached(const RenderView& view, const CacheGrid& grid, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+	// Level pixels of the rectangle and the tiles they fall into
+	const int64_t size = TileCache::TileSize;
+	int64_t left = grid.x + x;
+	int64_t top = grid.y + y;
+	int64_t firstX = FloorDiv(left, size);
+	int64_t firstY = FloorDiv(top, size);
+	size_t tilesX = (size_t)(FloorDiv(left + w - 1, size) - firstX + 1);
+	size_t tilesY = (size_t)(FloorDiv(top + h - 1, size) - firstY + 1);
+
+	m_pool.ParallelFor(tilesX * tilesY, [&](size_t t)
+	{
+		if (IsCancelled())
+			return;
+
+		int64_t tileX = firstX + (int64_t)(t % tilesX);
+		int64_t tileY = firstY + (int64_t)(t / tilesX);
+		TileKey key{ grid.level, tileX, tileY, view.maxIters, m_interiorChecks };
+
+		// The part of the tile inside the rectangle, in level pixels
+		int64_t x0 = std::max(left, tileX * size);
+		int64_t x1 = std::min(left + w, (tileX + 1) * size);
+		int64_t y0 = std::max(top, tileY * size);
+		int64_t y1 = std::min(top + h, (tileY + 1) * size);
+
+		RenderStats stats;
+		IterationBuffer tile;
+		if (m_cache->Find(key, tile))
+		{
+			stats.cacheHits++;
+			stats.cachedPixels += (uint64_t)((x1 - x0) * (y1 - y0));
+		}
+		else
+		{
+			RenderCacheTile(grid, tileX, tileY, view.maxIters, tile, stats);
+			if (IsCancelled())
+				return;
+
+			m_cache->Insert(key, tile);
+			stats.cacheMisses++;
+		}
+
+		uint32_t count = (uint32_t)(x1 - x0);
+		uint32_t srcX = (uint32_t)(x0 - tileX * size);
+		uint32_t dstX = (uint32_t)(x0 - grid.x) - m_originX;
+		for (int64_t j = y0; j < y1; j++)
+		{
+			uint32_t srcY = (uint32_t)(j - tileY * size);
+			uint32_t dstY = (uint32_t)(j - grid.y) - m_originY;
+			std::memcpy(buffer.GetRow(dstY) + dstX, tile.GetRow(srcY) + srcX, count * sizeof(uint32_t));
+			std::memcpy(buffer.GetSmoothRow(dstY) + dstX, tile.GetSmoothRow(srcY) + srcX, count * sizeof(float));
+		}
+
+		MergeStats(stats);
+	});
+}
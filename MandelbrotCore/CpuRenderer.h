@@ -0,0 +1,299 @@
+#pragma once
+
+#include "BigFixed.h"
+#include "IterationBuffer.h"
+#include "Kernel.h"
+#include "Perturbation.h"
+#include "ThreadPool.h"
+#include "TileCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+struct RenderView
+{
+	BigFixed centerX;
+	BigFixed centerY;
+	BigFixed radius;
+	uint32_t width;
+	uint32_t height;
+	int maxIters;
+
+	// Same mapping as the fragment shader: radius is half the view height
+	double GetPixelSize() const { return 2.0 * radius.ToDouble() / height; }
+	double GetMinX() const { return centerX.ToDouble() - 0.5 * width * GetPixelSize(); }
+	double GetMaxY() const { return centerY.ToDouble() + radius.ToDouble(); }
+};
+
+enum class Precision
+{
+	// Double until the pixel size gets near the double epsilon, then
+	// perturbation for Mandelbrot. The other formulas have no reference
+	// orbit and go on in double-double, then quad-double.
+	Auto,
+	Double,
+	// Every pixel iterated in 2 or 4 doubles (see MultiDouble.h), down to
+	// about 2^-98 and 2^-204
+	DoubleDouble,
+	QuadDouble,
+	Perturbation
+};
+
+const char* GetPrecisionName(Precision precision);
+
+struct RenderStats
+{
+	Precision precision = Precision::Double;
+	uint64_t rebases = 0;
+	uint64_t skippedIters = 0;
+	uint64_t cardioidRejected = 0;
+	uint64_t periodRejected = 0;
+	// Pixels Mariani-Silver filled instead of iterating
+	uint64_t filledPixels = 0;
+	// Full precision orbits computed, 0 when the last one was reused
+	uint64_t referenceOrbits = 0;
+	// Tiles copied out of the tile cache and ones rendered into it
+	uint64_t cacheHits = 0;
+	uint64_t cacheMisses = 0;
+	// Pixels of the rendered area that came from cache hits
+	uint64_t cachedPixels = 0;
+	// Kept orbits RaiseMaxIters went on with
+	uint64_t continuedOrbits = 0;
+
+	RenderStats& operator+=(const RenderStats& other)
+	{
+		precision = other.precision;
+		rebases += other.rebases;
+		skippedIters += other.skippedIters;
+		cardioidRejected += other.cardioidRejected;
+		periodRejected += other.periodRejected;
+		filledPixels += other.filledPixels;
+		referenceOrbits += other.referenceOrbits;
+		cacheHits += other.cacheHits;
+		cacheMisses += other.cacheMisses;
+		cachedPixels += other.cachedPixels;
+		continuedOrbits += other.continuedOrbits;
+		return *this;
+	}
+};
+
+enum class RenderMode
+{
+	// Every pixel is iterated
+	BruteForce,
+	// Tiles are subdivided until a rectangle has one count on its border,
+	// its inside is filled with that count
+	MarianiSilver
+};
+
+class OrbitState;
+struct OrbitSettings;
+
+class CpuRenderer
+{
+private:
+	ThreadPool m_pool;
+	uint32_t m_tileSize;
+	KernelIsa m_isa;
+	RowKernel m_rowKernel;
+	// Of m_renderPrecision, m_rowKernel stays the double one the tile cache uses
+	RowKernel m_renderKernel;
+	OrbitKernel m_orbitKernel;
+	Precision m_precision;
+
+	ReferenceOrbit m_orbit;
+	BlaTable m_bla;
+	bool m_blaEnabled;
+	double m_blaEpsilon;
+	bool m_interiorChecks;
+	RenderMode m_mode;
+	Formula m_formula;
+	int m_power;
+	double m_juliaX;
+	double m_juliaY;
+	bool m_distanceEstimation;
+	// Where in its pixel every pixel is sampled, in pixels from the center
+	double m_sampleOffsetX;
+	double m_sampleOffsetY;
+	// What m_precision resolved to for the render in progress
+	Precision m_renderPrecision;
+	double m_blaMaxDc;
+	// View center minus the reference point
+	double m_refOffsetX;
+	double m_refOffsetY;
+	// c of pixel (0, 0) in parts for the multi-double kernels, each one
+	// what the parts before it leave
+	double m_pixelX0[4];
+	double m_pixelY0[4];
+
+	// View pixel that lands on the buffer's (0, 0), only RenderRegion
+	// moves it
+	uint32_t m_originX;
+	uint32_t m_originY;
+	TileCache* m_cache;
+	OrbitState* m_orbitState;
+	// Whether the render in progress fills m_orbitState
+	bool m_keepOrbits;
+	const std::atomic<bool>* m_cancel;
+	RenderStats m_stats;
+	std::mutex m_statsMutex;
+
+	uint32_t& IterAt(IterationBuffer& buffer, uint32_t x, uint32_t y) const { return buffer.At(x - m_originX, y - m_originY); }
+	float& SmoothAt(IterationBuffer& buffer, uint32_t x, uint32_t y) const { return buffer.SmoothAt(x - m_originX, y - m_originY); }
+	float& DistanceAt(IterationBuffer& buffer, uint32_t x, uint32_t y) const { return buffer.DistanceAt(x - m_originX, y - m_originY); }
+	// Where the kernels write distances to, null while they are off
+	float* DistanceRow(IterationBuffer& buffer, uint32_t x, uint32_t y) const { return m_distanceEstimation ? buffer.GetDistanceRow(y - m_originY) + (x - m_originX) : nullptr; }
+
+	void RenderTile(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats);
+	void RenderTilePerturbed(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats);
+	void RenderPixels(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats);
+	void RenderTileMarianiSilver(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats);
+	void FillOrSplit(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, RenderStats& stats);
+	void MergeStats(RenderStats stats);
+	OrbitSettings GetOrbitSettings() const;
+	// The escape time level sets of other formulas may have holes
+	bool UseMarianiSilver() const { return m_mode == RenderMode::MarianiSilver && m_formula == Formula::Mandelbrot; }
+
+	// Where a view sits on the pixel grid of a cache level
+	struct CacheGrid
+	{
+		int level;
+		double pixelSize;
+		// Level pixel of the view's top left pixel
+		int64_t x;
+		int64_t y;
+	};
+
+	bool GetCacheGrid(const RenderView& view, CacheGrid& grid) const;
+	void RenderCacheTile(const CacheGrid& grid, int64_t tileX, int64_t tileY, int maxIters, IterationBuffer& tile, RenderStats& stats);
+	void RenderCached(const RenderView& view, const CacheGrid& grid, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+	void PrepareRender(const RenderView& view);
+	void RenderTiles(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+public:
+	CpuRenderer(size_t threadCount = 0);
+
+	// buffer is resized to the view
+	void Render(const RenderView& view, IterationBuffer& buffer);
+	void RenderRect(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+	// Renders only the given pixels of the view into a buffer of their size,
+	// for images that do not fit into memory. The pixels come out the same
+	// as from Render.
+	void RenderRegion(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+	// Renders the rows whose flag in rowDone is 0 and sets it to 1, rows not
+	// started by the deadline are left for the next call. Returns true once
+	// every row is done. Mariani-Silver goes by bands of tile size rows,
+	// rowDone has to be set or cleared for whole bands.
+	bool RenderRows(const RenderView& view, IterationBuffer& buffer, std::vector<uint8_t>& rowDone, std::chrono::steady_clock::time_point deadline);
+
+	// Renders the pixels of the region whose mask entry is not 0, mask is w
+	// x h. The others keep what buffer had, it is only resized if it does
+	// not fit. Goes by runs of pixels along rows, Mariani-Silver and the
+	// tile cache do not apply.
+	void RenderMasked(const RenderView& view, IterationBuffer& buffer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const std::vector<uint8_t>& mask);
+
+	// buffer holds the view as it was (dx, dy) pixels ago, i.e. the image
+	// moved right by dx and down by dy. Only the uncovered strips are rendered.
+	void RenderShifted(const RenderView& view, IterationBuffer& buffer, int dx, int dy);
+
+	// Picks the widest instruction set the CPU supports unless told otherwise
+	void SetKernelIsa(KernelIsa isa);
+	KernelIsa GetKernelIsa() const { return m_isa; }
+
+	void SetPrecision(Precision precision) { m_precision = precision; }
+	Precision GetPrecision() const { return m_precision; }
+	// What Auto turns into for the given view. Perturbation only applies to
+	// Mandelbrot, other formulas take the multi-double tier for the pixel
+	// size instead.
+	Precision ResolvePrecision(const RenderView& view) const;
+
+	// Skip iterations with linear approximations of the reference orbit
+	void SetBlaEnabled(bool enabled) { m_blaEnabled = enabled; }
+	bool IsBlaEnabled() const { return m_blaEnabled; }
+	void SetBlaEpsilon(double epsilon);
+	double GetBlaEpsilon() const { return m_blaEpsilon; }
+
+	// Cardioid/bulb test and periodicity checking, pixels they skip get
+	// maxIters. The cardioid test is exact, periodicity is a heuristic: an
+	// orbit that comes back within GetPeriodEpsilon of a saved point is
+	// taken for a cycle, so a slow escaper passing close by can be counted
+	// as interior.
+	void SetInteriorChecks(bool enabled) { m_interiorChecks = enabled; }
+	bool GetInteriorChecks() const { return m_interiorChecks; }
+	// How close an orbit has to return to count as periodic
+	static double GetPeriodEpsilon(double pixelSize) { return 1e-3 * pixelSize; }
+
+	void SetRenderMode(RenderMode mode) { m_mode = mode; }
+	RenderMode GetRenderMode() const { return m_mode; }
+
+	// Escape-time formula of every render, Mandelbrot by default. The others
+	// never use perturbation, they render brute force and without the tile
+	// cache. power is only used by Multibrot, between 2 and
+	// MaxMultibrotPower, and the c of Julia only by Julia.
+	void SetFormula(Formula formula) { m_formula = formula; }
+	Formula GetFormula() const { return m_formula; }
+	void SetMultibrotPower(int power) { m_power = std::min(std::max(power, 2), MaxMultibrotPower); }
+	int GetMultibrotPower() const { return m_power; }
+	void SetJuliaC(double x, double y) { m_juliaX = x; m_juliaY = y; }
+	double GetJuliaX() const { return m_juliaX; }
+	double GetJuliaY() const { return m_juliaY; }
+
+	// Track dz/dc and fill the buffers' distance estimates. Off by default,
+	// the kernels are compiled without the derivative then. Mariani-Silver
+	// blends the distances of filled pixels like their smooth fraction and
+	// the tile cache is not used.
+	void SetDistanceEstimation(bool enabled) { m_distanceEstimation = enabled; }
+	bool IsDistanceEstimation() const { return m_distanceEstimation; }
+
+	// Moves every sample off the pixel centers, for anti aliasing. Offsets
+	// are in pixels, x right and y down. The tile cache only holds
+	// centered samples and is not used otherwise.
+	void SetSampleOffset(double x, double y) { m_sampleOffsetX = x; m_sampleOffsetY = y; }
+	bool HasSampleOffset() const { return m_sampleOffsetX != 0 || m_sampleOffsetY != 0; }
+
+	// Views whose pixels line up with a level of the cache (see TileKey) are
+	// then assembled from its tiles, missing ones are rendered whole and
+	// added. Only applies in double precision, cached tiles are always
+	// iterated pixel by pixel. nullptr turns it off, the cache has to
+	// outlive the renderer otherwise.
+	void SetTileCache(TileCache* cache) { m_cache = cache; }
+	TileCache* GetTileCache() const { return m_cache; }
+	// Whether every pixel of the view would come from the cache
+	bool IsCached(const RenderView& view) const;
+
+	// Renders in double precision then keep where the orbits of the pixels
+	// that ran out of iterations stopped, so RaiseMaxIters can continue
+	// them. Render and RenderRows with no row done start it over, so do
+	// other views and settings. Renders it can not be kept for (more than
+	// double precision, distance estimation, sample offsets, the tile
+	// cache) clear it, unset it for renders into other buffers. nullptr
+	// turns it off.
+	void SetOrbitState(OrbitState* state) { m_orbitState = state; }
+	OrbitState* GetOrbitState() const { return m_orbitState; }
+	// Renders the view into a buffer that holds it complete at the lower
+	// maxIters the orbit state was kept at. Only pixels that reached that
+	// limit are touched: kept orbits go on from where they stopped, the
+	// ones an interior test rejected just take the new limit. Gives the
+	// same pixels as a brute force render at the new limit. Returns false
+	// and leaves the buffer alone when the state does not cover it, render
+	// it again then. When cancelled the buffer is left incomplete, returns
+	// false and the state is cleared.
+	bool RaiseMaxIters(const RenderView& view, IterationBuffer& buffer);
+
+	// Checked before every row and tile, once it is set the render in
+	// progress returns without starting more of them. The buffer is left
+	// incomplete then and RenderRows does not mark the rows it dropped.
+	// Tiles cut short do not go into the tile cache.
+	void SetCancelFlag(const std::atomic<bool>* cancel) { m_cancel = cancel; }
+	bool IsCancelled() const { return m_cancel && m_cancel->load(std::memory_order_relaxed); }
+
+	void SetTileSize(uint32_t tileSize) { m_tileSize = tileSize; }
+	uint32_t GetTileSize() const { return m_tileSize; }
+
+	// Of the last Render / RenderRect call
+	const RenderStats& GetStats() const { return m_stats; }
+
+	ThreadPool& GetPool() { return m_pool; }
+};
@@ -0,0 +1,502 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+
+namespace
+{
+	void PutBigEndian32(std::vector<uint8_t>& out, uint32_t v)
+	{
+		out.push_back((uint8_t)(v >> 24));
+		out.push_back((uint8_t)(v >> 16));
+		out.push_back((uint8_t)(v >> 8));
+		out.push_back((uint8_t)v);
+	}
+
+	void PutLittleEndian(std::vector<uint8_t>& out, uint64_t v, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+			out.push_back((uint8_t)(v >> (8 * i)));
+	}
+
+	uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size)
+	{
+		static const std::array<uint32_t, 256> table = []
+		{
+			std::array<uint32_t, 256> t;
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+				t[i] = c;
+			}
+			return t;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	uint32_t Adler32(uint32_t adler, const uint8_t* data, size_t size)
+	{
+		uint32_t a = adler & 0xFFFF;
+		uint32_t b = adler >> 16;
+		while (size > 0)
+		{
+			// Largest block before b can overflow
+			size_t n = std::min(size, (size_t)5552);
+			for (size_t i = 0; i < n; i++)
+			{
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+			data += n;
+			size -= n;
+		}
+		return (b << 16) | a;
+	}
+
+	uint8_t Paeth(uint8_t a, uint8_t b, uint8_t c)
+	{
+		int p = a + b - c;
+		int pa = std::abs(p - a);
+		int pb = std::abs(p - b);
+		int pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc)
+			return a;
+		return pb <= pc ? b : c;
+	}
+
+	// PNG filter types None, Sub, Up and Paeth
+	uint8_t Predict(uint8_t filter, uint8_t left, uint8_t up, uint8_t upLeft)
+	{
+		switch (filter)
+		{
+		case 1:
+			return left;
+		case 2:
+			return up;
+		case 4:
+			return Paeth(left, up, upLeft);
+		}
+		return 0;
+	}
+
+	bool EndsWith(const std::string& str, const std::string& suffix)
+	{
+		if (str.size() < suffix.size())
+			return false;
+
+		return std::equal(suffix.rbegin(), suffix.rend(), str.rbegin(), [](char a, char b)
+		{
+			return std::tolower((unsigned char)a) == std::tolower((unsigned char)b);
+		});
+	}
+}
+
+std::unique_ptr<ImageWriter> ImageWriter::Create(const std::string& path)
+{
+	if (EndsWith(path, ".png"))
+		return std::make_unique<PngWriter>();
+	if (EndsWith(path, ".tif") || EndsWith(path, ".tiff"))
+		return std::make_unique<TiffWriter>();
+	return nullptr;
+}
+
+PngWriter::PngWriter()
+	: m_width(0)
+	, m_rowsLeft(0)
+	, m_bits(0)
+	, m_bitCount(0)
+	, m_adler(1)
+{
+}
+
+void PngWriter::WriteChunk(const char* type, const uint8_t* data, size_t size)
+{
+	std::vector<uint8_t> header;
+	PutBigEndian32(header, (uint32_t)size);
+	header.insert(header.end(), type, type + 4);
+
+	uint32_t crc = Crc32(0, header.data() + 4, 4);
+	crc = Crc32(crc, data, size);
+
+	std::vector<uint8_t> footer;
+	PutBigEndian32(footer, crc);
+
+	m_file.write((const char*)header.data(), header.size());
+	m_file.write((const char*)data, size);
+	m_file.write((const char*)footer.data(), footer.size());
+}
+
+void PngWriter::PutBits(uint32_t bits, uint32_t count)
+{
+	m_bits |= (uint64_t)bits << m_bitCount;
+	m_bitCount += count;
+	while (m_bitCount >= 8)
+	{
+		m_idat.push_back((uint8_t)m_bits);
+		m_bits >>= 8;
+		m_bitCount -= 8;
+	}
+}
+
+// Huffman codes go out most significant bit first
+void PngWriter::PutCode(uint32_t code, uint32_t length)
+{
+	uint32_t reversed = 0;
+	for (uint32_t i = 0; i < length; i++)
+		reversed |= ((code >> i) & 1) << (length - 1 - i);
+	PutBits(reversed, length);
+}
+
+// Fixed literal/length code
+void PngWriter::PutSymbol(uint32_t symbol)
+{
+	if (symbol < 144)
+		PutCode(0x30 + symbol, 8);
+	else if (symbol < 256)
+		PutCode(0x190 + symbol - 144, 9);
+	else if (symbol < 280)
+		PutCode(symbol - 256, 7);
+	else
+		PutCode(0xC0 + symbol - 280, 8);
+}
+
+// A match of 3 to 258 bytes at distance 1, i.e. repeating the last byte
+void PngWriter::PutRun(uint32_t length)
+{
+	static const uint16_t base[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const uint8_t extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+	uint32_t i = 28;
+	while (base[i] > length)
+		i--;
+
+	PutSymbol(257 + i);
+	PutBits(length - base[i], extra[i]);
+	// Distance code 0 is distance 1
+	PutCode(0, 5);
+}
+
+void PngWriter::Compress(const uint8_t* data, size_t size)
+{
+	m_adler = Adler32(m_adler, data, size);
+
+	size_t i = 0;
+	while (i < size)
+	{
+		uint8_t b = data[i];
+		PutSymbol(b);
+
+		size_t run = 0;
+		while (i + 1 + run < size && data[i + 1 + run] == b)
+			run++;
+		i += 1 + run;
+
+		while (run >= 3)
+		{
+			uint32_t n = (uint32_t)std::min(run, (size_t)258);
+			PutRun(n);
+			run -= n;
+		}
+		for (; run > 0; run--)
+			PutSymbol(b);
+	}
+}
+
+void PngWriter::FlushIdat(bool all)
+{
+	if (m_idat.size() >= (1 << 16) || (all && !m_idat.empty()))
+	{
+		WriteChunk("IDAT", m_idat.data(), m_idat.size());
+		m_idat.clear();
+	}
+}
+
+bool PngWriter::Open(const std::string& path, uint32_t width, uint32_t height)
+{
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file)
+		return false;
+
+	m_width = width;
+	m_rowsLeft = height;
+	m_prevRow.assign((size_t)width * 3, 0);
+	m_filtered.resize((size_t)width * 3 + 1);
+	m_idat.clear();
+	m_bits = 0;
+	m_bitCount = 0;
+	m_adler = 1;
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	m_file.write((const char*)signature, sizeof(signature));
+
+	std::vector<uint8_t> ihdr;
+	PutBigEndian32(ihdr, width);
+	PutBigEndian32(ihdr, height);
+	// 8 bit RGB, deflate, adaptive filtering, no interlacing
+	const uint8_t format[] = { 8, 2, 0, 0, 0 };
+	ihdr.insert(ihdr.end(), format, format + sizeof(format));
+	WriteChunk("IHDR", ihdr.data(), ihdr.size());
+
+	// zlib header, then a fixed Huffman block that lasts until Close
+	m_idat.push_back(0x78);
+	m_idat.push_back(0x01);
+	PutBits(0, 1);
+	PutBits(1, 2);
+
+	return (bool)m_file;
+}
+
+bool PngWriter::WriteRows(const uint8_t* rgb, uint32_t rows)
+{
+	if (rows > m_rowsLeft)
+		return false;
+
+	size_t rowBytes = (size_t)m_width * 3;
+	for (uint32_t y = 0; y < rows; y++, rgb += rowBytes)
+	{
+		// Pick the filter with the smallest sum of residuals, the usual
+		// heuristic. Sub, Up and Paeth residuals of flat areas are runs of 0.
+		const uint8_t* up = m_prevRow.data();
+		uint8_t best = 0;
+		uint64_t bestCost = UINT64_MAX;
+		static const uint8_t filters[] = { 0, 1, 2, 4 };
+		for (uint8_t filter : filters)
+		{
+			uint64_t cost = 0;
+			for (size_t i = 0; i < rowBytes; i++)
+			{
+				uint8_t left = i >= 3 ? rgb[i - 3] : 0;
+				uint8_t upLeft = i >= 3 ? up[i - 3] : 0;
+				uint8_t predicted = Predict(filter, left, up[i], upLeft);
+				cost += std::abs((int8_t)(uint8_t)(rgb[i] - predicted));
+			}
+
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				best = filter;
+			}
+		}
+
+		m_filtered[0] = best;
+		for (size_t i = 0; i < rowBytes; i++)
+		{
+			uint8_t left = i >= 3 ? rgb[i - 3] : 0;
+			uint8_t upLeft = i >= 3 ? up[i - 3] : 0;
+			m_filtered[i + 1] = (uint8_t)(rgb[i] - Predict(best, left, up[i], upLeft));
+		}
+
+		Compress(m_filtered.data(), m_filtered.size());
+		std::copy(rgb, rgb + rowBytes, m_prevRow.begin());
+		FlushIdat(false);
+	}
+
+	m_rowsLeft -= rows;
+	return (bool)m_file;
+}
+
+bool PngWriter::Close()
+{
+	if (!m_file.is_open())
+		return false;
+
+	// End the open block and add an empty final one
+	PutSymbol(256);
+	PutBits(1, 1);
+	PutBits(1, 2);
+	PutSymbol(256);
+	if (m_bitCount > 0)
+		PutBits(0, 8 - m_bitCount);
+
+	PutBigEndian32(m_idat, m_adler);
+	FlushIdat(true);
+	WriteChunk("IEND", nullptr, 0);
+
+	bool ok = m_rowsLeft == 0 && (bool)m_file;
+	m_file.close();
+	return ok;
+}
+
+TiffWriter::TiffWriter()
+	: m_width(0)
+	, m_height(0)
+	, m_rowsLeft(0)
+	, m_big(false)
+{
+}
+
+bool TiffWriter::Open(const std::string& path, uint32_t width, uint32_t height)
+{
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file)
+		return false;
+
+	m_width = width;
+	m_height = height;
+	m_rowsLeft = height;
+
+	// Leave room for the directory after the pixels
+	m_big = (uint64_t)width * height * 3 > 0xFFFFFFFFull - (1ull << 28);
+
+	// The directory offset is filled in by Close
+	std::vector<uint8_t> header = { 'I', 'I' };
+	if (m_big)
+	{
+		PutLittleEndian(header, 43, 2);
+		PutLittleEndian(header, 8, 2);
+		PutLittleEndian(header, 0, 2);
+		PutLittleEndian(header, 0, 8);
+	}
+	else
+	{
+		PutLittleEndian(header, 42, 2);
+		PutLittleEndian(header, 0, 4);
+	}
+	m_file.write((const char*)header.data(), header.size());
+
+	return (bool)m_file;
+}
+
+bool TiffWriter::WriteRows(const uint8_t* rgb, uint32_t rows)
+{
+	if (rows > m_rowsLeft)
+		return false;
+
+	m_file.write((const char*)rgb, (std::streamsize)rows * m_width * 3);
+	m_rowsLeft -= rows;
+	return (bool)m_file;
+}
+
+bool TiffWriter::Close()
+{
+	if (!m_file.is_open())
+		return false;
+
+	if (m_rowsLeft != 0)
+	{
+		m_file.close();
+		return false;
+	}
+
+	enum Type : uint16_t { Short = 3, Long = 4, Rational = 5, Long8 = 16 };
+
+	struct Entry
+	{
+		uint16_t tag;
+		uint16_t type;
+		uint64_t count;
+		std::vector<uint8_t> data;
+	};
+
+	auto typeSize = [](uint16_t type) { return type == Short ? 2 : type == Long ? 4 : 8; };
+
+	std::vector<Entry> entries;
+	auto add = [&](uint16_t tag, uint16_t type, const std::vector<uint64_t>& values)
+	{
+		Entry e{ tag, type, values.size(), {} };
+		for (uint64_t v : values)
+		{
+			// Rationals are given as numerator << 32 | denominator
+			if (type == Rational)
+			{
+				PutLittleEndian(e.data, v >> 32, 4);
+				PutLittleEndian(e.data, v & 0xFFFFFFFF, 4);
+			}
+			else
+			{
+				PutLittleEndian(e.data, v, typeSize(type));
+			}
+		}
+		entries.push_back(std::move(e));
+	};
+
+	// Strips of about 64 KB
+	uint64_t rowBytes = (uint64_t)m_width * 3;
+	uint32_t rowsPerStrip = (uint32_t)std::max<uint64_t>(1, (1 << 16) / rowBytes);
+	uint32_t strips = (m_height + rowsPerStrip - 1) / rowsPerStrip;
+	uint64_t dataStart = m_big ? 16 : 8;
+
+	std::vector<uint64_t> offsets;
+	std::vector<uint64_t> counts;
+	for (uint32_t s = 0; s < strips; s++)
+	{
+		uint32_t rows = std::min(rowsPerStrip, m_height - s * rowsPerStrip);
+		offsets.push_back(dataStart + (uint64_t)s * rowsPerStrip * rowBytes);
+		counts.push_back(rows * rowBytes);
+	}
+
+	uint16_t offsetType = m_big ? Long8 : Long;
+
+	// Sorted by tag
+	add(256, Long, { m_width });
+	add(257, Long, { m_height });
+	add(258, Short, { 8, 8, 8 });
+	add(259, Short, { 1 });
+	add(262, Short, { 2 });
+	add(273, offsetType, offsets);
+	add(277, Short, { 3 });
+	add(278, Long, { rowsPerStrip });
+	add(279, offsetType, counts);
+	add(282, Rational, { (72ull << 32) | 1 });
+	add(283, Rational, { (72ull << 32) | 1 });
+	add(284, Short, { 1 });
+	add(296, Short, { 2 });
+
+	// Word aligned directory right after the pixels, values that do not fit
+	// into an entry follow it
+	uint64_t end = (uint64_t)m_file.tellp();
+	if (end & 1)
+	{
+		m_file.put(0);
+		end++;
+	}
+
+	size_t inlineSize = m_big ? 8 : 4;
+	uint64_t ifdSize = m_big ? 8 + entries.size() * 20 + 8 : 2 + entries.size() * 12 + 4;
+
+	std::vector<uint8_t> ifd;
+	std::vector<uint8_t> external;
+	PutLittleEndian(ifd, entries.size(), m_big ? 8 : 2);
+	for (const Entry& e : entries)
+	{
+		PutLittleEndian(ifd, e.tag, 2);
+		PutLittleEndian(ifd, e.type, 2);
+		PutLittleEndian(ifd, e.count, m_big ? 8 : 4);
+		if (e.data.size() <= inlineSize)
+		{
+			ifd.insert(ifd.end(), e.data.begin(), e.data.end());
+			ifd.resize(ifd.size() + inlineSize - e.data.size(), 0);
+		}
+		else
+		{
+			PutLittleEndian(ifd, end + ifdSize + external.size(), inlineSize);
+			external.insert(external.end(), e.data.begin(), e.data.end());
+			if (external.size() & 1)
+				external.push_back(0);
+		}
+	}
+	// No next directory
+	PutLittleEndian(ifd, 0, inlineSize);
+
+	m_file.write((const char*)ifd.data(), ifd.size());
+	m_file.write((const char*)external.data(), external.size());
+
+	std::vector<uint8_t> offset;
+	PutLittleEndian(offset, end, inlineSize);
+	m_file.seekp(m_big ? 8 : 4);
+	m_file.write((const char*)offset.data(), offset.size());
+
+	bool ok = (bool)m_file;
+	m_file.close();
+	return ok;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Streams an image to disk a few rows at a time, so images far larger than
+// memory can be written. Rows come top to bottom as packed 8 bit RGB.
+class ImageWriter
+{
+public:
+	virtual ~ImageWriter() = default;
+
+	virtual bool Open(const std::string& path, uint32_t width, uint32_t height) = 0;
+	virtual bool WriteRows(const uint8_t* rgb, uint32_t rows) = 0;
+	// Has to follow the last row, the file is incomplete until then
+	virtual bool Close() = 0;
+
+	// From the extension: .png, .tif or .tiff. Null for anything else.
+	static std::unique_ptr<ImageWriter> Create(const std::string& path);
+};
+
+// Deflate with fixed Huffman codes and run length matches only. There is no
+// zlib in the tree, on fractals the runs after row filtering still take the
+// file well below raw size.
+class PngWriter : public ImageWriter
+{
+private:
+	std::ofstream m_file;
+	uint32_t m_width;
+	uint32_t m_rowsLeft;
+
+	std::vector<uint8_t> m_prevRow;
+	std::vector<uint8_t> m_filtered;
+	// Compressed bytes not yet written as an IDAT chunk
+	std::vector<uint8_t> m_idat;
+	uint64_t m_bits;
+	uint32_t m_bitCount;
+	uint32_t m_adler;
+
+	void WriteChunk(const char* type, const uint8_t* data, size_t size);
+	void PutBits(uint32_t bits, uint32_t count);
+	void PutCode(uint32_t code, uint32_t length);
+	void PutSymbol(uint32_t symbol);
+	void PutRun(uint32_t length);
+	void Compress(const uint8_t* data, size_t size);
+	void FlushIdat(bool all);
+
+public:
+	PngWriter();
+
+	bool Open(const std::string& path, uint32_t width, uint32_t height) override;
+	bool WriteRows(const uint8_t* rgb, uint32_t rows) override;
+	bool Close() override;
+};
+
+// Uncompressed strips, BigTIFF once the pixels pass 4 GB
+class TiffWriter : public ImageWriter
+{
+private:
+	std::ofstream m_file;
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_rowsLeft;
+	bool m_big;
+
+public:
+	TiffWriter();
+
+	bool Open(const std::string& path, uint32_t width, uint32_t height) override;
+	bool WriteRows(const uint8_t* rgb, uint32_t rows) override;
+	bool Close() override;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Escape-time result of every pixel, row 0 is the top of the image. Next to
+// the integer count every pixel keeps a fraction in [0, 1) that places the
+// escape between two iterations, pixels that never escaped have 0. The
+// distance estimates in pixels are only kept once enabled, see
+// GetDistanceEstimate.
+class IterationBuffer
+{
+private:
+	uint32_t m_width;
+	uint32_t m_height;
+	std::vector<uint32_t> m_iters;
+	std::vector<float> m_smooth;
+	std::vector<float> m_distance;
+	bool m_hasDistance;
+
+public:
+	IterationBuffer() : m_width(0), m_height(0), m_hasDistance(false) {}
+	IterationBuffer(uint32_t width, uint32_t height) : m_hasDistance(false) { Resize(width, height); }
+
+	void Resize(uint32_t width, uint32_t height)
+	{
+		m_width = width;
+		m_height = height;
+		m_iters.assign((size_t)width * height, 0);
+		m_smooth.assign((size_t)width * height, 0.0f);
+		if (m_hasDistance)
+			m_distance.assign((size_t)width * height, 0.0f);
+	}
+
+	// Newly enabled distances are 0 until rendered
+	void SetDistanceEnabled(bool enabled)
+	{
+		if (enabled == m_hasDistance)
+			return;
+
+		m_hasDistance = enabled;
+		if (enabled)
+			m_distance.assign((size_t)m_width * m_height, 0.0f);
+		else
+			std::vector<float>().swap(m_distance);
+	}
+	bool HasDistance() const { return m_hasDistance; }
+
+	// Moves the contents by (dx, dy) pixels. The rows and columns that get
+	// uncovered keep stale values and have to be rendered again.
+	void Shift(int dx, int dy)
+	{
+		if (dx == 0 && dy == 0)
+			return;
+
+		if ((uint32_t)std::abs(dx) >= m_width || (uint32_t)std::abs(dy) >= m_height)
+			return;
+
+		uint32_t count = m_width - (uint32_t)std::abs(dx);
+		uint32_t srcX = dx < 0 ? (uint32_t)-dx : 0;
+		uint32_t dstX = dx > 0 ? (uint32_t)dx : 0;
+
+		// Walk rows against the direction of the move so nothing is
+		// overwritten before it is copied
+		for (uint32_t i = 0; i < m_height - (uint32_t)std::abs(dy); i++)
+		{
+			uint32_t dstY = dy > 0 ? m_height - 1 - i : i;
+			uint32_t srcY = dstY - dy;
+			std::memmove(GetRow(dstY) + dstX, GetRow(srcY) + srcX, count * sizeof(uint32_t));
+			std::memmove(GetSmoothRow(dstY) + dstX, GetSmoothRow(srcY) + srcX, count * sizeof(float));
+			if (m_hasDistance)
+				std::memmove(GetDistanceRow(dstY) + dstX, GetDistanceRow(srcY) + srcX, count * sizeof(float));
+		}
+	}
+
+	uint32_t GetWidth() const { return m_width; }
+	uint32_t GetHeight() const { return m_height; }
+
+	uint32_t* GetRow(uint32_t y) { return m_iters.data() + (size_t)y * m_width; }
+	const uint32_t* GetRow(uint32_t y) const { return m_iters.data() + (size_t)y * m_width; }
+
+	float* GetSmoothRow(uint32_t y) { return m_smooth.data() + (size_t)y * m_width; }
+	const float* GetSmoothRow(uint32_t y) const { return m_smooth.data() + (size_t)y * m_width; }
+
+	// Only with distances enabled
+	float* GetDistanceRow(uint32_t y) { return m_distance.data() + (size_t)y * m_width; }
+	const float* GetDistanceRow(uint32_t y) const { return m_distance.data() + (size_t)y * m_width; }
+
+	uint32_t& At(uint32_t x, uint32_t y) { return m_iters[(size_t)y * m_width + x]; }
+	uint32_t At(uint32_t x, uint32_t y) const { return m_iters[(size_t)y * m_width + x]; }
+
+	float& SmoothAt(uint32_t x, uint32_t y) { return m_smooth[(size_t)y * m_width + x]; }
+	float SmoothAt(uint32_t x, uint32_t y) const { return m_smooth[(size_t)y * m_width + x]; }
+
+	float& DistanceAt(uint32_t x, uint32_t y) { return m_distance[(size_t)y * m_width + x]; }
+	float DistanceAt(uint32_t x, uint32_t y) const { return m_distance[(size_t)y * m_width + x]; }
+
+	const std::vector<uint32_t>& GetData() const { return m_iters; }
+	const std::vector<float>& GetSmoothData() const { return m_smooth; }
+	const std::vector<float>& GetDistanceData() const { return m_distance; }
+};
@@ -0,0 +1,366 @@
+#include "IterationFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+	const char Magic[4] = { 'M', 'B', 'I', 'T' };
+	const size_t FixedHeaderSize = 36;
+
+	void PutLittleEndian(std::vector<uint8_t>& out, uint64_t v, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+			out.push_back((uint8_t)(v >> (8 * i)));
+	}
+
+	uint64_t GetLittleEndian(const uint8_t* data, int bytes)
+	{
+		uint64_t v = 0;
+		for (int i = 0; i < bytes; i++)
+			v |= (uint64_t)data[i] << (8 * i);
+		return v;
+	}
+
+	uint64_t AlignUp(uint64_t v)
+	{
+		return (v + 7) & ~(uint64_t)7;
+	}
+
+	void PutVarint(std::vector<uint8_t>& out, uint64_t v)
+	{
+		while (v >= 0x80)
+		{
+			out.push_back((uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((uint8_t)v);
+	}
+
+	bool GetVarint(const uint8_t*& data, const uint8_t* end, uint64_t& v)
+	{
+		v = 0;
+		for (int shift = 0; shift < 64 && data < end; shift += 7)
+		{
+			uint8_t byte = *data++;
+			v |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+}
+
+IterationFileWriter::IterationFileWriter()
+	: m_tileSize(0), m_compressed(false), m_tableOffset(0), m_offset(0), m_bandRows(0), m_rowsLeft(0)
+{
+}
+
+bool IterationFileWriter::Open(const std::string& path, const RenderView& view, bool compressed, uint32_t tileSize)
+{
+	if (view.width == 0 || view.height == 0 || tileSize == 0)
+		return false;
+
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file)
+		return false;
+
+	m_view = view;
+	m_tileSize = tileSize;
+	m_compressed = compressed;
+	m_rowsLeft = view.height;
+	m_bandRows = 0;
+	m_band.Resize(view.width, std::min(tileSize, view.height));
+
+	// A binary fraction of n bits has n decimal digits, with all of them
+	// the file reproduces the view exactly
+	uint32_t bits = std::max({ view.centerX.GetPrecision(), view.centerY.GetPrecision(), view.radius.GetPrecision() });
+	std::string text = view.centerX.ToString(bits) + " " + view.centerY.ToString(bits) + " " + view.radius.ToString(bits);
+
+	std::vector<uint8_t> header(Magic, Magic + sizeof(Magic));
+	PutLittleEndian(header, IterationFile::Version, 4);
+	PutLittleEndian(header, view.width, 4);
+	PutLittleEndian(header, view.height, 4);
+	PutLittleEndian(header, (uint32_t)view.maxIters, 4);
+	PutLittleEndian(header, tileSize, 4);
+	PutLittleEndian(header, compressed ? IterationFile::FlagCompressed : 0, 4);
+	PutLittleEndian(header, bits, 4);
+	PutLittleEndian(header, text.size(), 4);
+	header.insert(header.end(), text.begin(), text.end());
+	header.resize(AlignUp(header.size()), 0);
+
+	// The table is only known at the end, it gets a placeholder for now
+	uint64_t tiles = (uint64_t)((view.width + tileSize - 1) / tileSize) * ((view.height + tileSize - 1) / tileSize);
+	m_tableOffset = header.size();
+	m_table.clear();
+	m_table.reserve(tiles * 2);
+	header.resize(header.size() + tiles * 16, 0);
+	m_offset = header.size();
+
+	m_file.write((const char*)header.data(), header.size());
+	return (bool)m_file;
+}
+
+bool IterationFileWriter::WriteRows(const IterationBuffer& rows, uint32_t count)
+{
+	if (!m_file.is_open() || rows.GetWidth() != m_view.width || count > m_rowsLeft)
+		return false;
+
+	for (uint32_t j = 0; j < count; j++)
+	{
+		std::memcpy(m_band.GetRow(m_bandRows), rows.GetRow(j), m_view.width * sizeof(uint32_t));
+		std::memcpy(m_band.GetSmoothRow(m_bandRows), rows.GetSmoothRow(j), m_view.width * sizeof(float));
+		m_bandRows++;
+		m_rowsLeft--;
+
+		if ((m_bandRows == m_tileSize || m_rowsLeft == 0) && !FlushBand())
+			return false;
+	}
+	return true;
+}
+
+bool IterationFileWriter::FlushBand()
+{
+	for (uint32_t x = 0; x < m_view.width; x += m_tileSize)
+	{
+		uint32_t w = std::min(m_tileSize, m_view.width - x);
+		EncodeTile(x, w, m_bandRows);
+
+		m_table.push_back(m_offset);
+		m_table.push_back(m_encoded.size());
+
+		m_encoded.resize(AlignUp(m_encoded.size()), 0);
+		m_file.write((const char*)m_encoded.data(), m_encoded.size());
+		m_offset += m_encoded.size();
+	}
+
+	m_bandRows = 0;
+	return (bool)m_file;
+}
+
+void IterationFileWriter::EncodeTile(uint32_t x, uint32_t w, uint32_t h)
+{
+	m_encoded.clear();
+	if (!m_compressed)
+	{
+		m_encoded.resize((size_t)w * h * (sizeof(uint32_t) + sizeof(float)));
+		uint8_t* out = m_encoded.data();
+		for (uint32_t j = 0; j < h; j++, out += w * sizeof(uint32_t))
+			std::memcpy(out, m_band.GetRow(j) + x, w * sizeof(uint32_t));
+		for (uint32_t j = 0; j < h; j++, out += w * sizeof(float))
+			std::memcpy(out, m_band.GetSmoothRow(j) + x, w * sizeof(float));
+		return;
+	}
+
+	// Neighbours mostly differ by a few iterations and the inside is one
+	// long run of maxIters, so differences take a byte or less
+	int64_t previous = 0;
+	for (uint32_t j = 0; j < h; j++)
+	{
+		const uint32_t* iters = m_band.GetRow(j) + x;
+		for (uint32_t i = 0; i < w; i++)
+		{
+			int64_t delta = (int64_t)iters[i] - previous;
+			PutVarint(m_encoded, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+			previous = iters[i];
+		}
+	}
+
+	// Pixels that never escaped always have 0
+	for (uint32_t j = 0; j < h; j++)
+	{
+		const uint32_t* iters = m_band.GetRow(j) + x;
+		const float* smooth = m_band.GetSmoothRow(j) + x;
+		for (uint32_t i = 0; i < w; i++)
+		{
+			if (iters[i] >= (uint32_t)m_view.maxIters)
+				continue;
+			uint32_t bits;
+			std::memcpy(&bits, &smooth[i], sizeof(bits));
+			PutLittleEndian(m_encoded, bits, 4);
+		}
+	}
+}
+
+bool IterationFileWriter::Close()
+{
+	if (!m_file.is_open())
+		return false;
+
+	bool ok = m_rowsLeft == 0;
+
+	std::vector<uint8_t> table;
+	table.reserve(m_table.size() * 8);
+	for (uint64_t v : m_table)
+		PutLittleEndian(table, v, 8);
+
+	m_file.seekp(m_tableOffset);
+	m_file.write((const char*)table.data(), table.size());
+	ok = (bool)m_file && ok;
+	m_file.close();
+	return ok;
+}
+
+IterationFileReader::IterationFileReader()
+	: m_tileSize(0), m_tilesX(0), m_tilesY(0), m_compressed(false), m_table(nullptr)
+{
+}
+
+bool IterationFileReader::Open(const std::string& path)
+{
+	if (!m_file.OpenRead(path))
+		return false;
+
+	const uint8_t* data = m_file.GetData();
+	size_t size = m_file.GetSize();
+	if (size < FixedHeaderSize || std::memcmp(data, Magic, sizeof(Magic)) != 0 || GetLittleEndian(data + 4, 4) != IterationFile::Version)
+	{
+		Close();
+		return false;
+	}
+
+	m_view.width = (uint32_t)GetLittleEndian(data + 8, 4);
+	m_view.height = (uint32_t)GetLittleEndian(data + 12, 4);
+	m_view.maxIters = (int)GetLittleEndian(data + 16, 4);
+	m_tileSize = (uint32_t)GetLittleEndian(data + 20, 4);
+	m_compressed = (GetLittleEndian(data + 24, 4) & IterationFile::FlagCompressed) != 0;
+	uint32_t bits = (uint32_t)GetLittleEndian(data + 28, 4);
+	size_t textSize = (size_t)GetLittleEndian(data + 32, 4);
+	if (m_view.width == 0 || m_view.height == 0 || m_view.maxIters <= 0 || m_tileSize == 0 || FixedHeaderSize + textSize > size)
+	{
+		Close();
+		return false;
+	}
+
+	std::istringstream text(std::string((const char*)data + FixedHeaderSize, textSize));
+	std::string centerX, centerY, radius;
+	if (!(text >> centerX >> centerY >> radius))
+	{
+		Close();
+		return false;
+	}
+	m_view.centerX = BigFixed(centerX, bits);
+	m_view.centerY = BigFixed(centerY, bits);
+	m_view.radius = BigFixed(radius, bits);
+
+	m_tilesX = (m_view.width + m_tileSize - 1) / m_tileSize;
+	m_tilesY = (m_view.height + m_tileSize - 1) / m_tileSize;
+	uint64_t tableOffset = AlignUp(FixedHeaderSize + textSize);
+	if (tableOffset + (uint64_t)m_tilesX * m_tilesY * 16 > size)
+	{
+		Close();
+		return false;
+	}
+	m_table = data + tableOffset;
+	return true;
+}
+
+bool IterationFileReader::GetTile(uint32_t tileX, uint32_t tileY, const uint8_t*& data, size_t& size) const
+{
+	const uint8_t* entry = m_table + ((size_t)tileY * m_tilesX + tileX) * 16;
+	uint64_t offset = GetLittleEndian(entry, 8);
+	uint64_t length = GetLittleEndian(entry + 8, 8);
+	if (offset > m_file.GetSize() || length > m_file.GetSize() - offset)
+		return false;
+
+	data = m_file.GetData() + offset;
+	size = (size_t)length;
+	return true;
+}
+
+bool IterationFileReader::DecodeTile(const uint8_t* data, size_t size, uint32_t w, uint32_t h, uint32_t* iters, size_t itersStride, float* smooth, size_t smoothStride) const
+{
+	if (!m_compressed)
+	{
+		if (size != (size_t)w * h * (sizeof(uint32_t) + sizeof(float)))
+			return false;
+
+		for (uint32_t j = 0; j < h; j++, data += w * sizeof(uint32_t))
+			std::memcpy(iters + j * itersStride, data, w * sizeof(uint32_t));
+		for (uint32_t j = 0; j < h; j++, data += w * sizeof(float))
+			std::memcpy(smooth + j * smoothStride, data, w * sizeof(float));
+		return true;
+	}
+
+	const uint8_t* end = data + size;
+	int64_t previous = 0;
+	for (uint32_t j = 0; j < h; j++)
+	{
+		for (uint32_t i = 0; i < w; i++)
+		{
+			uint64_t zigzag;
+			if (!GetVarint(data, end, zigzag))
+				return false;
+			previous += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+			iters[j * itersStride + i] = (uint32_t)previous;
+		}
+	}
+
+	for (uint32_t j = 0; j < h; j++)
+	{
+		for (uint32_t i = 0; i < w; i++)
+		{
+			float& out = smooth[j * smoothStride + i];
+			if (iters[j * itersStride + i] >= (uint32_t)m_view.maxIters)
+			{
+				out = 0.0f;
+				continue;
+			}
+			if (end - data < 4)
+				return false;
+			uint32_t bits = (uint32_t)GetLittleEndian(data, 4);
+			std::memcpy(&out, &bits, sizeof(out));
+			data += 4;
+		}
+	}
+	return true;
+}
+
+bool IterationFileReader::ReadRows(uint32_t y, uint32_t count, IterationBuffer& rows) const
+{
+	if (!m_file.IsOpen() || count == 0 || y >= m_view.height || count > m_view.height - y)
+		return false;
+
+	if (rows.GetWidth() != m_view.width || rows.GetHeight() < count)
+		rows.Resize(m_view.width, count);
+
+	IterationBuffer tile;
+	for (uint32_t tileY = y / m_tileSize; tileY * m_tileSize < y + count; tileY++)
+	{
+		uint32_t top = tileY * m_tileSize;
+		uint32_t h = std::min(m_tileSize, m_view.height - top);
+		uint32_t first = std::max(y, top);
+		uint32_t last = std::min(y + count, top + h);
+		bool whole = first == top && last == top + h;
+
+		for (uint32_t tileX = 0; tileX < m_tilesX; tileX++)
+		{
+			uint32_t left = tileX * m_tileSize;
+			uint32_t w = std::min(m_tileSize, m_view.width - left);
+
+			const uint8_t* data;
+			size_t size;
+			if (!GetTile(tileX, tileY, data, size))
+				return false;
+
+			// Straight into the rows when all of the tile is wanted
+			if (whole)
+			{
+				if (!DecodeTile(data, size, w, h, rows.GetRow(top - y) + left, m_view.width, rows.GetSmoothRow(top - y) + left, m_view.width))
+					return false;
+				continue;
+			}
+
+			tile.Resize(w, h);
+			if (!DecodeTile(data, size, w, h, tile.GetRow(0), w, tile.GetSmoothRow(0), w))
+				return false;
+			for (uint32_t j = first; j < last; j++)
+			{
+				std::memcpy(rows.GetRow(j - y) + left, tile.GetRow(j - top), w * sizeof(uint32_t));
+				std::memcpy(rows.GetSmoothRow(j - y) + left, tile.GetSmoothRow(j - top), w * sizeof(float));
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "CpuRenderer.h"
+#include "IterationBuffer.h"
+#include "MappedFile.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Iteration counts and smooth fractions of a whole view, so an image can be
+// colored again without iterating. Little endian throughout:
+//
+//   "MBIT", version, width, height, maxIters, tileSize, flags, precision
+//   bits, length of the view text, then the text "centerX centerY radius"
+//   in decimal, padded to 8 bytes
+//   offset and size (2 x uint64) of every tile, row by row
+//   the tiles, each starting on 8 bytes
+//
+// A tile is tileSize x tileSize pixels, less on the right and bottom edge.
+// Raw tiles hold every count followed by every fraction, row by row, and
+// are used straight from the mapped file. Compressed tiles hold the counts
+// as zigzag varints of the difference to the pixel before, then the
+// fractions of the pixels that escaped.
+namespace IterationFile
+{
+	constexpr uint32_t Version = 1;
+	constexpr uint32_t FlagCompressed = 1;
+	constexpr uint32_t DefaultTileSize = 256;
+}
+
+// Takes rows top to bottom and only keeps one band of tiles in memory
+class IterationFileWriter
+{
+private:
+	std::ofstream m_file;
+	RenderView m_view;
+	uint32_t m_tileSize;
+	bool m_compressed;
+
+	uint64_t m_tableOffset;
+	std::vector<uint64_t> m_table;
+	uint64_t m_offset;
+
+	IterationBuffer m_band;
+	uint32_t m_bandRows;
+	uint32_t m_rowsLeft;
+	std::vector<uint8_t> m_encoded;
+
+	bool FlushBand();
+	void EncodeTile(uint32_t x, uint32_t w, uint32_t h);
+
+public:
+	IterationFileWriter();
+
+	bool Open(const std::string& path, const RenderView& view, bool compressed, uint32_t tileSize = IterationFile::DefaultTileSize);
+	// The first count rows of rows, which is as wide as the view
+	bool WriteRows(const IterationBuffer& rows, uint32_t count);
+	// Has to follow the last row, the file is incomplete until then
+	bool Close();
+};
+
+// Maps the file, nothing is read until tiles are asked for. Reading is
+// const and may happen from several threads.
+class IterationFileReader
+{
+private:
+	MappedFile m_file;
+	RenderView m_view;
+	uint32_t m_tileSize;
+	uint32_t m_tilesX;
+	uint32_t m_tilesY;
+	bool m_compressed;
+	const uint8_t* m_table;
+
+	bool GetTile(uint32_t tileX, uint32_t tileY, const uint8_t*& data, size_t& size) const;
+	bool DecodeTile(const uint8_t* data, size_t size, uint32_t w, uint32_t h, uint32_t* iters, size_t itersStride, float* smooth, size_t smoothStride) const;
+
+public:
+	IterationFileReader();
+
+	bool Open(const std::string& path);
+	void Close() { m_file.Close(); }
+
+	// The view the file was rendered from, width and height included
+	const RenderView& GetView() const { return m_view; }
+	uint32_t GetTileSize() const { return m_tileSize; }
+	bool IsCompressed() const { return m_compressed; }
+
+	// Rows y ... y + count - 1 into a buffer of the view's width. Reading
+	// whole bands of tiles decodes every compressed tile once.
+	bool ReadRows(uint32_t y, uint32_t count, IterationBuffer& rows) const;
+};
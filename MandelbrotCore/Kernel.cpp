@@ -0,0 +1,201 @@
+#include "KernelImpl.h"
+#include "MultiDouble.h"
+
+#include <cmath>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// 1 - log_power(log|z| / log 2), which runs from 1 down to 0 while |z|
+// grows from the bailout radius to its power-th power
+float GetSmoothFraction(double r2, int power)
+{
+	double frac = 1.0 - std::log2(0.5 * std::log(r2) / std::log(2.0)) / std::log2((double)power);
+	return (float)std::min(std::max(frac, 0.0), 0.999);
+}
+
+float GetDistanceEstimate(double r2, double dx, double dy, double pixelSize)
+{
+	// In this order the derivative can get huge before anything overflows
+	double z = std::sqrt(r2);
+	return (float)(z * 0.5 * std::log(r2) / pixelSize / std::sqrt(dx * dx + dy * dy));
+}
+
+void IterateRowScalar(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<ScalarOps>(row, stats);
+}
+
+void IterateRowDoubleDoubleScalar(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<DoubleDoubleOps<ScalarOps>>(row, stats);
+}
+
+void IterateRowQuadDoubleScalar(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<QuadDoubleOps<ScalarOps>>(row, stats);
+}
+
+void ContinueOrbitsScalar(const KernelOrbits& orbits, KernelStats& stats)
+{
+	ContinueOrbitsImpl<ScalarOps>(orbits, stats);
+}
+
+const char* GetFormulaName(Formula formula)
+{
+	switch (formula)
+	{
+	case Formula::Multibrot: return "multibrot";
+	case Formula::BurningShip: return "burning-ship";
+	case Formula::Tricorn: return "tricorn";
+	case Formula::Julia: return "julia";
+	default: return "mandelbrot";
+	}
+}
+
+bool FindFormula(const char* name, Formula& formula)
+{
+	const Formula formulas[] = { Formula::Mandelbrot, Formula::Multibrot, Formula::BurningShip, Formula::Tricorn, Formula::Julia };
+	for (Formula f : formulas)
+	{
+		if (std::strcmp(name, GetFormulaName(f)) == 0)
+		{
+			formula = f;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void Cpuid(int leaf, int subleaf, int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex(regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switches
+static uint64_t Xgetbv()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+bool IsKernelIsaSupported(KernelIsa isa)
+{
+	if (isa == KernelIsa::Scalar)
+		return true;
+
+	int regs[4];
+	Cpuid(0, 0, regs);
+	if (regs[0] < 7)
+		return false;
+
+	Cpuid(1, 0, regs);
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avx = (regs[2] & (1 << 28)) != 0;
+	// The multi-double kernels take their products' error from FMA
+	bool fma = (regs[2] & (1 << 12)) != 0;
+	if (!osxsave || !avx || !fma)
+		return false;
+
+	uint64_t xcr0 = Xgetbv();
+	Cpuid(7, 0, regs);
+
+	if (isa == KernelIsa::AVX2)
+		return (xcr0 & 0x06) == 0x06 && (regs[1] & (1 << 5)) != 0;
+
+	// F, DQ, CD, BW and VL, the set the compiler may use for /arch:AVX512
+	if (isa == KernelIsa::AVX512)
+	{
+		const uint32_t avx512 = (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31);
+		return (xcr0 & 0xe6) == 0xe6 && ((uint32_t)regs[1] & avx512) == avx512;
+	}
+
+	return false;
+}
+
+KernelIsa GetBestKernelIsa()
+{
+	static const KernelIsa best = []()
+	{
+		if (IsKernelIsaSupported(KernelIsa::AVX512))
+			return KernelIsa::AVX512;
+		if (IsKernelIsaSupported(KernelIsa::AVX2))
+			return KernelIsa::AVX2;
+		return KernelIsa::Scalar;
+	}();
+
+	return best;
+}
+
+const char* GetKernelIsaName(KernelIsa isa)
+{
+	switch (isa)
+	{
+	case KernelIsa::AVX2: return "AVX2";
+	case KernelIsa::AVX512: return "AVX-512";
+	default: return "Scalar";
+	}
+}
+
+const char* GetKernelPrecisionName(KernelPrecision precision)
+{
+	switch (precision)
+	{
+	case KernelPrecision::DoubleDouble: return "double-double";
+	case KernelPrecision::QuadDouble: return "quad-double";
+	default: return "double";
+	}
+}
+
+RowKernel GetRowKernel(KernelIsa isa, KernelPrecision precision)
+{
+	if (precision == KernelPrecision::DoubleDouble)
+	{
+		switch (isa)
+		{
+		case KernelIsa::AVX2: return IterateRowDoubleDoubleAVX2;
+		case KernelIsa::AVX512: return IterateRowDoubleDoubleAVX512;
+		default: return IterateRowDoubleDoubleScalar;
+		}
+	}
+
+	if (precision == KernelPrecision::QuadDouble)
+	{
+		switch (isa)
+		{
+		case KernelIsa::AVX2: return IterateRowQuadDoubleAVX2;
+		case KernelIsa::AVX512: return IterateRowQuadDoubleAVX512;
+		default: return IterateRowQuadDoubleScalar;
+		}
+	}
+
+	switch (isa)
+	{
+	case KernelIsa::AVX2: return IterateRowAVX2;
+	case KernelIsa::AVX512: return IterateRowAVX512;
+	default: return IterateRowScalar;
+	}
+}
+
+OrbitKernel GetOrbitKernel(KernelIsa isa)
+{
+	switch (isa)
+	{
+	case KernelIsa::AVX2: return ContinueOrbitsAVX2;
+	case KernelIsa::AVX512: return ContinueOrbitsAVX512;
+	default: return ContinueOrbitsScalar;
+	}
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Escape-time formulas, z starts at 0 and c is the pixel unless noted
+enum class Formula
+{
+	// z^2 + c
+	Mandelbrot,
+	// z^power + c
+	Multibrot,
+	// (|x| + i |y|)^2 + c
+	BurningShip,
+	// conj(z)^2 + c
+	Tricorn,
+	// z^2 + juliaC, z starts at the pixel
+	Julia
+};
+
+// Multibrot powers the kernels are compiled for, 2 is Mandelbrot
+constexpr int MinMultibrotPower = 3;
+constexpr int MaxMultibrotPower = 8;
+
+// Where the orbits of a run that ran out of iterations stopped, indexed by
+// position in the run (not by stride). stopped is 1 for those and 0 for
+// pixels that escaped or that an interior test rejected, the others are only
+// written where it is 1. The derivative is not kept.
+struct KernelStops
+{
+	uint8_t* stopped = nullptr;
+	// The c the kernel iterated with, continuing from a recomputed one
+	// could round differently
+	double* cx = nullptr;
+	double* cy = nullptr;
+	double* x = nullptr;
+	double* y = nullptr;
+	// Brent's saved point, 1e300 without periodicity checking
+	double* savedX = nullptr;
+	double* savedY = nullptr;
+};
+
+// A run of pixels along a row or a column of a pixel grid where pixel
+// (i, j) is c = (x0 + i * dx, y0 + j * dy). The run starts at pixel (x, y)
+// and goes right, or down if vertical is set. Taking c from the grid gives a
+// pixel the same value whichever run it is rendered in. iters, smooth and
+// distance point at the first pixel, consecutive pixels are stride elements
+// apart. distance may be null, the derivative it needs is only tracked
+// otherwise.
+struct KernelRow
+{
+	double x0;
+	double dx;
+	double y0;
+	double dy;
+	uint32_t x;
+	uint32_t y;
+	uint32_t count;
+	bool vertical;
+	int maxIters;
+	uint32_t* iters;
+	float* smooth;
+	float* distance;
+	size_t stride;
+
+	// Interior tests, pixels they reject get maxIters. periodEpsilon is how
+	// close the orbit has to come back to a saved point, 0 turns it off.
+	// The cardioid test only applies to Mandelbrot.
+	bool cardioid;
+	double periodEpsilon;
+
+	// Every formula has its own instance of the loop, these only pick it.
+	// Formulas without a complex derivative (Burning Ship, Tricorn) give
+	// NoDistance everywhere.
+	Formula formula = Formula::Mandelbrot;
+	int power = 2;
+	double juliaX = 0;
+	double juliaY = 0;
+
+	// Only filled where stops.stopped is set
+	KernelStops stops;
+
+	// What x0 and y0 leave off, for the double-double and quad-double
+	// kernels deeper than double reaches. They read one or three parts.
+	double x0Tail[3] = {};
+	double y0Tail[3] = {};
+};
+
+// Orbits a row kernel stopped, continued up to maxIters. Entry k adds
+// c = (cx[k], cy[k]) and is at z = (x[k], y[k]) after iters[k] iterations,
+// with Brent's saved point next to it. It goes on exactly as it would have
+// in a row rendered with the higher maxIters from the start. Escaped and
+// periodic entries get their count and smooth fraction, the ones that run
+// out again get maxIters, their state moved on and stopped[k] = 1.
+struct KernelOrbits
+{
+	double* cx;
+	double* cy;
+	double* x;
+	double* y;
+	double* savedX;
+	double* savedY;
+	uint32_t* iters;
+	float* smooth;
+	uint8_t* stopped;
+	uint32_t count;
+	int maxIters;
+	// 0 turns periodicity checking off, it has to match the row kernel's
+	double periodEpsilon;
+
+	// Julia uses the entries' c too
+	Formula formula = Formula::Mandelbrot;
+	int power = 2;
+};
+
+// Pixels the interior tests rejected
+struct KernelStats
+{
+	uint64_t cardioidRejected = 0;
+	uint64_t periodRejected = 0;
+};
+
+// Main cardioid and period 2 bulb
+inline bool IsInCardioidOrBulb(double x, double y)
+{
+	double y2 = y * y;
+	double q = (x - 0.25) * (x - 0.25) + y2;
+	return q * (q + x - 0.25) <= 0.25 * y2 || (x + 1) * (x + 1) + y2 <= 0.0625;
+}
+
+// Where between two iterations a point escaped, from |z|^2 at the escape
+// and the power of the formula
+float GetSmoothFraction(double r2, int power = 2);
+
+// Exterior distance estimate |z| ln|z| / |dz/dc| in pixels, from z and the
+// derivative at the escape (dz/dz0 for Julia sets). The distance to the
+// set is within about a factor of 2 of it. Pixels that never escaped get
+// NoDistance.
+float GetDistanceEstimate(double r2, double dx, double dy, double pixelSize);
+constexpr float NoDistance = -1.0f;
+
+enum class KernelIsa
+{
+	Scalar,
+	AVX2,
+	AVX512
+};
+
+// Numbers the row kernels iterate in, double-double and quad-double are
+// the sum of 2 and 4 doubles with about 106 and 212 bits (see
+// MultiDouble.h). Orbits are not kept in them, the continued ones are
+// always double.
+enum class KernelPrecision
+{
+	Double,
+	DoubleDouble,
+	QuadDouble
+};
+
+using RowKernel = void(*)(const KernelRow& row, KernelStats& stats);
+using OrbitKernel = void(*)(const KernelOrbits& orbits, KernelStats& stats);
+
+void IterateRowScalar(const KernelRow& row, KernelStats& stats);
+void IterateRowAVX2(const KernelRow& row, KernelStats& stats);
+void IterateRowAVX512(const KernelRow& row, KernelStats& stats);
+
+void IterateRowDoubleDoubleScalar(const KernelRow& row, KernelStats& stats);
+void IterateRowDoubleDoubleAVX2(const KernelRow& row, KernelStats& stats);
+void IterateRowDoubleDoubleAVX512(const KernelRow& row, KernelStats& stats);
+
+void IterateRowQuadDoubleScalar(const KernelRow& row, KernelStats& stats);
+void IterateRowQuadDoubleAVX2(const KernelRow& row, KernelStats& stats);
+void IterateRowQuadDoubleAVX512(const KernelRow& row, KernelStats& stats);
+
+void ContinueOrbitsScalar(const KernelOrbits& orbits, KernelStats& stats);
+void ContinueOrbitsAVX2(const KernelOrbits& orbits, KernelStats& stats);
+void ContinueOrbitsAVX512(const KernelOrbits& orbits, KernelStats& stats);
+
+const char* GetFormulaName(Formula formula);
+// Name as GetFormulaName() gives it, case sensitive
+bool FindFormula(const char* name, Formula& formula);
+
+bool IsKernelIsaSupported(KernelIsa isa);
+KernelIsa GetBestKernelIsa();
+const char* GetKernelIsaName(KernelIsa isa);
+RowKernel GetRowKernel(KernelIsa isa, KernelPrecision precision = KernelPrecision::Double);
+const char* GetKernelPrecisionName(KernelPrecision precision);
+OrbitKernel GetOrbitKernel(KernelIsa isa);
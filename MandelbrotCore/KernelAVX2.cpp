@@ -0,0 +1,68 @@
+#include "KernelImpl.h"
+#include "MultiDouble.h"
+
+#include <immintrin.h>
+
+struct Avx2Ops
+{
+	static constexpr uint32_t Width = 4;
+	static constexpr int Parts = 1;
+	static constexpr bool Fma = true;
+
+	using Real = __m256d;
+	using Mask = __m256d;
+
+	static Real Set(double v) { return _mm256_set1_pd(v); }
+	static Real Ramp(double x0, double dx, uint32_t p, uint32_t step)
+	{
+		Real lanes = _mm256_mul_pd(_mm256_set_pd(3, 2, 1, 0), _mm256_set1_pd(step));
+		return _mm256_add_pd(_mm256_set1_pd(x0), _mm256_mul_pd(_mm256_add_pd(_mm256_set1_pd(p), lanes), _mm256_set1_pd(dx)));
+	}
+	static Mask FirstLanes(uint32_t n) { return _mm256_cmp_pd(_mm256_set_pd(3, 2, 1, 0), _mm256_set1_pd(n), _CMP_LT_OQ); }
+
+	static Real Add(Real a, Real b) { return _mm256_add_pd(a, b); }
+	static Real Sub(Real a, Real b) { return _mm256_sub_pd(a, b); }
+	static Real Mul(Real a, Real b) { return _mm256_mul_pd(a, b); }
+	static Real MulSub(Real a, Real b, Real c) { return _mm256_fmsub_pd(a, b, c); }
+	static Real Abs(Real a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+
+	static Mask LessEqual(Real a, Real b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+	static Mask And(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+	static Mask Or(Mask a, Mask b) { return _mm256_or_pd(a, b); }
+	static Mask AndNot(Mask a, Mask b) { return _mm256_andnot_pd(b, a); }
+	static bool Any(Mask m) { return _mm256_movemask_pd(m) != 0; }
+	static uint32_t Count(Mask m) { return (uint32_t)std::bitset<4>(_mm256_movemask_pd(m)).count(); }
+	static Real Select(Mask m, Real a, Real b) { return _mm256_blendv_pd(b, a, m); }
+	static Real Increment(Real count, Mask m) { return _mm256_add_pd(count, _mm256_and_pd(m, _mm256_set1_pd(1))); }
+
+	static void StoreCounts(Real count, uint32_t* out, size_t stride, uint32_t lanes)
+	{
+		alignas(16) int32_t tmp[4];
+		_mm_store_si128((__m128i*)tmp, _mm256_cvttpd_epi32(count));
+		for (uint32_t i = 0; i < lanes; i++)
+			out[i * stride] = (uint32_t)tmp[i];
+	}
+
+	static Real Load(const double* in) { return _mm256_loadu_pd(in); }
+	static void Store(Real v, double* out) { _mm256_storeu_pd(out, v); }
+};
+
+void IterateRowAVX2(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<Avx2Ops>(row, stats);
+}
+
+void IterateRowDoubleDoubleAVX2(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<DoubleDoubleOps<Avx2Ops>>(row, stats);
+}
+
+void IterateRowQuadDoubleAVX2(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<QuadDoubleOps<Avx2Ops>>(row, stats);
+}
+
+void ContinueOrbitsAVX2(const KernelOrbits& orbits, KernelStats& stats)
+{
+	ContinueOrbitsImpl<Avx2Ops>(orbits, stats);
+}
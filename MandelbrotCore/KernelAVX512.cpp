@@ -0,0 +1,68 @@
+#include "KernelImpl.h"
+#include "MultiDouble.h"
+
+#include <immintrin.h>
+
+struct Avx512Ops
+{
+	static constexpr uint32_t Width = 8;
+	static constexpr int Parts = 1;
+	static constexpr bool Fma = true;
+
+	using Real = __m512d;
+	using Mask = __mmask8;
+
+	static Real Set(double v) { return _mm512_set1_pd(v); }
+	static Real Ramp(double x0, double dx, uint32_t p, uint32_t step)
+	{
+		Real lanes = _mm512_mul_pd(_mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_pd(step));
+		return _mm512_add_pd(_mm512_set1_pd(x0), _mm512_mul_pd(_mm512_add_pd(_mm512_set1_pd(p), lanes), _mm512_set1_pd(dx)));
+	}
+	static Mask FirstLanes(uint32_t n) { return (Mask)((1u << n) - 1); }
+
+	static Real Add(Real a, Real b) { return _mm512_add_pd(a, b); }
+	static Real Sub(Real a, Real b) { return _mm512_sub_pd(a, b); }
+	static Real Mul(Real a, Real b) { return _mm512_mul_pd(a, b); }
+	static Real MulSub(Real a, Real b, Real c) { return _mm512_fmsub_pd(a, b, c); }
+	static Real Abs(Real a) { return _mm512_abs_pd(a); }
+
+	static Mask LessEqual(Real a, Real b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+	static Mask And(Mask a, Mask b) { return (Mask)(a & b); }
+	static Mask Or(Mask a, Mask b) { return (Mask)(a | b); }
+	static Mask AndNot(Mask a, Mask b) { return (Mask)(a & ~b); }
+	static bool Any(Mask m) { return m != 0; }
+	static uint32_t Count(Mask m) { return (uint32_t)std::bitset<8>(m).count(); }
+	static Real Select(Mask m, Real a, Real b) { return _mm512_mask_blend_pd(m, b, a); }
+	static Real Increment(Real count, Mask m) { return _mm512_mask_add_pd(count, m, count, _mm512_set1_pd(1)); }
+
+	static void StoreCounts(Real count, uint32_t* out, size_t stride, uint32_t lanes)
+	{
+		alignas(32) uint32_t tmp[8];
+		_mm256_store_si256((__m256i*)tmp, _mm512_cvttpd_epu32(count));
+		for (uint32_t i = 0; i < lanes; i++)
+			out[i * stride] = tmp[i];
+	}
+
+	static Real Load(const double* in) { return _mm512_loadu_pd(in); }
+	static void Store(Real v, double* out) { _mm512_storeu_pd(out, v); }
+};
+
+void IterateRowAVX512(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<Avx512Ops>(row, stats);
+}
+
+void IterateRowDoubleDoubleAVX512(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<DoubleDoubleOps<Avx512Ops>>(row, stats);
+}
+
+void IterateRowQuadDoubleAVX512(const KernelRow& row, KernelStats& stats)
+{
+	IterateRowImpl<QuadDoubleOps<Avx512Ops>>(row, stats);
+}
+
+void ContinueOrbitsAVX512(const KernelOrbits& orbits, KernelStats& stats)
+{
+	ContinueOrbitsImpl<Avx512Ops>(orbits, stats);
+}
@@ -0,0 +1,595 @@
+#pragma once
+
+// Escape-time loop shared by every instruction set. Each Kernel*.cpp includes
+// this with its own Ops, so the template is compiled with the matching
+// target flags. Every Ops rounds exactly like the scalar path, so switching
+// ISA never changes the image. The only FMA is the error term of TwoProd in
+// MultiDouble.h, which is exact with or without it.
+
+#include "Kernel.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+
+struct ScalarOps
+{
+	static constexpr uint32_t Width = 1;
+	// Doubles per number, see MultiDouble.h
+	static constexpr int Parts = 1;
+	// Whether there is a fused MulSub, see TwoProd
+	static constexpr bool Fma = false;
+
+	using Real = double;
+	using Mask = bool;
+
+	static Real Set(double v) { return v; }
+	static Real Ramp(double x0, double dx, uint32_t p, uint32_t) { return x0 + p * dx; }
+	static Mask FirstLanes(uint32_t n) { return n > 0; }
+
+	static Real Add(Real a, Real b) { return a + b; }
+	static Real Sub(Real a, Real b) { return a - b; }
+	static Real Mul(Real a, Real b) { return a * b; }
+	static Real Abs(Real a) { return std::abs(a); }
+
+	static Mask LessEqual(Real a, Real b) { return a <= b; }
+	static Mask And(Mask a, Mask b) { return a && b; }
+	static Mask Or(Mask a, Mask b) { return a || b; }
+	static Mask AndNot(Mask a, Mask b) { return a && !b; }
+	static bool Any(Mask m) { return m; }
+	static uint32_t Count(Mask m) { return m ? 1 : 0; }
+	static Real Select(Mask m, Real a, Real b) { return m ? a : b; }
+	static Real Increment(Real count, Mask m) { return m ? count + 1 : count; }
+
+	static void StoreCounts(Real count, uint32_t* out, size_t, uint32_t) { *out = (uint32_t)count; }
+	static Real Load(const double* in) { return *in; }
+	static void Store(Real v, double* out) { *out = v; }
+};
+
+template<typename Ops>
+typename Ops::Mask InCardioidOrBulb(typename Ops::Real x, typename Ops::Real y)
+{
+	using Real = typename Ops::Real;
+
+	Real y2 = Ops::Mul(y, y);
+	Real xq = Ops::Sub(x, Ops::Set(0.25));
+	Real q = Ops::Add(Ops::Mul(xq, xq), y2);
+	Real x1 = Ops::Add(x, Ops::Set(1));
+
+	return Ops::Or(
+		Ops::LessEqual(Ops::Mul(q, Ops::Add(q, xq)), Ops::Mul(Ops::Set(0.25), y2)),
+		Ops::LessEqual(Ops::Add(Ops::Mul(x1, x1), y2), Ops::Set(0.0625)));
+}
+
+// c along a run. Multi-double Ops take x0 with the tail parts the row
+// holds for them, in double the tail is always 0.
+template<typename Ops>
+typename Ops::Real RampRun(double x0, const double* tail, double dx, uint32_t p, uint32_t step)
+{
+	if constexpr (Ops::Parts > 1)
+	{
+		double parts[Ops::Parts] = { x0 };
+		std::copy(tail, tail + Ops::Parts - 1, parts + 1);
+		return Ops::Ramp(parts, dx, p, step);
+	}
+	else
+		return Ops::Ramp(x0, dx, p, step);
+}
+
+// One step of each formula as a type, so the loop is compiled once per
+// formula with the step inlined. x2 and y2 are x * x and y * y of the
+// current z, the derivative step sees z before the formula step.
+template<typename Ops>
+struct MandelbrotStep
+{
+	using Real = typename Ops::Real;
+
+	static constexpr bool IsJulia = false;
+	static constexpr bool HasDerivative = true;
+	// Whether the main cardioid and period 2 bulb are interior
+	static constexpr bool HasCardioid = true;
+	static constexpr int Power = 2;
+
+	static void Step(Real& x, Real& y, Real x2, Real y2, Real cx, Real cy)
+	{
+		y = Ops::Add(Ops::Mul(Ops::Add(x, x), y), cy);
+		x = Ops::Add(Ops::Sub(x2, y2), cx);
+	}
+
+	// dz/dc' = 2 z dz/dc + 1
+	static void Derive(Real x, Real y, Real& dx, Real& dy)
+	{
+		Real re = Ops::Sub(Ops::Mul(x, dx), Ops::Mul(y, dy));
+		Real im = Ops::Add(Ops::Mul(x, dy), Ops::Mul(y, dx));
+		dx = Ops::Add(Ops::Add(re, re), Ops::Set(1.0));
+		dy = Ops::Add(im, im);
+	}
+};
+
+template<typename Ops, int N>
+struct MultibrotStep
+{
+	using Real = typename Ops::Real;
+
+	static constexpr bool IsJulia = false;
+	static constexpr bool HasCardioid = false;
+	static constexpr bool HasDerivative = true;
+	static constexpr int Power = N;
+
+	// z^(n - 1) by repeated multiplication, unrolled for the fixed power
+	static void PowerMinusOne(Real x, Real y, Real x2, Real y2, Real& px, Real& py)
+	{
+		px = Ops::Sub(x2, y2);
+		py = Ops::Mul(Ops::Add(x, x), y);
+		for (int k = 3; k < N; k++)
+		{
+			Real t = Ops::Sub(Ops::Mul(px, x), Ops::Mul(py, y));
+			py = Ops::Add(Ops::Mul(px, y), Ops::Mul(py, x));
+			px = t;
+		}
+	}
+
+	static void Step(Real& x, Real& y, Real x2, Real y2, Real cx, Real cy)
+	{
+		Real px, py;
+		PowerMinusOne(x, y, x2, y2, px, py);
+		Real nx = Ops::Add(Ops::Sub(Ops::Mul(px, x), Ops::Mul(py, y)), cx);
+		y = Ops::Add(Ops::Add(Ops::Mul(px, y), Ops::Mul(py, x)), cy);
+		x = nx;
+	}
+
+	// dz/dc' = n z^(n - 1) dz/dc + 1
+	static void Derive(Real x, Real y, Real& dx, Real& dy)
+	{
+		Real px, py;
+		PowerMinusOne(x, y, Ops::Mul(x, x), Ops::Mul(y, y), px, py);
+		Real n = Ops::Set(N);
+		Real re = Ops::Mul(n, Ops::Sub(Ops::Mul(px, dx), Ops::Mul(py, dy)));
+		Real im = Ops::Mul(n, Ops::Add(Ops::Mul(px, dy), Ops::Mul(py, dx)));
+		dx = Ops::Add(re, Ops::Set(1.0));
+		dy = im;
+	}
+};
+
+template<typename Ops>
+struct BurningShipStep
+{
+	using Real = typename Ops::Real;
+
+	static constexpr bool IsJulia = false;
+	static constexpr bool HasCardioid = false;
+	static constexpr bool HasDerivative = false;
+	static constexpr int Power = 2;
+
+	static void Step(Real& x, Real& y, Real x2, Real y2, Real cx, Real cy)
+	{
+		y = Ops::Add(Ops::Abs(Ops::Mul(Ops::Add(x, x), y)), cy);
+		x = Ops::Add(Ops::Sub(x2, y2), cx);
+	}
+
+	static void Derive(Real, Real, Real&, Real&) {}
+};
+
+template<typename Ops>
+struct TricornStep
+{
+	using Real = typename Ops::Real;
+
+	static constexpr bool IsJulia = false;
+	static constexpr bool HasCardioid = false;
+	static constexpr bool HasDerivative = false;
+	static constexpr int Power = 2;
+
+	static void Step(Real& x, Real& y, Real x2, Real y2, Real cx, Real cy)
+	{
+		y = Ops::Sub(cy, Ops::Mul(Ops::Add(x, x), y));
+		x = Ops::Add(Ops::Sub(x2, y2), cx);
+	}
+
+	static void Derive(Real, Real, Real&, Real&) {}
+};
+
+template<typename Ops>
+struct JuliaStep : MandelbrotStep<Ops>
+{
+	using Real = typename Ops::Real;
+
+	static constexpr bool IsJulia = true;
+	static constexpr bool HasCardioid = false;
+
+	// dz/dz0' = 2 z dz/dz0, starting at 1
+	static void Derive(Real x, Real y, Real& dx, Real& dy)
+	{
+		Real re = Ops::Sub(Ops::Mul(x, dx), Ops::Mul(y, dy));
+		Real im = Ops::Add(Ops::Mul(x, dy), Ops::Mul(y, dx));
+		dx = Ops::Add(re, re);
+		dy = Ops::Add(im, im);
+	}
+};
+
+// Periodicity follows Brent: the orbit is compared with a point saved at
+// every power of two iterations, a cycle of length p is found once the
+// window between saves is longer than p. Distance tracks dz/dc next to z.
+template<typename Ops, typename FormulaStep, bool Periodicity, bool Distance>
+void IterateRowLoop(const KernelRow& row, KernelStats& stats)
+{
+	using Real = typename Ops::Real;
+	using Mask = typename Ops::Mask;
+
+	const Real four = Ops::Set(4.0);
+	const Real juliaX = Ops::Set(row.juliaX);
+	const Real juliaY = Ops::Set(row.juliaY);
+	const Real eps2 = Ops::Set(row.periodEpsilon * row.periodEpsilon);
+
+	// Lanes step along the run, the other coordinate stays
+	const uint32_t stepX = row.vertical ? 0 : 1;
+	const uint32_t stepY = row.vertical ? 1 : 0;
+
+	for (uint32_t p = 0; p < row.count; p += Ops::Width)
+	{
+		uint32_t lanes = std::min(Ops::Width, row.count - p);
+
+		Real x0 = RampRun<Ops>(row.x0, row.x0Tail, row.dx, row.x + p * stepX, stepX);
+		Real y0 = RampRun<Ops>(row.y0, row.y0Tail, row.dy, row.y + p * stepY, stepY);
+
+		// Julia sets start at the pixel with the same c everywhere
+		Real x = FormulaStep::IsJulia ? x0 : Ops::Set(0);
+		Real y = FormulaStep::IsJulia ? y0 : Ops::Set(0);
+		Real x2 = Ops::Mul(x, x);
+		Real y2 = Ops::Mul(y, y);
+		const Real cx = FormulaStep::IsJulia ? juliaX : x0;
+		const Real cy = FormulaStep::IsJulia ? juliaY : y0;
+		Real count = Ops::Set(0);
+		Real escapeR2 = Ops::Set(0);
+		Real derivX = Ops::Set(FormulaStep::IsJulia ? 1 : 0);
+		Real derivY = Ops::Set(0);
+		Real escapeDerivX = Ops::Set(0);
+		Real escapeDerivY = Ops::Set(0);
+		Mask active = Ops::FirstLanes(lanes);
+		Mask interior = Ops::FirstLanes(0);
+
+		if (FormulaStep::HasCardioid && row.cardioid)
+		{
+			interior = Ops::And(active, InCardioidOrBulb<Ops>(x0, y0));
+			active = Ops::AndNot(active, interior);
+			stats.cardioidRejected += Ops::Count(interior);
+		}
+
+		// Far from every orbit until the first save
+		Real savedX = Ops::Set(1e300);
+		Real savedY = Ops::Set(1e300);
+		int saveAt = 1;
+
+		for (int i = 0; i < row.maxIters; i++)
+		{
+			Real r2 = Ops::Add(x2, y2);
+			Mask inside = Ops::LessEqual(r2, four);
+			Mask escaped = Ops::AndNot(active, inside);
+			if (Ops::Any(escaped))
+			{
+				escapeR2 = Ops::Select(escaped, r2, escapeR2);
+				if constexpr (Distance)
+				{
+					escapeDerivX = Ops::Select(escaped, derivX, escapeDerivX);
+					escapeDerivY = Ops::Select(escaped, derivY, escapeDerivY);
+				}
+			}
+
+			active = Ops::And(active, inside);
+
+			if constexpr (Periodicity)
+			{
+				Real ex = Ops::Sub(x, savedX);
+				Real ey = Ops::Sub(y, savedY);
+				Mask periodic = Ops::And(active, Ops::LessEqual(Ops::Add(Ops::Mul(ex, ex), Ops::Mul(ey, ey)), eps2));
+				if (Ops::Any(periodic))
+				{
+					interior = Ops::Or(interior, periodic);
+					active = Ops::AndNot(active, periodic);
+					stats.periodRejected += Ops::Count(periodic);
+				}
+
+				if (i == saveAt)
+				{
+					savedX = x;
+					savedY = y;
+					saveAt *= 2;
+				}
+			}
+
+			if (!Ops::Any(active))
+				break;
+
+			count = Ops::Increment(count, active);
+
+			if constexpr (Distance)
+				FormulaStep::Derive(x, y, derivX, derivY);
+
+			FormulaStep::Step(x, y, x2, y2, cx, cy);
+			x2 = Ops::Mul(x, x);
+			y2 = Ops::Mul(y, y);
+		}
+
+		count = Ops::Select(interior, Ops::Set(row.maxIters), count);
+		Ops::StoreCounts(count, row.iters + p * row.stride, row.stride, lanes);
+
+		if (row.stops.stopped)
+		{
+			// Lanes still active ran out of iterations
+			double left[Ops::Width];
+			double scx[Ops::Width];
+			double scy[Ops::Width];
+			double sx[Ops::Width];
+			double sy[Ops::Width];
+			double px[Ops::Width];
+			double py[Ops::Width];
+			Ops::Store(Ops::Select(active, Ops::Set(1), Ops::Set(0)), left);
+			Ops::Store(cx, scx);
+			Ops::Store(cy, scy);
+			Ops::Store(x, sx);
+			Ops::Store(y, sy);
+			Ops::Store(savedX, px);
+			Ops::Store(savedY, py);
+			for (uint32_t l = 0; l < lanes; l++)
+			{
+				row.stops.stopped[p + l] = left[l] != 0;
+				if (left[l] != 0)
+				{
+					row.stops.cx[p + l] = scx[l];
+					row.stops.cy[p + l] = scy[l];
+					row.stops.x[p + l] = sx[l];
+					row.stops.y[p + l] = sy[l];
+					row.stops.savedX[p + l] = px[l];
+					row.stops.savedY[p + l] = py[l];
+				}
+			}
+		}
+
+		double r2[Ops::Width];
+		Ops::Store(escapeR2, r2);
+		for (uint32_t l = 0; l < lanes; l++)
+		{
+			size_t i = (p + l) * row.stride;
+			row.smooth[i] = row.iters[i] < (uint32_t)row.maxIters ? GetSmoothFraction(r2[l], FormulaStep::Power) : 0.0f;
+		}
+
+		if constexpr (Distance)
+		{
+			double ex[Ops::Width];
+			double ey[Ops::Width];
+			Ops::Store(escapeDerivX, ex);
+			Ops::Store(escapeDerivY, ey);
+			for (uint32_t l = 0; l < lanes; l++)
+			{
+				size_t i = (p + l) * row.stride;
+				row.distance[i] = row.iters[i] < (uint32_t)row.maxIters ? GetDistanceEstimate(r2[l], ex[l], ey[l], std::abs(row.dx)) : NoDistance;
+			}
+		}
+	}
+}
+
+template<typename Ops, typename FormulaStep>
+void IterateRowFormula(const KernelRow& row, KernelStats& stats)
+{
+	bool periodicity = row.periodEpsilon > 0;
+	if constexpr (FormulaStep::HasDerivative)
+	{
+		if (row.distance)
+		{
+			periodicity ? IterateRowLoop<Ops, FormulaStep, true, true>(row, stats) : IterateRowLoop<Ops, FormulaStep, false, true>(row, stats);
+			return;
+		}
+	}
+
+	periodicity ? IterateRowLoop<Ops, FormulaStep, true, false>(row, stats) : IterateRowLoop<Ops, FormulaStep, false, false>(row, stats);
+
+	if (!FormulaStep::HasDerivative && row.distance)
+	{
+		for (uint32_t p = 0; p < row.count; p++)
+			row.distance[p * row.stride] = NoDistance;
+	}
+}
+
+template<typename Ops, int N = MinMultibrotPower>
+void IterateRowMultibrot(const KernelRow& row, KernelStats& stats)
+{
+	if constexpr (N < MaxMultibrotPower)
+	{
+		if (row.power > N)
+		{
+			IterateRowMultibrot<Ops, N + 1>(row, stats);
+			return;
+		}
+	}
+
+	IterateRowFormula<Ops, MultibrotStep<Ops, N>>(row, stats);
+}
+
+// The formula is picked once per row, the loops have no branch on it
+template<typename Ops>
+void IterateRowImpl(const KernelRow& row, KernelStats& stats)
+{
+	switch (row.formula)
+	{
+	case Formula::Multibrot:
+		if (row.power > 2)
+			IterateRowMultibrot<Ops>(row, stats);
+		else
+			IterateRowFormula<Ops, MandelbrotStep<Ops>>(row, stats);
+		break;
+	case Formula::BurningShip: IterateRowFormula<Ops, BurningShipStep<Ops>>(row, stats); break;
+	case Formula::Tricorn: IterateRowFormula<Ops, TricornStep<Ops>>(row, stats); break;
+	case Formula::Julia: IterateRowFormula<Ops, JuliaStep<Ops>>(row, stats); break;
+	default: IterateRowFormula<Ops, MandelbrotStep<Ops>>(row, stats); break;
+	}
+}
+
+// Lanes take consecutive entries, which come from different rows and
+// iterations, so every lane keeps its own count and next save. A lane that
+// reaches maxIters is held where it is while the others go on.
+template<typename Ops, typename FormulaStep, bool Periodicity>
+void ContinueOrbitsLoop(const KernelOrbits& orbits, KernelStats& stats)
+{
+	using Real = typename Ops::Real;
+	using Mask = typename Ops::Mask;
+
+	const Real four = Ops::Set(4.0);
+	const Real last = Ops::Set(orbits.maxIters - 1);
+	const Real eps2 = Ops::Set(orbits.periodEpsilon * orbits.periodEpsilon);
+
+	for (uint32_t p = 0; p < orbits.count; p += Ops::Width)
+	{
+		uint32_t lanes = std::min(Ops::Width, orbits.count - p);
+
+		// Lanes past the end are never active, they only need some value
+		auto load = [&](const double* in)
+		{
+			double lane[Ops::Width] = {};
+			std::copy(in + p, in + p + lanes, lane);
+			return Ops::Load(lane);
+		};
+
+		const Real cx = load(orbits.cx);
+		const Real cy = load(orbits.cy);
+		Real x = load(orbits.x);
+		Real y = load(orbits.y);
+		Real savedX = load(orbits.savedX);
+		Real savedY = load(orbits.savedY);
+
+		// The row loop saves at every power of two, the next one at or
+		// above the count is still to come
+		double iters[Ops::Width] = {};
+		double next[Ops::Width] = {};
+		for (uint32_t l = 0; l < lanes; l++)
+		{
+			iters[l] = orbits.iters[p + l];
+			next[l] = 1;
+			while (next[l] < iters[l])
+				next[l] *= 2;
+		}
+		Real count = Ops::Load(iters);
+		Real saveAt = Ops::Load(next);
+
+		Real x2 = Ops::Mul(x, x);
+		Real y2 = Ops::Mul(y, y);
+		Real escapeR2 = Ops::Set(0);
+		Mask active = Ops::FirstLanes(lanes);
+		Mask interior = Ops::FirstLanes(0);
+		Mask running = Ops::And(active, Ops::LessEqual(count, last));
+
+		while (Ops::Any(running))
+		{
+			Real r2 = Ops::Add(x2, y2);
+			Mask inside = Ops::LessEqual(r2, four);
+			Mask escaped = Ops::AndNot(running, inside);
+			if (Ops::Any(escaped))
+			{
+				escapeR2 = Ops::Select(escaped, r2, escapeR2);
+				active = Ops::AndNot(active, escaped);
+				running = Ops::AndNot(running, escaped);
+			}
+
+			if constexpr (Periodicity)
+			{
+				Real ex = Ops::Sub(x, savedX);
+				Real ey = Ops::Sub(y, savedY);
+				Mask periodic = Ops::And(running, Ops::LessEqual(Ops::Add(Ops::Mul(ex, ex), Ops::Mul(ey, ey)), eps2));
+				if (Ops::Any(periodic))
+				{
+					interior = Ops::Or(interior, periodic);
+					active = Ops::AndNot(active, periodic);
+					running = Ops::AndNot(running, periodic);
+					stats.periodRejected += Ops::Count(periodic);
+				}
+
+				Mask save = Ops::And(running, Ops::LessEqual(saveAt, count));
+				savedX = Ops::Select(save, x, savedX);
+				savedY = Ops::Select(save, y, savedY);
+				saveAt = Ops::Select(save, Ops::Add(saveAt, saveAt), saveAt);
+			}
+
+			if (!Ops::Any(running))
+				break;
+
+			count = Ops::Increment(count, running);
+
+			Real nx = x;
+			Real ny = y;
+			FormulaStep::Step(nx, ny, x2, y2, cx, cy);
+			x = Ops::Select(running, nx, x);
+			y = Ops::Select(running, ny, y);
+			x2 = Ops::Mul(x, x);
+			y2 = Ops::Mul(y, y);
+
+			running = Ops::And(running, Ops::LessEqual(count, last));
+		}
+
+		count = Ops::Select(interior, Ops::Set(orbits.maxIters), count);
+		Ops::StoreCounts(count, orbits.iters + p, 1, lanes);
+
+		double r2[Ops::Width];
+		double left[Ops::Width];
+		double sx[Ops::Width];
+		double sy[Ops::Width];
+		double px[Ops::Width];
+		double py[Ops::Width];
+		Ops::Store(escapeR2, r2);
+		Ops::Store(Ops::Select(active, Ops::Set(1), Ops::Set(0)), left);
+		Ops::Store(x, sx);
+		Ops::Store(y, sy);
+		Ops::Store(savedX, px);
+		Ops::Store(savedY, py);
+		for (uint32_t l = 0; l < lanes; l++)
+		{
+			uint32_t k = p + l;
+			orbits.smooth[k] = orbits.iters[k] < (uint32_t)orbits.maxIters ? GetSmoothFraction(r2[l], FormulaStep::Power) : 0.0f;
+			orbits.stopped[k] = left[l] != 0;
+			orbits.x[k] = sx[l];
+			orbits.y[k] = sy[l];
+			orbits.savedX[k] = px[l];
+			orbits.savedY[k] = py[l];
+		}
+	}
+}
+
+template<typename Ops, typename FormulaStep>
+void ContinueOrbitsFormula(const KernelOrbits& orbits, KernelStats& stats)
+{
+	if (orbits.periodEpsilon > 0)
+		ContinueOrbitsLoop<Ops, FormulaStep, true>(orbits, stats);
+	else
+		ContinueOrbitsLoop<Ops, FormulaStep, false>(orbits, stats);
+}
+
+template<typename Ops, int N = MinMultibrotPower>
+void ContinueOrbitsMultibrot(const KernelOrbits& orbits, KernelStats& stats)
+{
+	if constexpr (N < MaxMultibrotPower)
+	{
+		if (orbits.power > N)
+		{
+			ContinueOrbitsMultibrot<Ops, N + 1>(orbits, stats);
+			return;
+		}
+	}
+
+	ContinueOrbitsFormula<Ops, MultibrotStep<Ops, N>>(orbits, stats);
+}
+
+// Julia needs no step of its own, the entries hold its c
+template<typename Ops>
+void ContinueOrbitsImpl(const KernelOrbits& orbits, KernelStats& stats)
+{
+	switch (orbits.formula)
+	{
+	case Formula::Multibrot:
+		if (orbits.power > 2)
+			ContinueOrbitsMultibrot<Ops>(orbits, stats);
+		else
+			ContinueOrbitsFormula<Ops, MandelbrotStep<Ops>>(orbits, stats);
+		break;
+	case Formula::BurningShip: ContinueOrbitsFormula<Ops, BurningShipStep<Ops>>(orbits, stats); break;
+	case Formula::Tricorn: ContinueOrbitsFormula<Ops, TricornStep<Ops>>(orbits, stats); break;
+	default: ContinueOrbitsFormula<Ops, MandelbrotStep<Ops>>(orbits, stats); break;
+	}
+}
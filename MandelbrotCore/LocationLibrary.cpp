@@ -0,0 +1,351 @@
+#include "LocationLibrary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+	std::string Trim(const std::string& str)
+	{
+		size_t first = str.find_first_not_of(" \t\r");
+		if (first == std::string::npos)
+			return "";
+		size_t last = str.find_last_not_of(" \t\r");
+		return str.substr(first, last - first + 1);
+	}
+
+	bool IsNumber(const std::string& str)
+	{
+		char* end = nullptr;
+		std::strtod(str.c_str(), &end);
+		return !str.empty() && *end == '\0';
+	}
+
+	bool ReadNumber(std::istream& in, std::string& str)
+	{
+		return (bool)(in >> str) && IsNumber(str);
+	}
+
+	bool ReadDouble(std::istream& in, double& value)
+	{
+		std::string str;
+		if (!ReadNumber(in, str))
+			return false;
+		value = std::atof(str.c_str());
+		return true;
+	}
+
+	// A block while it is read, center and radius have no default
+	struct Block
+	{
+		Location location;
+		bool hasCenter = false;
+		bool hasRadius = false;
+	};
+
+	// The rest of a line after its key
+	bool ParseField(const std::string& key, std::istream& in, Block& block)
+	{
+		Location& location = block.location;
+		std::string x, y;
+		if (key == "center")
+		{
+			if (!ReadNumber(in, x) || !ReadNumber(in, y))
+				return false;
+			location.centerX = BigFixed(x);
+			location.centerY = BigFixed(y);
+			block.hasCenter = true;
+		}
+		else if (key == "radius")
+		{
+			if (!ReadNumber(in, x))
+				return false;
+			location.radius = BigFixed(x);
+			block.hasRadius = !location.radius.IsNegative() && !location.radius.IsZero();
+			return block.hasRadius;
+		}
+		else if (key == "iters")
+		{
+			in >> location.maxIters;
+			return (bool)in && location.maxIters > 0;
+		}
+		else if (key == "formula")
+		{
+			std::string name;
+			if (!(in >> name) || !FindFormula(name.c_str(), location.formula))
+				return false;
+
+			if (location.formula == Formula::Multibrot && in >> location.power)
+				return location.power >= MinMultibrotPower && location.power <= MaxMultibrotPower;
+			if (location.formula == Formula::Julia && in >> x)
+			{
+				if (!IsNumber(x) || !ReadDouble(in, location.juliaY))
+					return false;
+				location.juliaX = std::atof(x.c_str());
+			}
+		}
+		else if (key == "color")
+		{
+			if (!(in >> location.color))
+				return false;
+
+			// name=value pairs
+			location.uniforms.clear();
+			std::string pair;
+			while (in >> pair)
+			{
+				size_t equals = pair.find('=');
+				if (equals == std::string::npos || equals == 0 || !IsNumber(pair.substr(equals + 1)))
+					return false;
+				location.uniforms.emplace_back(pair.substr(0, equals), (float)std::atof(pair.c_str() + equals + 1));
+			}
+		}
+		else if (key == "aspect")
+		{
+			return ReadDouble(in, location.aspect) && location.aspect > 0;
+		}
+		return true;
+	}
+
+	std::string ToExactString(const BigFixed& value)
+	{
+		// As many digits as bits, see IterationFileWriter::Open
+		return value.ToString(value.GetPrecision());
+	}
+}
+
+RenderView Location::GetView(uint32_t width, uint32_t height) const
+{
+	RenderView view;
+	view.centerX = centerX;
+	view.centerY = centerY;
+	view.radius = radius;
+	view.width = width;
+	view.height = height;
+	view.maxIters = maxIters;
+
+	uint32_t bits = std::max({ GetPrecisionForScale(view.GetPixelSize()), centerX.GetPrecision(), centerY.GetPrecision() });
+	view.centerX.SetPrecision(bits);
+	view.centerY.SetPrecision(bits);
+	view.radius.SetPrecision(bits);
+	return view;
+}
+
+LocationLibrary::LocationLibrary()
+	: m_nextId(0)
+	, m_thumbnails(false)
+	, m_renderer(1)
+{
+	m_renderer.SetRenderMode(RenderMode::MarianiSilver);
+	m_renderer.SetCancelFlag(&m_thread.GetCancelFlag());
+}
+
+void LocationLibrary::EnableThumbnails()
+{
+	m_thumbnails = true;
+	StartThumbnails();
+}
+
+bool LocationLibrary::Load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::vector<Block> blocks;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line = Trim(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream in(line);
+		std::string key;
+		in >> key;
+		if (key == "location")
+		{
+			blocks.emplace_back();
+			blocks.back().location.name = Trim(line.substr(key.size()));
+		}
+		else if (blocks.empty() || !ParseField(key, in, blocks.back()))
+		{
+			return false;
+		}
+	}
+
+	for (const Block& block : blocks)
+	{
+		if (!block.hasCenter || !block.hasRadius)
+			return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.clear();
+		for (Block& block : blocks)
+			m_entries.push_back({ std::move(block.location), m_nextId++, IterationBuffer(), false });
+	}
+	StartThumbnails();
+	return true;
+}
+
+bool LocationLibrary::Save(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+		return false;
+
+	file << "# Locations of the Mandelbrot viewer, see LocationLibrary.h\n";
+	file << std::setprecision(17);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (const Entry& entry : m_entries)
+	{
+		const Location& location = entry.location;
+		file << "\nlocation " << location.name << '\n';
+		file << "center " << ToExactString(location.centerX) << ' ' << ToExactString(location.centerY) << '\n';
+		file << "radius " << ToExactString(location.radius) << '\n';
+		file << "iters " << location.maxIters << '\n';
+
+		file << "formula " << GetFormulaName(location.formula);
+		if (location.formula == Formula::Multibrot)
+			file << ' ' << location.power;
+		if (location.formula == Formula::Julia)
+			file << ' ' << location.juliaX << ' ' << location.juliaY;
+		file << '\n';
+
+		file << "color " << location.color;
+		for (const auto& [name, value] : location.uniforms)
+			file << ' ' << name << '=' << value;
+		file << '\n';
+
+		file << "aspect " << location.aspect << '\n';
+	}
+	return (bool)file;
+}
+
+size_t LocationLibrary::GetCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entries.size();
+}
+
+Location LocationLibrary::Get(size_t index) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entries[index].location;
+}
+
+int LocationLibrary::Find(const std::string& name) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		if (m_entries[i].location.name == name)
+			return (int)i;
+	}
+	return -1;
+}
+
+size_t LocationLibrary::Add(const Location& location)
+{
+	size_t index;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry entry = { location, m_nextId++, IterationBuffer(), false };
+
+		auto it = std::find_if(m_entries.begin(), m_entries.end(), [&](const Entry& e) { return e.location.name == location.name; });
+		if (it != m_entries.end())
+			*it = std::move(entry);
+		else
+			it = m_entries.insert(m_entries.end(), std::move(entry));
+		index = it - m_entries.begin();
+	}
+	StartThumbnails();
+	return index;
+}
+
+bool LocationLibrary::Remove(size_t index)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (index >= m_entries.size())
+		return false;
+
+	m_entries.erase(m_entries.begin() + index);
+	return true;
+}
+
+RenderView LocationLibrary::GetThumbnailView(const Location& location)
+{
+	double width = std::round(ThumbnailHeight * std::clamp(location.aspect, 0.125, 8.0));
+	return location.GetView((uint32_t)width, ThumbnailHeight);
+}
+
+bool LocationLibrary::GetThumbnail(size_t index, IterationBuffer& thumbnail, RenderView& view) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (index >= m_entries.size() || !m_entries[index].hasThumbnail)
+		return false;
+
+	thumbnail = m_entries[index].thumbnail;
+	view = GetThumbnailView(m_entries[index].location);
+	return true;
+}
+
+void LocationLibrary::WaitForThumbnails()
+{
+	m_thread.Wait();
+}
+
+void LocationLibrary::StartThumbnails()
+{
+	if (!m_thumbnails)
+		return;
+
+	// Replaces the job in flight, the new one starts with whatever is still
+	// missing
+	m_thread.Submit([this](const std::atomic<bool>& cancelled) { RenderThumbnails(cancelled); });
+}
+
+// Runs on m_thread, the lock is only held to pick and to store
+void LocationLibrary::RenderThumbnails(const std::atomic<bool>& cancelled)
+{
+	while (!cancelled)
+	{
+		Location location;
+		uint64_t id;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = std::find_if(m_entries.begin(), m_entries.end(), [](const Entry& e) { return !e.hasThumbnail; });
+			if (it == m_entries.end())
+				return;
+
+			location = it->location;
+			id = it->id;
+		}
+
+		m_renderer.SetFormula(location.formula);
+		m_renderer.SetMultibrotPower(location.power);
+		m_renderer.SetJuliaC(location.juliaX, location.juliaY);
+
+		IterationBuffer thumbnail;
+		m_renderer.Render(GetThumbnailView(location), thumbnail);
+		if (cancelled)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (Entry& entry : m_entries)
+		{
+			if (entry.id != id)
+				continue;
+
+			entry.thumbnail = std::move(thumbnail);
+			entry.hasThumbnail = true;
+		}
+	}
+}
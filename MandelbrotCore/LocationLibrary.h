@@ -0,0 +1,114 @@
+#pragma once
+
+#include "CpuRenderer.h"
+#include "IterationBuffer.h"
+#include "RenderThread.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A view worth coming back to, with everything needed to render and color
+// it the same way again
+struct Location
+{
+	std::string name;
+	BigFixed centerX;
+	BigFixed centerY;
+	BigFixed radius;
+	int maxIters = 1500;
+	Formula formula = Formula::Mandelbrot;
+	int power = MinMultibrotPower;
+	double juliaX = -0.123;
+	double juliaY = 0.745;
+	// Palette name (see GetPaletteName) and the values of its uniforms
+	std::string color = "gradient";
+	std::vector<std::pair<std::string, float>> uniforms;
+	// Width over height of the view it was saved from
+	double aspect = 1.0;
+
+	// With enough bits to place every pixel of the size
+	RenderView GetView(uint32_t width, uint32_t height) const;
+};
+
+// Locations kept in a text file, each one with a small rendering of its
+// view. The file holds blocks like
+//
+//   location Seahorse valley
+//   center -0.7461860152692163517 0.095926522548036297078
+//   radius 0.0035131274618377607462
+//   iters 1500
+//   formula mandelbrot
+//   color hsv colorMult=1000
+//   aspect 1
+//
+// where location starts a block and names it with the rest of the line.
+// center and radius are required and written with every digit they have,
+// the other lines may be left out and take the defaults of Location.
+// formula is followed by the power for multibrot and by c for julia. Lines
+// starting with # and keys not known are skipped.
+//
+// Thumbnails are rendered one after the other on a thread of their own, by
+// a renderer with one worker so the view being looked at keeps the rest of
+// the CPU. Once EnableThumbnails is called every location added or loaded
+// gets one, asking for it before it is done just finds none.
+class LocationLibrary
+{
+public:
+	static constexpr uint32_t ThumbnailHeight = 96;
+
+private:
+	struct Entry
+	{
+		Location location;
+		// New for every location added, a thumbnail finished for one that
+		// was replaced meanwhile is dropped
+		uint64_t id;
+		IterationBuffer thumbnail;
+		bool hasThumbnail;
+	};
+
+	mutable std::mutex m_mutex;
+	std::vector<Entry> m_entries;
+	uint64_t m_nextId;
+	bool m_thumbnails;
+	// Only the thumbnail jobs touch it
+	CpuRenderer m_renderer;
+	// Declared last, it stops before what its jobs touch goes away
+	RenderThread m_thread;
+
+	void StartThumbnails();
+	void RenderThumbnails(const std::atomic<bool>& cancelled);
+
+public:
+	LocationLibrary();
+
+	// Starts rendering thumbnails, for the locations there are and for
+	// every one after. Without it the library only holds locations.
+	void EnableThumbnails();
+
+	// Replaces every location with those of the file, which are left alone
+	// when it cannot be read or has a malformed block
+	bool Load(const std::string& path);
+	bool Save(const std::string& path) const;
+
+	size_t GetCount() const;
+	Location Get(size_t index) const;
+	// -1 if there is none of that name
+	int Find(const std::string& name) const;
+	// Replaces the location of the same name if there is one, returns the
+	// index it ended up at
+	size_t Add(const Location& location);
+	bool Remove(size_t index);
+
+	// The view thumbnails are rendered at, ThumbnailHeight high and as wide
+	// as the location's aspect asks for
+	static RenderView GetThumbnailView(const Location& location);
+	// Copies the thumbnail of the location and the view it was rendered at,
+	// false while it is not rendered yet
+	bool GetThumbnail(size_t index, IterationBuffer& thumbnail, RenderView& view) const;
+	// Returns once every thumbnail is rendered
+	void WaitForThumbnails();
+};
@@ -0,0 +1,171 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: m_data(nullptr), m_size(0), m_writable(false), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+{
+}
+
+bool MappedFile::OpenRead(const std::string& path)
+{
+	Close();
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping)
+		m_data = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+	m_writable = false;
+	return true;
+}
+
+bool MappedFile::Create(const std::string& path, size_t size)
+{
+	Close();
+	if (size == 0)
+		return false;
+	m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// The mapping grows the file to its size
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+	if (m_mapping)
+		m_data = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+	m_size = size;
+	m_writable = true;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data)
+	{
+		if (m_writable)
+			FlushViewOfFile(m_data, 0);
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_data = nullptr;
+	m_size = 0;
+	m_writable = false;
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: m_data(nullptr), m_size(0), m_writable(false), m_file(-1)
+{
+}
+
+bool MappedFile::OpenRead(const std::string& path)
+{
+	Close();
+	m_file = open(path.c_str(), O_RDONLY);
+	if (m_file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(m_file, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	m_data = (uint8_t*)data;
+	m_size = (size_t)info.st_size;
+	m_writable = false;
+	return true;
+}
+
+bool MappedFile::Create(const std::string& path, size_t size)
+{
+	Close();
+	if (size == 0)
+		return false;
+	m_file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_file < 0)
+		return false;
+
+	if (ftruncate(m_file, (off_t)size) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	m_data = (uint8_t*)data;
+	m_size = size;
+	m_writable = true;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data)
+	{
+		if (m_writable)
+			msync(m_data, m_size, MS_SYNC);
+		munmap(m_data, m_size);
+	}
+	if (m_file >= 0)
+		close(m_file);
+	m_data = nullptr;
+	m_size = 0;
+	m_writable = false;
+	m_file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
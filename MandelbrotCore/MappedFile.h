@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A file mapped into memory, the OS pages it in and out on demand
+class MappedFile
+{
+private:
+	uint8_t* m_data;
+	size_t m_size;
+	bool m_writable;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_file;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Maps all of an existing file
+	bool OpenRead(const std::string& path);
+	// Creates or truncates the file to size bytes and maps it for writing
+	bool Create(const std::string& path, size_t size);
+	// Writes back what changed and unmaps, the file itself stays
+	void Close();
+
+	bool IsOpen() const { return m_data != nullptr; }
+	const uint8_t* GetData() const { return m_data; }
+	// Null unless the file was created for writing
+	uint8_t* GetWritableData() { return m_writable ? m_data : nullptr; }
+	size_t GetSize() const { return m_size; }
+};
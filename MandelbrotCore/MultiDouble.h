@@ -0,0 +1,254 @@
+#pragma once
+
+// Double-double and quad-double numbers as Ops for the escape-time loops
+// of KernelImpl.h. A number is the unevaluated sum of 2 or 4 doubles, each
+// part below the last bit of the one before, giving about 106 or 212 bits.
+// The arithmetic is built on error-free transformations of any Ops, so the
+// same code runs in scalar, AVX2 and AVX-512 lanes. The error of a product
+// comes from FMA where the Ops have it and from Dekker's split otherwise,
+// both are exact so every ISA gets the same parts. Comparisons only look at
+// the leading part, which is all the escape and interior tests need.
+
+#include <cstddef>
+#include <cstdint>
+
+// a + b = s + e exactly
+template<typename Ops>
+void TwoSum(typename Ops::Real a, typename Ops::Real b, typename Ops::Real& s, typename Ops::Real& e)
+{
+	s = Ops::Add(a, b);
+	typename Ops::Real bb = Ops::Sub(s, a);
+	e = Ops::Add(Ops::Sub(a, Ops::Sub(s, bb)), Ops::Sub(b, bb));
+}
+
+// Same for |a| >= |b| or a = 0, with half the operations
+template<typename Ops>
+void QuickTwoSum(typename Ops::Real a, typename Ops::Real b, typename Ops::Real& s, typename Ops::Real& e)
+{
+	s = Ops::Add(a, b);
+	e = Ops::Sub(b, Ops::Sub(s, a));
+}
+
+// a = hi + lo with 26 bits in each half
+template<typename Ops>
+void Split(typename Ops::Real a, typename Ops::Real& hi, typename Ops::Real& lo)
+{
+	typename Ops::Real t = Ops::Mul(Ops::Set(134217729.0), a);
+	hi = Ops::Sub(t, Ops::Sub(t, a));
+	lo = Ops::Sub(a, hi);
+}
+
+// a * b = p + e exactly
+template<typename Ops>
+void TwoProd(typename Ops::Real a, typename Ops::Real b, typename Ops::Real& p, typename Ops::Real& e)
+{
+	using Real = typename Ops::Real;
+
+	p = Ops::Mul(a, b);
+	if constexpr (Ops::Fma)
+	{
+		// Also safe from the compiler contracting the split's products
+		e = Ops::MulSub(a, b, p);
+	}
+	else
+	{
+		Real ah, al, bh, bl;
+		Split<Ops>(a, ah, al);
+		Split<Ops>(b, bh, bl);
+		e = Ops::Add(Ops::Add(Ops::Add(Ops::Sub(Ops::Mul(ah, bh), p), Ops::Mul(ah, bl)), Ops::Mul(al, bh)), Ops::Mul(al, bl));
+	}
+}
+
+// (a, b, c) = a + b + c, the largest part first
+template<typename Ops>
+void ThreeSum(typename Ops::Real& a, typename Ops::Real& b, typename Ops::Real& c)
+{
+	typename Ops::Real t1, t2, t3;
+	TwoSum<Ops>(a, b, t1, t2);
+	TwoSum<Ops>(c, t1, a, t3);
+	TwoSum<Ops>(t2, t3, b, c);
+}
+
+// Same with the last part dropped
+template<typename Ops>
+void ThreeSum2(typename Ops::Real& a, typename Ops::Real& b, typename Ops::Real c)
+{
+	typename Ops::Real t1, t2, t3;
+	TwoSum<Ops>(a, b, t1, t2);
+	TwoSum<Ops>(c, t1, a, t3);
+	b = Ops::Add(t2, t3);
+}
+
+// Five overlapping terms to four parts. Without the zero tests of the
+// usual version, so lanes take no branches: the sum is gathered bottom up
+// exactly, then every part gives what lies below its last bit to the next.
+template<typename Ops>
+void Renormalize(typename Ops::Real* c, typename Ops::Real c4)
+{
+	typename Ops::Real s;
+	TwoSum<Ops>(c[3], c4, s, c4);
+	TwoSum<Ops>(c[2], s, s, c[3]);
+	TwoSum<Ops>(c[1], s, s, c[2]);
+	TwoSum<Ops>(c[0], s, c[0], c[1]);
+
+	QuickTwoSum<Ops>(c[1], c[2], c[1], c[2]);
+	QuickTwoSum<Ops>(c[2], c[3], c[2], c[3]);
+	c[3] = Ops::Add(c[3], c4);
+}
+
+// Masks, counts and stores go to the leading part, the lanes are those of
+// the underlying Ops. N is 2 or 4.
+template<typename Ops, int N>
+struct MultiDoubleOps
+{
+	static_assert(N == 2 || N == 4, "double-double or quad-double");
+
+	using Part = typename Ops::Real;
+
+	static constexpr uint32_t Width = Ops::Width;
+	static constexpr int Parts = N;
+
+	struct Real
+	{
+		Part v[N];
+	};
+	using Mask = typename Ops::Mask;
+
+	static Real Set(double v)
+	{
+		Real r;
+		r.v[0] = Ops::Set(v);
+		for (int i = 1; i < N; i++)
+			r.v[i] = Ops::Set(0);
+		return r;
+	}
+
+	// x0 in N parts, the steps from it are exact enough in double
+	static Real Ramp(const double* x0, double dx, uint32_t p, uint32_t step)
+	{
+		Real r;
+		for (int i = 0; i < N; i++)
+			r.v[i] = Ops::Set(x0[i]);
+		Real offset = Set(0);
+		offset.v[0] = Ops::Ramp(0, dx, p, step);
+		return Add(r, offset);
+	}
+
+	static Mask FirstLanes(uint32_t n) { return Ops::FirstLanes(n); }
+
+	static Real Add(Real a, Real b)
+	{
+		Real r;
+		if constexpr (N == 2)
+		{
+			// The accurate add, x^2 - y^2 cancels often
+			Part s, e, t, f;
+			TwoSum<Ops>(a.v[0], b.v[0], s, e);
+			TwoSum<Ops>(a.v[1], b.v[1], t, f);
+			e = Ops::Add(e, t);
+			QuickTwoSum<Ops>(s, e, s, e);
+			e = Ops::Add(e, f);
+			QuickTwoSum<Ops>(s, e, r.v[0], r.v[1]);
+		}
+		else
+		{
+			Part t[4];
+			for (int i = 0; i < 4; i++)
+				TwoSum<Ops>(a.v[i], b.v[i], r.v[i], t[i]);
+
+			TwoSum<Ops>(r.v[1], t[0], r.v[1], t[0]);
+			ThreeSum<Ops>(r.v[2], t[0], t[1]);
+			ThreeSum2<Ops>(r.v[3], t[0], t[2]);
+			Renormalize<Ops>(r.v, Ops::Add(Ops::Add(t[0], t[1]), t[3]));
+		}
+		return r;
+	}
+
+	static Real Mul(Real a, Real b)
+	{
+		Real r;
+		if constexpr (N == 2)
+		{
+			Part p, e;
+			TwoProd<Ops>(a.v[0], b.v[0], p, e);
+			e = Ops::Add(e, Ops::Add(Ops::Mul(a.v[0], b.v[1]), Ops::Mul(a.v[1], b.v[0])));
+			QuickTwoSum<Ops>(p, e, r.v[0], r.v[1]);
+		}
+		else
+		{
+			// Products down to the third order exactly, the fourth in double
+			Part p[6], q[6];
+			TwoProd<Ops>(a.v[0], b.v[0], p[0], q[0]);
+			TwoProd<Ops>(a.v[0], b.v[1], p[1], q[1]);
+			TwoProd<Ops>(a.v[1], b.v[0], p[2], q[2]);
+			TwoProd<Ops>(a.v[0], b.v[2], p[3], q[3]);
+			TwoProd<Ops>(a.v[1], b.v[1], p[4], q[4]);
+			TwoProd<Ops>(a.v[2], b.v[0], p[5], q[5]);
+
+			ThreeSum<Ops>(p[1], p[2], q[0]);
+			ThreeSum<Ops>(p[2], q[1], q[2]);
+			ThreeSum<Ops>(p[3], p[4], p[5]);
+
+			Part s0, s1, s2, t0, t1;
+			TwoSum<Ops>(p[2], p[3], s0, t0);
+			TwoSum<Ops>(q[1], p[4], s1, t1);
+			s2 = Ops::Add(q[2], p[5]);
+			TwoSum<Ops>(s1, t0, s1, t0);
+			s2 = Ops::Add(s2, Ops::Add(t0, t1));
+
+			Part fourth = Ops::Add(Ops::Add(Ops::Mul(a.v[0], b.v[3]), Ops::Mul(a.v[1], b.v[2])),
+				Ops::Add(Ops::Mul(a.v[2], b.v[1]), Ops::Mul(a.v[3], b.v[0])));
+			fourth = Ops::Add(fourth, Ops::Add(Ops::Add(q[0], q[3]), Ops::Add(q[4], q[5])));
+			s1 = Ops::Add(s1, fourth);
+
+			r.v[0] = p[0];
+			r.v[1] = p[1];
+			r.v[2] = s0;
+			r.v[3] = s1;
+			Renormalize<Ops>(r.v, s2);
+		}
+		return r;
+	}
+
+	static Real Neg(Real a)
+	{
+		for (int i = 0; i < N; i++)
+			a.v[i] = Ops::Sub(Ops::Set(0), a.v[i]);
+		return a;
+	}
+	static Real Sub(Real a, Real b) { return Add(a, Neg(b)); }
+	static Real Abs(Real a) { return Select(Ops::LessEqual(Ops::Set(0), a.v[0]), a, Neg(a)); }
+
+	static Mask LessEqual(Real a, Real b) { return Ops::LessEqual(a.v[0], b.v[0]); }
+	static Mask And(Mask a, Mask b) { return Ops::And(a, b); }
+	static Mask Or(Mask a, Mask b) { return Ops::Or(a, b); }
+	static Mask AndNot(Mask a, Mask b) { return Ops::AndNot(a, b); }
+	static bool Any(Mask m) { return Ops::Any(m); }
+	static uint32_t Count(Mask m) { return Ops::Count(m); }
+	static Real Select(Mask m, Real a, Real b)
+	{
+		for (int i = 0; i < N; i++)
+			a.v[i] = Ops::Select(m, a.v[i], b.v[i]);
+		return a;
+	}
+
+	// Counts only ever use the leading part
+	static Real Increment(Real count, Mask m)
+	{
+		count.v[0] = Ops::Increment(count.v[0], m);
+		return count;
+	}
+	static void StoreCounts(Real count, uint32_t* out, size_t stride, uint32_t lanes) { Ops::StoreCounts(count.v[0], out, stride, lanes); }
+	static Real Load(const double* in)
+	{
+		Real r = Set(0);
+		r.v[0] = Ops::Load(in);
+		return r;
+	}
+	static void Store(Real v, double* out) { Ops::Store(v.v[0], out); }
+};
+
+template<typename Ops>
+using DoubleDoubleOps = MultiDoubleOps<Ops, 2>;
+template<typename Ops>
+using QuadDoubleOps = MultiDoubleOps<Ops, 4>;
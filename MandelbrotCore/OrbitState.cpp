@@ -0,0 +1,154 @@
+#include "OrbitState.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+size_t OrbitArrays::GetMemory() const
+{
+	return pixel.capacity() * sizeof(uint64_t) + iters.capacity() * sizeof(uint32_t)
+		+ (cx.capacity() + cy.capacity() + x.capacity() + y.capacity() + savedX.capacity() + savedY.capacity()) * sizeof(double);
+}
+
+void OrbitArrays::Add(uint64_t p, double pcx, double pcy, double px, double py, double psavedX, double psavedY, uint32_t piters)
+{
+	pixel.push_back(p);
+	cx.push_back(pcx);
+	cy.push_back(pcy);
+	x.push_back(px);
+	y.push_back(py);
+	savedX.push_back(psavedX);
+	savedY.push_back(psavedY);
+	iters.push_back(piters);
+}
+
+void OrbitArrays::Append(const OrbitArrays& other)
+{
+	pixel.insert(pixel.end(), other.pixel.begin(), other.pixel.end());
+	cx.insert(cx.end(), other.cx.begin(), other.cx.end());
+	cy.insert(cy.end(), other.cy.begin(), other.cy.end());
+	x.insert(x.end(), other.x.begin(), other.x.end());
+	y.insert(y.end(), other.y.begin(), other.y.end());
+	savedX.insert(savedX.end(), other.savedX.begin(), other.savedX.end());
+	savedY.insert(savedY.end(), other.savedY.begin(), other.savedY.end());
+	iters.insert(iters.end(), other.iters.begin(), other.iters.end());
+}
+
+void OrbitArrays::Keep(const std::vector<uint8_t>& keep)
+{
+	size_t n = 0;
+	for (size_t k = 0; k < keep.size(); k++)
+	{
+		if (!keep[k])
+			continue;
+
+		pixel[n] = pixel[k];
+		cx[n] = cx[k];
+		cy[n] = cy[k];
+		x[n] = x[k];
+		y[n] = y[k];
+		savedX[n] = savedX[k];
+		savedY[n] = savedY[k];
+		iters[n] = iters[k];
+		n++;
+	}
+
+	pixel.resize(n);
+	cx.resize(n);
+	cy.resize(n);
+	x.resize(n);
+	y.resize(n);
+	savedX.resize(n);
+	savedY.resize(n);
+	iters.resize(n);
+}
+
+void OrbitArrays::Clear()
+{
+	// Frees the memory, a new view may have far fewer of them
+	*this = OrbitArrays();
+}
+
+bool OrbitSettings::operator==(const OrbitSettings& other) const
+{
+	return formula == other.formula && power == other.power && juliaX == other.juliaX && juliaY == other.juliaY
+		&& interiorChecks == other.interiorChecks;
+}
+
+OrbitState::OrbitState()
+	: m_pixels(0)
+{
+	m_view.width = 0;
+	m_view.height = 0;
+	m_view.maxIters = 0;
+}
+
+void OrbitState::Reset(const RenderView& view, const OrbitSettings& settings)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_orbits.Clear();
+	m_view = view;
+	m_settings = settings;
+	m_pixels = 0;
+}
+
+void OrbitState::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_orbits.Clear();
+	m_pixels = 0;
+}
+
+bool OrbitState::Matches(const RenderView& view, const OrbitSettings& settings) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return view.width == m_view.width && view.height == m_view.height && view.centerX == m_view.centerX
+		&& view.centerY == m_view.centerY && view.radius == m_view.radius && settings == m_settings;
+}
+
+bool OrbitState::IsComplete() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pixels == (uint64_t)m_view.width * m_view.height;
+}
+
+void OrbitState::Add(const OrbitArrays& orbits, uint64_t pixels)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_orbits.Append(orbits);
+	m_pixels += pixels;
+}
+
+void OrbitState::Shift(const RenderView& view, int dx, int dy)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	bool complete = m_pixels == (uint64_t)m_view.width * m_view.height;
+
+	std::vector<uint8_t> keep(m_orbits.GetSize());
+	for (size_t k = 0; k < keep.size(); k++)
+	{
+		int64_t x = (int64_t)(m_orbits.pixel[k] % m_view.width) + dx;
+		int64_t y = (int64_t)(m_orbits.pixel[k] / m_view.width) + dy;
+		keep[k] = x >= 0 && y >= 0 && x < (int64_t)view.width && y < (int64_t)view.height;
+		if (keep[k])
+			m_orbits.pixel[k] = (uint64_t)y * view.width + (uint64_t)x;
+	}
+	m_orbits.Keep(keep);
+
+	// What stayed in view, the strips come on top
+	uint64_t keptW = (uint64_t)std::max<int64_t>((int64_t)view.width - std::abs(dx), 0);
+	uint64_t keptH = (uint64_t)std::max<int64_t>((int64_t)view.height - std::abs(dy), 0);
+	m_pixels = complete && view.width == m_view.width && view.height == m_view.height ? keptW * keptH : 0;
+	m_view = view;
+}
+
+size_t OrbitState::GetSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_orbits.GetSize();
+}
+
+size_t OrbitState::GetMemory() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_orbits.GetMemory();
+}
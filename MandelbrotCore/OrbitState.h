@@ -0,0 +1,89 @@
+#pragma once
+
+#include "CpuRenderer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Pixels whose orbits ran out of iterations and where they stopped, one
+// array per value so the kernels can load them lane by lane
+struct OrbitArrays
+{
+	// y * width + x in the view
+	std::vector<uint64_t> pixel;
+	// c the formula adds, z after iters iterations and Brent's saved point
+	std::vector<double> cx;
+	std::vector<double> cy;
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> savedX;
+	std::vector<double> savedY;
+	std::vector<uint32_t> iters;
+
+	size_t GetSize() const { return pixel.size(); }
+	size_t GetMemory() const;
+
+	void Add(uint64_t p, double pcx, double pcy, double px, double py, double psavedX, double psavedY, uint32_t piters);
+	void Append(const OrbitArrays& other);
+	// Drops the entries whose flag is 0, keep holds one per entry
+	void Keep(const std::vector<uint8_t>& keep);
+	void Clear();
+};
+
+// Everything besides the view that decides where an orbit goes
+struct OrbitSettings
+{
+	Formula formula = Formula::Mandelbrot;
+	int power = 2;
+	double juliaX = 0;
+	double juliaY = 0;
+	bool interiorChecks = true;
+
+	bool operator==(const OrbitSettings& other) const;
+	bool operator!=(const OrbitSettings& other) const { return !(*this == other); }
+};
+
+// The stopped orbits of one buffer, so raising maxIters continues those
+// pixels instead of starting every pixel over at z = 0 (see
+// CpuRenderer::RaiseMaxIters). Only they have entries, the memory follows
+// the interior of the image and not its size. A renderer it is set on fills
+// it in as it renders and starts it over when the view or the settings
+// change. Thread safe while the renderer fills it, not while it is shifted
+// or continued.
+class OrbitState
+{
+private:
+	mutable std::mutex m_mutex;
+	OrbitArrays m_orbits;
+	RenderView m_view;
+	OrbitSettings m_settings;
+	// Rendered since the reset, it is complete once every pixel of the view
+	// came through here
+	uint64_t m_pixels;
+
+public:
+	OrbitState();
+
+	void Reset(const RenderView& view, const OrbitSettings& settings);
+	// Keeps the view, it is not complete until rendered again
+	void Clear();
+
+	// Same pixel grid and settings, maxIters may differ
+	bool Matches(const RenderView& view, const OrbitSettings& settings) const;
+	int GetMaxIters() const { return m_view.maxIters; }
+	void SetMaxIters(int maxIters) { m_view.maxIters = maxIters; }
+	bool IsComplete() const;
+
+	// Entries of pixels that were rendered, out of pixels rendered
+	void Add(const OrbitArrays& orbits, uint64_t pixels);
+
+	// The image moved right by dx and down by dy into view. Entries that
+	// left it are dropped, the uncovered strips still have to be rendered.
+	void Shift(const RenderView& view, int dx, int dy);
+
+	OrbitArrays& GetOrbits() { return m_orbits; }
+	size_t GetSize() const;
+	size_t GetMemory() const;
+};
@@ -0,0 +1,207 @@
+#include "Palette.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	struct Color
+	{
+		float r, g, b;
+	};
+
+	Color Mix(const Color& a, const Color& b, float t)
+	{
+		return { a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t };
+	}
+
+	float Fract(float x)
+	{
+		return x - std::floor(x);
+	}
+
+	Color Gradient(float x)
+	{
+		static const Color colors[] =
+		{
+			{ 0, 0, 0 },
+			{ 0.13f, 0.142f, 0.8f },
+			{ 1, 1, 1 },
+			{ 1, 0.667f, 0 },
+			{ 0, 0, 0 },
+		};
+
+		// mod(x, colors.length() - 1)
+		x -= 4 * std::floor(x / 4);
+
+		int i = std::min((int)x, 3);
+		return Mix(colors[i], colors[i + 1], x - i);
+	}
+
+	Color Hsv(float h)
+	{
+		auto channel = [h](float k)
+		{
+			float p = std::abs(Fract(h + k) * 6 - 3);
+			return std::min(std::max(p - 1, 0.0f), 1.0f);
+		};
+
+		return { channel(1.0f), channel(2.0f / 3.0f), channel(1.0f / 3.0f) };
+	}
+
+	Color GetColor(Palette palette, float x)
+	{
+		switch (palette)
+		{
+		case Palette::Gradient:
+			return Gradient(x);
+		case Palette::Hsv:
+			return Hsv(x);
+		case Palette::Exponential:
+			return Mix({ 1, 1, 1 }, { 0.1f, 0.1f, 1 }, std::exp(-x));
+		case Palette::Waves:
+			return { std::sin(x) * 0.5f + 0.5f, std::cos(x) * 0.5f + 0.5f, 1 };
+		}
+
+		return { 0, 0, 0 };
+	}
+
+	uint8_t ToByte(float v)
+	{
+		return (uint8_t)(std::min(std::max(v, 0.0f), 1.0f) * 255 + 0.5f);
+	}
+}
+
+const char* GetPaletteName(Palette palette)
+{
+	switch (palette)
+	{
+	case Palette::Gradient:
+		return "gradient";
+	case Palette::Hsv:
+		return "hsv";
+	case Palette::Exponential:
+		return "exponential";
+	case Palette::Waves:
+		return "waves";
+	}
+
+	return "";
+}
+
+bool ParsePalette(const std::string& name, Palette& palette)
+{
+	const Palette palettes[] = { Palette::Gradient, Palette::Hsv, Palette::Exponential, Palette::Waves };
+	for (Palette p : palettes)
+	{
+		if (name == GetPaletteName(p))
+		{
+			palette = p;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+float GetDefaultColorMult(Palette palette)
+{
+	return palette == Palette::Hsv ? 1000.0f : 200.0f;
+}
+
+void ColorizeScalar(const uint32_t* table, uint32_t last, const uint32_t* iters, uint32_t count, uint8_t* rgb)
+{
+	for (uint32_t i = 0; i < count; i++, rgb += 3)
+	{
+		uint32_t c = table[std::min(iters[i], last)];
+		rgb[0] = (uint8_t)c;
+		rgb[1] = (uint8_t)(c >> 8);
+		rgb[2] = (uint8_t)(c >> 16);
+	}
+}
+
+CpuColorFunction::CpuColorFunction(Function function, std::vector<Uniform> uniforms)
+	: m_function(std::move(function)), m_uniforms(std::move(uniforms)), m_maxIters(0), m_dirty(true), m_isa(GetBestKernelIsa())
+{
+	for (const Uniform& uniform : m_uniforms)
+		m_values.push_back(uniform.defaultValue);
+}
+
+CpuColorFunction CpuColorFunction::Create(Palette palette)
+{
+	// The ranges of the viewer's color functions
+	Uniform colorMult = { "colorMult", 1, 300, GetDefaultColorMult(palette) };
+	if (palette == Palette::Hsv)
+		colorMult = { "colorMult", 1.1f, 5000, GetDefaultColorMult(palette) };
+	else if (palette == Palette::Exponential)
+		colorMult = { "colorMult", 1, 1000, GetDefaultColorMult(palette) };
+
+	Function function = [palette](int iters, const float* uniforms, float* rgb)
+	{
+		Color c = GetColor(palette, iters / uniforms[0]);
+		rgb[0] = c.r;
+		rgb[1] = c.g;
+		rgb[2] = c.b;
+	};
+	return CpuColorFunction(function, { colorMult });
+}
+
+bool CpuColorFunction::SetUniform(const std::string& name, float value)
+{
+	for (size_t i = 0; i < m_uniforms.size(); i++)
+	{
+		if (m_uniforms[i].name == name)
+		{
+			if (m_values[i] != value)
+				m_dirty = true;
+			m_values[i] = value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+float CpuColorFunction::GetUniform(const std::string& name) const
+{
+	for (size_t i = 0; i < m_uniforms.size(); i++)
+		if (m_uniforms[i].name == name)
+			return m_values[i];
+
+	return 0;
+}
+
+void CpuColorFunction::SetIsa(KernelIsa isa)
+{
+	if (!IsKernelIsaSupported(isa) || !IsKernelIsaSupported(KernelIsa::AVX2))
+		isa = KernelIsa::Scalar;
+
+	m_isa = isa;
+}
+
+void CpuColorFunction::Prepare(int maxIters)
+{
+	maxIters = std::max(maxIters, 0);
+	if (!m_dirty && maxIters == m_maxIters)
+		return;
+
+	m_table.resize((size_t)maxIters + 1);
+	for (int i = 0; i < maxIters; i++)
+	{
+		float c[3];
+		m_function(i, m_values.data(), c);
+		m_table[i] = ToByte(c[0]) | (uint32_t)ToByte(c[1]) << 8 | (uint32_t)ToByte(c[2]) << 16;
+	}
+	m_table[maxIters] = 0;
+
+	m_maxIters = maxIters;
+	m_dirty = false;
+}
+
+void CpuColorFunction::Colorize(const uint32_t* iters, uint32_t count, uint8_t* rgb) const
+{
+	if (m_isa != KernelIsa::Scalar)
+		ColorizeAVX2(m_table.data(), (uint32_t)m_maxIters, iters, count, rgb);
+	else
+		ColorizeScalar(m_table.data(), (uint32_t)m_maxIters, iters, count, rgb);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Kernel.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The color functions the viewer ships with, evaluated on the CPU the same
+// way their get_color shaders do
+enum class Palette
+{
+	Gradient,
+	Hsv,
+	Exponential,
+	Waves
+};
+
+const char* GetPaletteName(Palette palette);
+// Case sensitive, matches GetPaletteName
+bool ParsePalette(const std::string& name, Palette& palette);
+// The colorMult each palette starts with in the viewer
+float GetDefaultColorMult(Palette palette);
+
+// A color function with named parameters, the CPU side of the viewer's
+// ColorFunction. Colors only depend on the integer count, like get_color,
+// so Prepare evaluates the function once per count into a table and
+// coloring a buffer is a lookup per pixel.
+class CpuColorFunction
+{
+public:
+	struct Uniform
+	{
+		std::string name;
+		float min;
+		float max;
+		float defaultValue;
+	};
+
+	// Writes r, g and b in 0 ... 1 for a count below maxIters
+	using Function = std::function<void(int iters, const float* uniforms, float* rgb)>;
+
+private:
+	Function m_function;
+	std::vector<Uniform> m_uniforms;
+	std::vector<float> m_values;
+
+	// 0x00BBGGRR per count, the last entry is the black of maxIters
+	std::vector<uint32_t> m_table;
+	int m_maxIters;
+	bool m_dirty;
+	KernelIsa m_isa;
+
+public:
+	CpuColorFunction(Function function, std::vector<Uniform> uniforms);
+
+	// The built-in palette, its colorMult uniform ranging like the viewer's
+	static CpuColorFunction Create(Palette palette);
+
+	const std::vector<Uniform>& GetUniforms() const { return m_uniforms; }
+	// Unknown names are ignored and return false
+	bool SetUniform(const std::string& name, float value);
+	float GetUniform(const std::string& name) const;
+
+	// Scalar or AVX2, AVX-512 colors with AVX2. Defaults to the best supported,
+	// one the CPU lacks gives Scalar like CpuRenderer::SetKernelIsa.
+	void SetIsa(KernelIsa isa);
+	KernelIsa GetIsa() const { return m_isa; }
+
+	// Builds the table for maxIters unless it is up to date already
+	void Prepare(int maxIters);
+	int GetMaxIters() const { return m_maxIters; }
+
+	// Writes count packed 8 bit RGB pixels. Pixels that reached maxIters are
+	// black like the viewer's background. Needs Prepare first and may run
+	// from several threads at once.
+	void Colorize(const uint32_t* iters, uint32_t count, uint8_t* rgb) const;
+};
+
+// Table lookups behind CpuColorFunction::Colorize, counts above last are
+// clamped to it
+void ColorizeScalar(const uint32_t* table, uint32_t last, const uint32_t* iters, uint32_t count, uint8_t* rgb);
+void ColorizeAVX2(const uint32_t* table, uint32_t last, const uint32_t* iters, uint32_t count, uint8_t* rgb);
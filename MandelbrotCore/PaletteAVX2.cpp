@@ -0,0 +1,26 @@
+#include "Palette.h"
+
+#include <immintrin.h>
+
+void ColorizeAVX2(const uint32_t* table, uint32_t last, const uint32_t* iters, uint32_t count, uint8_t* rgb)
+{
+	const __m256i lastCount = _mm256_set1_epi32((int)last);
+	// Drops the zero byte of every 0x00BBGGRR, leaving 12 bytes per lane
+	const __m256i pack = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	// The stores write 4 bytes past the 8 pixels, the next ones overwrite
+	// them. The last pixels are left to the scalar loop so nothing is
+	// written past rgb.
+	uint32_t i = 0;
+	for (; i + 10 <= count; i += 8, rgb += 24)
+	{
+		__m256i index = _mm256_min_epu32(_mm256_loadu_si256((const __m256i*)(iters + i)), lastCount);
+		__m256i colors = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int*)table, index, 4), pack);
+		_mm_storeu_si128((__m128i*)rgb, _mm256_castsi256_si128(colors));
+		_mm_storeu_si128((__m128i*)(rgb + 12), _mm256_extracti128_si256(colors, 1));
+	}
+
+	ColorizeScalar(table, last, iters + i, count - i, rgb);
+}
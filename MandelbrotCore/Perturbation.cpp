@@ -0,0 +1,280 @@
+#include "Perturbation.h"
+#include "Kernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+void ReferenceOrbit::Compute(const BigFixed& cx, const BigFixed& cy, int maxIters)
+{
+	m_cx = cx;
+	m_cy = cy;
+	m_maxIters = maxIters;
+
+	m_x.clear();
+	m_y.clear();
+	m_x.reserve((size_t)maxIters + 1);
+	m_y.reserve((size_t)maxIters + 1);
+
+	uint32_t precision = std::max(cx.GetPrecision(), cy.GetPrecision());
+	BigFixed x(0.0, precision);
+	BigFixed y(0.0, precision);
+
+	m_x.push_back(0);
+	m_y.push_back(0);
+
+	for (int i = 0; i < maxIters; i++)
+	{
+		BigFixed xy = x * y;
+		x = x * x - y * y + cx;
+		y = xy + xy + cy;
+
+		double dx = x.ToDouble();
+		double dy = y.ToDouble();
+		m_x.push_back(dx);
+		m_y.push_back(dy);
+
+		if (dx * dx + dy * dy > 4)
+			break;
+	}
+}
+
+bool ReferenceOrbit::Matches(const BigFixed& cx, const BigFixed& cy, int maxIters) const
+{
+	return m_maxIters == maxIters
+		&& cx.GetPrecision() == m_cx.GetPrecision()
+		&& cy.GetPrecision() == m_cy.GetPrecision()
+		&& cx == m_cx && cy == m_cy;
+}
+
+void BlaTable::Build(const ReferenceOrbit& orbit, double maxDc, double epsilon)
+{
+	Clear();
+
+	const double* X = orbit.GetX();
+	const double* Y = orbit.GetY();
+	size_t last = orbit.GetLength() - 1;
+	if (last < 2)
+		return;
+
+	// Single steps, A = 2 Z_m and B = 1. Dropping dz^2 next to 2 Z_m dz is
+	// accurate to epsilon while |dz| < epsilon |Z_m|.
+	std::vector<Step> level;
+	level.reserve(last - 1);
+	for (size_t m = 1; m < last; m++)
+	{
+		double r = epsilon * std::sqrt(X[m] * X[m] + Y[m] * Y[m]);
+		level.push_back({ 2 * X[m], 2 * Y[m], 1, 0, r * r, 1 });
+		m_maxR2 = std::max(m_maxR2, r * r);
+	}
+	m_levels.push_back(std::move(level));
+
+	// x then y: A = Ay Ax, B = Ay Bx + By, valid while |dz| < Rx and
+	// |Ax dz + Bx dc| < Ry
+	while (m_levels.back().size() >= 2)
+	{
+		const std::vector<Step>& prev = m_levels.back();
+		std::vector<Step> next;
+		next.reserve(prev.size() / 2);
+
+		for (size_t k = 0; k + 1 < prev.size(); k += 2)
+		{
+			const Step& x = prev[k];
+			const Step& y = prev[k + 1];
+
+			Step z;
+			z.ax = y.ax * x.ax - y.ay * x.ay;
+			z.ay = y.ax * x.ay + y.ay * x.ax;
+			z.bx = y.ax * x.bx - y.ay * x.by + y.bx;
+			z.by = y.ax * x.by + y.ay * x.bx + y.by;
+			z.length = x.length + y.length;
+
+			double absA = std::sqrt(x.ax * x.ax + x.ay * x.ay);
+			double absB = std::sqrt(x.bx * x.bx + x.by * x.by);
+			double r = std::min(std::sqrt(x.r2), (std::sqrt(y.r2) - absB * maxDc) / absA);
+			r = std::max(0.0, r);
+			z.r2 = std::isfinite(r) ? r * r : 0;
+
+			next.push_back(z);
+		}
+		m_levels.push_back(std::move(next));
+	}
+}
+
+const BlaTable::Step* BlaTable::Find(size_t m, double dz2, uint32_t maxLength) const
+{
+	if (m == 0 || m_levels.empty())
+		return nullptr;
+
+	// A merged step is never valid further out than its first half, so the
+	// search goes up from single steps and stops at the first miss
+	size_t offset = m - 1;
+	const Step* best = nullptr;
+	for (size_t l = 0; l < m_levels.size(); l++)
+	{
+		if (offset & (((size_t)1 << l) - 1))
+			break;
+
+		size_t k = offset >> l;
+		if (k >= m_levels[l].size())
+			break;
+
+		const Step& step = m_levels[l][k];
+		if (dz2 >= step.r2 || step.length > maxLength)
+			break;
+
+		best = &step;
+	}
+	return best;
+}
+
+namespace
+{
+	// Distance tracks the derivative of the full z. Z does not depend on
+	// the pixel, so it is the derivative of dz: 2 z d + 1 per step, A d + B
+	// over a BLA step and unchanged by a rebase.
+	template<bool Distance>
+	void IteratePerturbedRowImpl(const ReferenceOrbit& orbit, const BlaTable* bla, const PerturbedRow& row, PerturbationStats& stats)
+	{
+		const double* X = orbit.GetX();
+		const double* Y = orbit.GetY();
+		const size_t last = orbit.GetLength() - 1;
+		const double eps2 = row.periodEpsilon * row.periodEpsilon;
+
+		for (uint32_t p = 0; p < row.count; p++)
+		{
+			double dcx = row.dx0 + (row.vertical ? row.x : row.x + p) * row.ddx;
+			double dcy = row.dy0 + (row.vertical ? row.y + p : row.y) * row.ddy;
+			size_t out = p * row.stride;
+
+			if (row.cardioid && IsInCardioidOrBulb(row.refX + dcx, row.refY + dcy))
+			{
+				row.iters[out] = (uint32_t)row.maxIters;
+				row.smooth[out] = 0.0f;
+				if constexpr (Distance)
+					row.distance[out] = NoDistance;
+				stats.cardioidRejected++;
+				continue;
+			}
+
+			double dzx = 0;
+			double dzy = 0;
+			size_t m = 0;
+			double r2 = 0;
+			double derivX = 0;
+			double derivY = 0;
+
+			// Saved point for the periodicity check as reference iteration and
+			// delta, z - saved = (Z_m - Z_s) + (dz - dz_s)
+			size_t savedM = 0;
+			double savedX = 1e300;
+			double savedY = 1e300;
+			int saveAt = 1;
+
+			int i;
+			for (i = 0; i < row.maxIters; i++)
+			{
+				double zx = X[m] + dzx;
+				double zy = Y[m] + dzy;
+				r2 = zx * zx + zy * zy;
+				if (r2 > 4)
+					break;
+
+				if (eps2 > 0)
+				{
+					// epsilon is far below the resolution of Z, so only an exact
+					// repeat of the reference can get close enough
+					if (X[m] == X[savedM] && Y[m] == Y[savedM])
+					{
+						double ex = dzx - savedX;
+						double ey = dzy - savedY;
+						if (ex * ex + ey * ey <= eps2)
+						{
+							stats.periodRejected++;
+							i = row.maxIters;
+							break;
+						}
+					}
+
+					// BLA steps jump over the exact power of two
+					if (i >= saveAt)
+					{
+						savedM = m;
+						savedX = dzx;
+						savedY = dzy;
+						while (saveAt <= i)
+							saveAt *= 2;
+					}
+				}
+
+				// Once the pixel gets closer to 0 than to the reference the delta
+				// loses precision (a glitch). Restarting the reference from Z_0
+				// with the full value as the delta avoids it, this is also how
+				// pixels outlive a reference that escaped early.
+				if (m != 0 && (r2 < dzx * dzx + dzy * dzy || m == last))
+				{
+					dzx = zx;
+					dzy = zy;
+					m = 0;
+					stats.rebases++;
+				}
+
+				double dz2 = dzx * dzx + dzy * dzy;
+				if (bla && bla->MayApply(m, dz2))
+				{
+					const BlaTable::Step* step = bla->Find(m, dz2, (uint32_t)(row.maxIters - i));
+					if (step)
+					{
+						double nx = step->ax * dzx - step->ay * dzy + step->bx * dcx - step->by * dcy;
+						double ny = step->ax * dzy + step->ay * dzx + step->bx * dcy + step->by * dcx;
+						dzx = nx;
+						dzy = ny;
+
+						if constexpr (Distance)
+						{
+							double dx = step->ax * derivX - step->ay * derivY + step->bx;
+							double dy = step->ax * derivY + step->ay * derivX + step->by;
+							derivX = dx;
+							derivY = dy;
+						}
+						m += step->length;
+
+						// The loop adds the last one
+						i += step->length - 1;
+						stats.skippedIters += step->length;
+						continue;
+					}
+				}
+
+				if constexpr (Distance)
+				{
+					double nx = 2 * (zx * derivX - zy * derivY) + 1;
+					double ny = 2 * (zx * derivY + zy * derivX);
+					derivX = nx;
+					derivY = ny;
+				}
+
+				// dz' = 2 Z dz + dz^2 + dc
+				double nx = 2 * (X[m] * dzx - Y[m] * dzy) + dzx * dzx - dzy * dzy + dcx;
+				double ny = 2 * (X[m] * dzy + Y[m] * dzx) + 2 * dzx * dzy + dcy;
+				dzx = nx;
+				dzy = ny;
+				m++;
+			}
+			row.iters[out] = (uint32_t)i;
+			row.smooth[out] = i < row.maxIters ? GetSmoothFraction(r2) : 0.0f;
+			if constexpr (Distance)
+				row.distance[out] = i < row.maxIters ? GetDistanceEstimate(r2, derivX, derivY, std::abs(row.ddx)) : NoDistance;
+		}
+	}
+}
+
+void IteratePerturbedRow(const ReferenceOrbit& orbit, const BlaTable* bla, const PerturbedRow& row, PerturbationStats& stats)
+{
+	if (bla && bla->IsEmpty())
+		bla = nullptr;
+
+	if (row.distance)
+		IteratePerturbedRowImpl<true>(orbit, bla, row, stats);
+	else
+		IteratePerturbedRowImpl<false>(orbit, bla, row, stats);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "BigFixed.h"
+
+#include <cstdint>
+#include <vector>
+
+// Orbit of one point iterated in full precision, rounded to double. Every
+// other pixel is iterated as a small delta from it.
+class ReferenceOrbit
+{
+private:
+	std::vector<double> m_x;
+	std::vector<double> m_y;
+
+	BigFixed m_cx;
+	BigFixed m_cy;
+	int m_maxIters;
+
+public:
+	ReferenceOrbit() : m_maxIters(-1) {}
+
+	// Stops early when the reference itself escapes
+	void Compute(const BigFixed& cx, const BigFixed& cy, int maxIters);
+	bool Matches(const BigFixed& cx, const BigFixed& cy, int maxIters) const;
+
+	const BigFixed& GetCenterX() const { return m_cx; }
+	const BigFixed& GetCenterY() const { return m_cy; }
+	int GetMaxIters() const { return m_maxIters; }
+
+	// Z_0 ... Z_(length - 1), Z_0 is always 0
+	size_t GetLength() const { return m_x.size(); }
+	const double* GetX() const { return m_x.data(); }
+	const double* GetY() const { return m_y.data(); }
+};
+
+// Bivariate linear approximation of the perturbed iteration. Over `length`
+// iterations starting at reference iteration m, dz -> A dz + B dc as long
+// as |dz| < R, so whole blocks of iterations are skipped at once. Level l
+// holds steps of length 2^l starting at m = 1 + k 2^l.
+class BlaTable
+{
+public:
+	struct Step
+	{
+		double ax, ay;
+		double bx, by;
+		double r2;
+		uint32_t length;
+	};
+
+private:
+	std::vector<std::vector<Step>> m_levels;
+	// Largest r2 of the single steps, no merged step reaches further
+	double m_maxR2;
+
+public:
+	BlaTable() : m_maxR2(0) {}
+
+	// maxDc bounds |dc| over every pixel that will use the table. Steps drop
+	// the dz^2 term, epsilon is the relative error allowed for that.
+	void Build(const ReferenceOrbit& orbit, double maxDc, double epsilon);
+	void Clear() { m_levels.clear(); m_maxR2 = 0; }
+	bool IsEmpty() const { return m_levels.empty(); }
+
+	// Whether any step is valid for a |dz|^2 as large as dz2. Deltas rarely
+	// get much below the pixel size, when even that is out of reach the
+	// lookups only cost time.
+	bool MayApplyAt(double dz2) const { return dz2 < m_maxR2; }
+
+	// Cheap test run every iteration before the full search
+	bool MayApply(size_t m, double dz2) const
+	{
+		return m != 0 && m - 1 < m_levels[0].size() && dz2 < m_levels[0][m - 1].r2;
+	}
+
+	// Longest step from reference iteration m valid for |dz|^2 == dz2 that
+	// is no longer than maxLength, nullptr if there is none
+	const Step* Find(size_t m, double dz2, uint32_t maxLength) const;
+};
+
+// A run of pixels like KernelRow, given as offsets from the reference:
+// pixel (i, j) is dc = (dx0 + i * ddx, dy0 + j * ddy). distance may be null
+// like in KernelRow.
+struct PerturbedRow
+{
+	double dx0;
+	double ddx;
+	double dy0;
+	double ddy;
+	uint32_t x;
+	uint32_t y;
+	uint32_t count;
+	bool vertical;
+	int maxIters;
+	uint32_t* iters;
+	float* smooth;
+	float* distance;
+	size_t stride;
+
+	// Interior tests like KernelRow. The cardioid test needs the reference
+	// point in double, the periodicity check compares z through the
+	// reference so periodEpsilon can be far below double resolution of z.
+	bool cardioid;
+	double refX;
+	double refY;
+	double periodEpsilon;
+};
+
+struct PerturbationStats
+{
+	uint64_t rebases = 0;
+	uint64_t skippedIters = 0;
+	uint64_t cardioidRejected = 0;
+	uint64_t periodRejected = 0;
+};
+
+// Deltas are plain doubles, which holds up until pixel sizes near 1e-290.
+// bla may be null or empty to iterate every step.
+void IteratePerturbedRow(const ReferenceOrbit& orbit, const BlaTable* bla, const PerturbedRow& row, PerturbationStats& stats);
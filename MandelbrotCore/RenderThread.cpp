@@ -0,0 +1,75 @@
+#include "RenderThread.h"
+
+RenderThread::RenderThread()
+	: m_running(false)
+	, m_stop(false)
+	, m_cancelled(false)
+{
+	m_thread = std::thread(&RenderThread::Loop, this);
+}
+
+RenderThread::~RenderThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending = nullptr;
+		m_stop = true;
+		m_cancelled = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+void RenderThread::Loop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [this]() { return m_stop || m_pending; });
+		if (m_stop)
+			return;
+
+		// Cleared under the lock, a Submit after this cancels the new job
+		Job job = std::move(m_pending);
+		m_pending = nullptr;
+		m_cancelled = false;
+		m_running = true;
+
+		lock.unlock();
+		job(m_cancelled);
+		lock.lock();
+
+		m_running = false;
+		if (!m_pending)
+			m_idle.notify_all();
+	}
+}
+
+void RenderThread::Submit(Job job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending = std::move(job);
+		m_cancelled = true;
+	}
+	m_wake.notify_one();
+}
+
+void RenderThread::Cancel()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pending = nullptr;
+	m_cancelled = true;
+}
+
+void RenderThread::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this]() { return !m_running && !m_pending; });
+}
+
+bool RenderThread::IsBusy()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_running || m_pending;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs render jobs one at a time on a thread of its own. Only the latest
+// job matters: a new one replaces the job still waiting and cancels the
+// running one, which sees it through the flag it is handed (see
+// CpuRenderer::SetCancelFlag) and returns early. Nothing but Wait blocks
+// on a job.
+class RenderThread
+{
+public:
+	using Job = std::function<void(const std::atomic<bool>& cancelled)>;
+
+private:
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_idle;
+	Job m_pending;
+	bool m_running;
+	bool m_stop;
+	// Set for the running job, cleared when the next one starts
+	std::atomic<bool> m_cancelled;
+
+	void Loop();
+
+public:
+	RenderThread();
+	// Cancels the running job and waits for it to return
+	~RenderThread();
+
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+
+	void Submit(Job job);
+	// Drops the waiting job and cancels the running one
+	void Cancel();
+	// Returns once no job is waiting or running. With Cancel before it,
+	// that is as soon as the running job notices.
+	void Wait();
+	bool IsBusy();
+
+	// What every job is handed, for renderers that check it themselves
+	const std::atomic<bool>& GetCancelFlag() const { return m_cancelled; }
+};
@@ -0,0 +1,189 @@
+#include "Sampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Samples a pixel can take with the counts kept in a byte
+	constexpr uint32_t SampleLimit = 256;
+	// Half the diagonal, how far a pixel reaches from its center
+	constexpr float PixelReach = 0.70711f;
+	// Discs are only filled up to this radius, bigger ones mostly cover
+	// pixels filled already
+	constexpr int MaxDiscRadius = 64;
+}
+
+void GetSampleOffset(uint32_t sample, double& x, double& y)
+{
+	// 1 / g and 1 / g^2 for the plastic number g
+	const double a1 = 0.75487766624669276005;
+	const double a2 = 0.56984029099805326591;
+
+	double u = 0.5 + a1 * sample;
+	double v = 0.5 + a2 * sample;
+	x = u - std::floor(u) - 0.5;
+	y = v - std::floor(v) - 0.5;
+}
+
+SamplingStats PlanSamples(const IterationBuffer& buffer, int maxIters, const SamplingOptions& options, std::vector<uint8_t>& extraSamples)
+{
+	const uint32_t w = buffer.GetWidth();
+	const uint32_t h = buffer.GetHeight();
+	const uint32_t extra = std::min(std::max(options.maxSamples, 1u), SampleLimit) - 1;
+
+	SamplingStats stats;
+	if (!options.adaptive || !buffer.HasDistance())
+	{
+		extraSamples.assign((size_t)w * h, (uint8_t)extra);
+		stats.sampledPixels = extra > 0 ? (uint64_t)w * h : 0;
+		return stats;
+	}
+
+	extraSamples.assign((size_t)w * h, 0);
+	std::vector<uint8_t> done((size_t)w * h, 0);
+
+	auto isInterior = [&](uint32_t i, uint32_t j) { return buffer.At(i, j) >= (uint32_t)maxIters; };
+
+	for (uint32_t j = 0; j < h; j++)
+	{
+		for (uint32_t i = 0; i < w; i++)
+		{
+			size_t p = (size_t)j * w + i;
+			if (done[p])
+				continue;
+			done[p] = 1;
+
+			if (isInterior(i, j))
+			{
+				// The boundary runs between it and an exterior neighbour
+				bool edge = false;
+				for (uint32_t y = j > 0 ? j - 1 : 0; y <= std::min(j + 1, h - 1) && !edge; y++)
+					for (uint32_t x = i > 0 ? i - 1 : 0; x <= std::min(i + 1, w - 1) && !edge; x++)
+						edge = !isInterior(x, y);
+
+				extraSamples[p] = edge ? (uint8_t)extra : 0;
+				continue;
+			}
+
+			float distance = buffer.DistanceAt(i, j);
+			if (distance < options.distanceLimit)
+			{
+				// Up to every sample right on a filament
+				float closeness = 1.0f - std::max(distance, 0.0f) / options.distanceLimit;
+				extraSamples[p] = (uint8_t)std::min((uint32_t)std::ceil(extra * closeness), extra);
+				continue;
+			}
+
+			// Pixels that fit into half the estimate have no boundary in them
+			float reach = 0.5f * distance - PixelReach;
+			if (reach < 1)
+				continue;
+
+			int r = std::min((int)reach, MaxDiscRadius);
+			float r2 = std::min(reach, (float)MaxDiscRadius) * std::min(reach, (float)MaxDiscRadius);
+			for (int dy = -r; dy <= r; dy++)
+			{
+				int y = (int)j + dy;
+				if (y < 0 || y >= (int)h)
+					continue;
+
+				for (int dx = -r; dx <= r; dx++)
+				{
+					int x = (int)i + dx;
+					if (x < 0 || x >= (int)w || (float)(dx * dx + dy * dy) > r2)
+						continue;
+
+					size_t q = (size_t)y * w + x;
+					if (!done[q])
+					{
+						done[q] = 1;
+						stats.filledPixels++;
+					}
+				}
+			}
+		}
+	}
+
+	for (uint8_t s : extraSamples)
+		stats.sampledPixels += s > 0;
+	return stats;
+}
+
+SamplingStats RenderAntialiased(CpuRenderer& renderer, const RenderView& view, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+	const CpuColorFunction& colors, const SamplingOptions& options, std::vector<uint8_t>& rgb)
+{
+	const uint32_t maxSamples = std::min(std::max(options.maxSamples, 1u), SampleLimit);
+	const size_t pixels = (size_t)w * h;
+
+	// Only the center samples need the distances
+	bool distance = renderer.IsDistanceEstimation();
+	renderer.SetDistanceEstimation(options.adaptive && maxSamples > 1);
+
+	IterationBuffer buffer;
+	renderer.RenderRegion(view, buffer, x, y, w, h);
+	renderer.SetDistanceEstimation(false);
+
+	std::vector<uint8_t> extraSamples;
+	SamplingStats stats = PlanSamples(buffer, view.maxIters, options, extraSamples);
+	stats.samples = pixels;
+
+	// 256 samples of 255 still fit
+	std::vector<uint16_t> sums(pixels * 3);
+	auto accumulate = [&](const IterationBuffer& samples, const std::vector<uint8_t>* mask)
+	{
+		renderer.GetPool().ParallelFor(h, [&](size_t j)
+		{
+			std::vector<uint8_t> row((size_t)w * 3);
+			colors.Colorize(samples.GetRow((uint32_t)j), w, row.data());
+
+			uint16_t* sum = sums.data() + j * w * 3;
+			for (uint32_t i = 0; i < w; i++)
+			{
+				if (mask && !(*mask)[j * w + i])
+					continue;
+
+				sum[3 * i] += row[3 * i];
+				sum[3 * i + 1] += row[3 * i + 1];
+				sum[3 * i + 2] += row[3 * i + 2];
+			}
+		});
+	};
+	accumulate(buffer, nullptr);
+
+	// Sample k goes to every pixel that takes at least k extra ones, all
+	// of them at the same offset so the runs stay on the pixel grid
+	std::vector<uint8_t> mask(pixels);
+	for (uint32_t k = 1; k < maxSamples; k++)
+	{
+		uint64_t active = 0;
+		for (size_t p = 0; p < pixels; p++)
+		{
+			mask[p] = extraSamples[p] >= k;
+			active += mask[p];
+		}
+
+		if (active == 0)
+			break;
+
+		double offsetX, offsetY;
+		GetSampleOffset(k, offsetX, offsetY);
+		renderer.SetSampleOffset(offsetX, offsetY);
+		renderer.RenderMasked(view, buffer, x, y, w, h, mask);
+		accumulate(buffer, &mask);
+		stats.samples += active;
+	}
+
+	renderer.SetSampleOffset(0, 0);
+	renderer.SetDistanceEstimation(distance);
+
+	rgb.resize(pixels * 3);
+	for (size_t p = 0; p < pixels; p++)
+	{
+		uint32_t n = 1 + extraSamples[p];
+		for (int c = 0; c < 3; c++)
+			rgb[3 * p + c] = (uint8_t)((sums[3 * p + c] + n / 2) / n);
+	}
+
+	return stats;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "CpuRenderer.h"
+#include "IterationBuffer.h"
+#include "Palette.h"
+
+#include <cstdint>
+#include <vector>
+
+// Anti aliasing guided by the distance estimates. A pixel whose footprint
+// is further from the set than a pixel has no boundary inside it and only
+// takes its center sample. Closer pixels take more samples the closer
+// they are, so they collect along the filaments.
+struct SamplingOptions
+{
+	// Samples per pixel at most, the center one included
+	uint32_t maxSamples = 16;
+	// Off samples every pixel maxSamples times
+	bool adaptive = true;
+	// Pixels estimated at least this many pixels away take no extra samples
+	float distanceLimit = 1.0f;
+};
+
+struct SamplingStats
+{
+	// Of all pixels, the center samples included
+	uint64_t samples = 0;
+	// Pixels that took extra samples
+	uint64_t sampledPixels = 0;
+	// Pixels inside a disc that another pixel's distance proved empty, they
+	// were not looked at on their own
+	uint64_t filledPixels = 0;
+};
+
+// Offset of extra sample i >= 1 from the pixel center, in [-0.5, 0.5)
+// pixels. Follows the R2 sequence, so the first samples of a pixel are
+// already spread over it.
+void GetSampleOffset(uint32_t sample, double& x, double& y);
+
+// Extra samples of every pixel of a buffer rendered with distance
+// estimation. The estimate is at most about twice the distance, so half of
+// it is a radius with no boundary inside: a disc of pixels that fit into
+// it is filled with 0 at once. Interior pixels take every sample when an
+// exterior one touches them and none otherwise.
+SamplingStats PlanSamples(const IterationBuffer& buffer, int maxIters, const SamplingOptions& options, std::vector<uint8_t>& extraSamples);
+
+// Renders the region (x, y, w, h) of the view with up to maxSamples per
+// pixel and writes the average of the samples' colors as packed 8 bit RGB.
+// colors has to be prepared for the view's maxIters. Turns the renderer's
+// distance estimation on for the center samples and leaves it as it was.
+SamplingStats RenderAntialiased(CpuRenderer& renderer, const RenderView& view, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+	const CpuColorFunction& colors, const SamplingOptions& options, std::vector<uint8_t>& rgb);
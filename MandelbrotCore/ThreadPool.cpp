@@ -0,0 +1,196 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	// Queue the thread took its current job from
+	thread_local size_t t_queue = 0;
+	// Set while a ParallelFor job is timed, nested ones are part of it
+	thread_local bool t_timed = false;
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+	: m_queued(0)
+	, m_next(0)
+	, m_stop(false)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// One extra queue for jobs pushed by threads outside the pool
+	for (size_t i = 0; i < threadCount + 1; i++)
+		m_queues.push_back(std::make_unique<Queue>());
+
+	for (size_t i = 0; i < threadCount; i++)
+		m_threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& t : m_threads)
+		t.join();
+}
+
+bool ThreadPool::TryPop(size_t index, Job& job)
+{
+	Queue& q = *m_queues[index];
+	std::lock_guard<std::mutex> lock(q.mutex);
+	if (q.jobs.empty())
+		return false;
+
+	job = std::move(q.jobs.back());
+	q.jobs.pop_back();
+	return true;
+}
+
+bool ThreadPool::TrySteal(size_t index, Job& job)
+{
+	for (size_t i = 1; i < m_queues.size(); i++)
+	{
+		Queue& q = *m_queues[(index + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.jobs.empty())
+			continue;
+
+		job = std::move(q.jobs.front());
+		q.jobs.pop_front();
+		return true;
+	}
+	return false;
+}
+
+bool ThreadPool::RunOne(size_t index)
+{
+	Job job;
+	if (!TryPop(index, job) && !TrySteal(index, job))
+		return false;
+
+	m_queued--;
+	t_queue = index;
+	job();
+	return true;
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+	while (true)
+	{
+		if (RunOne(index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+		if (m_stop && m_queued == 0)
+			return;
+	}
+}
+
+void ThreadPool::Submit(Job job)
+{
+	size_t index = m_next++ % m_queues.size();
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queued++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+		m_queues[index]->jobs.push_back(std::move(job));
+	}
+	m_wake.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+	if (count == 0)
+		return;
+
+	// Jobs share ownership, the last one may still be notifying after the
+	// wait below saw remaining reach 0 and returned
+	struct State
+	{
+		std::atomic<size_t> remaining;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	auto state = std::make_shared<State>();
+	state->remaining = count;
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queued += count;
+	}
+
+	// Hand every queue a contiguous run of indices so neighbouring tiles stay
+	// on one thread; stealing takes care of the uneven ones.
+	size_t queueCount = m_queues.size();
+	for (size_t q = 0; q < queueCount; q++)
+	{
+		size_t begin = count * q / queueCount;
+		size_t end = count * (q + 1) / queueCount;
+		if (begin == end)
+			continue;
+
+		std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+		for (size_t i = begin; i < end; i++)
+		{
+			m_queues[q]->jobs.push_back([this, i, &func, state]()
+			{
+				// Counted before the job reports done, so the time is in
+				// once ParallelFor returns
+				if (t_timed)
+				{
+					func(i);
+				}
+				else
+				{
+					size_t queue = t_queue;
+					auto start = std::chrono::steady_clock::now();
+					t_timed = true;
+					func(i);
+					t_timed = false;
+					m_queues[queue]->busy += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				}
+
+				if (--state->remaining == 0)
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->done.notify_all();
+				}
+			});
+		}
+	}
+	m_wake.notify_all();
+
+	// Help out instead of idling, this also keeps nested calls from deadlocking
+	size_t self = m_queues.size() - 1;
+	while (state->remaining > 0)
+	{
+		if (RunOne(self))
+			continue;
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->done.wait_for(lock, std::chrono::milliseconds(1), [&state]() { return state->remaining == 0; });
+	}
+}
+
+std::vector<double> ThreadPool::GetBusyTimes() const
+{
+	std::vector<double> times;
+	for (const auto& q : m_queues)
+		times.push_back(q->busy * 1e-9);
+	return times;
+}
+
+void ThreadPool::ResetBusyTimes()
+{
+	for (auto& q : m_queues)
+		q->busy = 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker owns a deque, pops from its back and
+// steals from the front of the others when it runs dry.
+class ThreadPool
+{
+public:
+	using Job = std::function<void()>;
+
+private:
+	struct Queue
+	{
+		std::deque<Job> jobs;
+		std::mutex mutex;
+		// Nanoseconds spent in ParallelFor jobs taken by the queue's thread
+		std::atomic<int64_t> busy{ 0 };
+	};
+
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	std::atomic<size_t> m_queued;
+	std::atomic<size_t> m_next;
+	bool m_stop;
+
+	bool TryPop(size_t index, Job& job);
+	bool TrySteal(size_t index, Job& job);
+	bool RunOne(size_t index);
+	void WorkerLoop(size_t index);
+
+public:
+	// threadCount == 0 uses every hardware thread
+	ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void Submit(Job job);
+
+	// Runs func(0) ... func(count - 1) and returns once all of them finished.
+	// The calling thread helps, so it is safe to call from inside a job.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+	size_t GetThreadCount() const { return m_threads.size(); }
+
+	// Seconds every worker spent running ParallelFor jobs since the last
+	// reset, then the time of the threads that helped from outside the
+	// pool. A job that waits on nested ones is counted once.
+	std::vector<double> GetBusyTimes() const;
+	void ResetBusyTimes();
+};
@@ -0,0 +1,210 @@
+#include "TileCache.h"
+
+#include <cmath>
+#include <cstring>
+
+size_t TileKeyHash::operator()(const TileKey& key) const
+{
+	uint64_t h = (uint64_t)key.x * 0x9E3779B97F4A7C15ull;
+	h ^= (uint64_t)key.y * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+	h ^= (uint64_t)(uint32_t)key.level * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+	h ^= (uint64_t)(uint32_t)key.maxIters + (h << 6) + (h >> 2);
+	h ^= (uint64_t)key.interiorChecks + (h << 6) + (h >> 2);
+	return (size_t)h;
+}
+
+TileCache::TileCache(size_t memoryLimit)
+	: m_memoryLimit(memoryLimit)
+{
+}
+
+void TileCache::SetMemoryLimit(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_memoryLimit = bytes;
+	Trim();
+}
+
+bool TileCache::EnableSpill(const std::string& path, size_t fileBytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_spillEntries.clear();
+	m_spillIndex.clear();
+	m_freeSlots.clear();
+
+	size_t slots = fileBytes / TileBytes;
+	if (slots == 0 || !m_spill.Create(path, slots * TileBytes))
+		return false;
+
+	// Handed out from the back, so the file fills from its start
+	for (size_t i = slots; i > 0; i--)
+		m_freeSlots.push_back(i - 1);
+	return true;
+}
+
+void TileCache::DisableSpill()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats.evictions += m_spillEntries.size();
+	m_spillEntries.clear();
+	m_spillIndex.clear();
+	m_freeSlots.clear();
+	m_spill.Close();
+}
+
+bool TileCache::Find(const TileKey& key, IterationBuffer& tile)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_index.find(key);
+	if (it != m_index.end())
+	{
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		tile = it->second->tile;
+		m_stats.hits++;
+		return true;
+	}
+
+	auto spilled = m_spillIndex.find(key);
+	if (spilled != m_spillIndex.end())
+	{
+		Unspill(spilled->second, tile);
+		InsertLocked(key, tile);
+		m_stats.hits++;
+		m_stats.spillHits++;
+		return true;
+	}
+
+	m_stats.misses++;
+	return false;
+}
+
+bool TileCache::Contains(const TileKey& key) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_index.count(key) > 0 || m_spillIndex.count(key) > 0;
+}
+
+void TileCache::Insert(const TileKey& key, const IterationBuffer& tile)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_index.find(key);
+	if (it != m_index.end())
+	{
+		it->second->tile = tile;
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		return;
+	}
+
+	auto spilled = m_spillIndex.find(key);
+	if (spilled != m_spillIndex.end())
+	{
+		m_freeSlots.push_back(spilled->second->slot);
+		m_spillEntries.erase(spilled->second);
+		m_spillIndex.erase(spilled);
+	}
+
+	InsertLocked(key, tile);
+}
+
+void TileCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+	m_index.clear();
+	for (const SpillEntry& entry : m_spillEntries)
+		m_freeSlots.push_back(entry.slot);
+	m_spillEntries.clear();
+	m_spillIndex.clear();
+}
+
+TileCacheStats TileCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	TileCacheStats stats = m_stats;
+	stats.memoryTiles = m_entries.size();
+	stats.spillTiles = m_spillEntries.size();
+	return stats;
+}
+
+double TileCache::GetLevelPixelSize(int level)
+{
+	return std::exp2(-(double)level / LevelsPerOctave);
+}
+
+bool TileCache::FindLevel(double pixelSize, int& level)
+{
+	if (!(pixelSize > 0))
+		return false;
+
+	double exact = -std::log2(pixelSize) * LevelsPerOctave;
+	if (std::abs(exact) > 1e6)
+		return false;
+
+	int nearest = (int)std::lround(exact);
+	if (std::abs(pixelSize / GetLevelPixelSize(nearest) - 1.0) > 1e-9)
+		return false;
+
+	level = nearest;
+	return true;
+}
+
+void TileCache::InsertLocked(const TileKey& key, IterationBuffer tile)
+{
+	m_entries.push_front({ key, std::move(tile) });
+	m_index[key] = m_entries.begin();
+	Trim();
+}
+
+void TileCache::Trim()
+{
+	while (!m_entries.empty() && m_entries.size() * TileBytes > m_memoryLimit)
+	{
+		Entry& oldest = m_entries.back();
+		if (m_spill.IsOpen())
+			Spill(oldest);
+		else
+			m_stats.evictions++;
+
+		m_index.erase(oldest.key);
+		m_entries.pop_back();
+	}
+}
+
+void TileCache::Spill(Entry& entry)
+{
+	if (m_freeSlots.empty())
+	{
+		// The file is full, its oldest tile makes room
+		SpillEntry& oldest = m_spillEntries.back();
+		m_freeSlots.push_back(oldest.slot);
+		m_spillIndex.erase(oldest.key);
+		m_spillEntries.pop_back();
+		m_stats.evictions++;
+	}
+
+	size_t slot = m_freeSlots.back();
+	m_freeSlots.pop_back();
+
+	size_t count = (size_t)TileSize * TileSize;
+	uint8_t* data = m_spill.GetWritableData() + slot * TileBytes;
+	std::memcpy(data, entry.tile.GetRow(0), count * sizeof(uint32_t));
+	std::memcpy(data + count * sizeof(uint32_t), entry.tile.GetSmoothRow(0), count * sizeof(float));
+
+	m_spillEntries.push_front({ entry.key, slot });
+	m_spillIndex[entry.key] = m_spillEntries.begin();
+}
+
+void TileCache::Unspill(std::list<SpillEntry>::iterator it, IterationBuffer& tile)
+{
+	size_t count = (size_t)TileSize * TileSize;
+	const uint8_t* data = m_spill.GetData() + it->slot * TileBytes;
+	tile.Resize(TileSize, TileSize);
+	std::memcpy(tile.GetRow(0), data, count * sizeof(uint32_t));
+	std::memcpy(tile.GetSmoothRow(0), data + count * sizeof(uint32_t), count * sizeof(float));
+
+	m_freeSlots.push_back(it->slot);
+	m_spillIndex.erase(it->key);
+	m_spillEntries.erase(it);
+}
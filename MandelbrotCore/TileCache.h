@@ -0,0 +1,113 @@
+#pragma once
+
+#include "IterationBuffer.h"
+#include "MappedFile.h"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A tile of a zoom level's pixel grid. Level L has pixels 2^(-L / 8) wide
+// and pixel (0, 0) has its top left corner at the origin, so tile (x, y)
+// covers the pixels x * TileSize ... and y * TileSize ... counting right
+// and down. Periodicity checking can change a tile, so tiles rendered with
+// and without the interior checks are kept apart.
+struct TileKey
+{
+	int level;
+	int64_t x;
+	int64_t y;
+	int maxIters;
+	bool interiorChecks;
+
+	bool operator==(const TileKey& other) const
+	{
+		return level == other.level && x == other.x && y == other.y && maxIters == other.maxIters && interiorChecks == other.interiorChecks;
+	}
+};
+
+struct TileKeyHash
+{
+	size_t operator()(const TileKey& key) const;
+};
+
+struct TileCacheStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	// Hits that had to be read back from the spill file
+	uint64_t spillHits = 0;
+	// Tiles dropped for good, spilling does not count
+	uint64_t evictions = 0;
+	size_t memoryTiles = 0;
+	size_t spillTiles = 0;
+};
+
+// Iteration data of tiles already rendered, least recently used ones go
+// first once the memory limit is reached. With a spill file they move
+// there instead and only leave the cache when the file is full too.
+// Every method locks, tiles can be looked up from render jobs.
+class TileCache
+{
+public:
+	static constexpr uint32_t TileSize = 64;
+	static constexpr int LevelsPerOctave = 8;
+	static constexpr size_t TileBytes = (size_t)TileSize * TileSize * (sizeof(uint32_t) + sizeof(float));
+
+private:
+	struct Entry
+	{
+		TileKey key;
+		IterationBuffer tile;
+	};
+
+	struct SpillEntry
+	{
+		TileKey key;
+		size_t slot;
+	};
+
+	// Most recently used first
+	std::list<Entry> m_entries;
+	std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> m_index;
+	size_t m_memoryLimit;
+
+	MappedFile m_spill;
+	std::list<SpillEntry> m_spillEntries;
+	std::unordered_map<TileKey, std::list<SpillEntry>::iterator, TileKeyHash> m_spillIndex;
+	std::vector<size_t> m_freeSlots;
+
+	TileCacheStats m_stats;
+	mutable std::mutex m_mutex;
+
+	void Trim();
+	void Spill(Entry& entry);
+	void Unspill(std::list<SpillEntry>::iterator it, IterationBuffer& tile);
+	void InsertLocked(const TileKey& key, IterationBuffer tile);
+
+public:
+	TileCache(size_t memoryLimit = (size_t)256 << 20);
+
+	void SetMemoryLimit(size_t bytes);
+	size_t GetMemoryLimit() const { return m_memoryLimit; }
+
+	// Tiles evicted from memory go to a memory mapped file of up to
+	// fileBytes instead of being dropped. The file starts over empty.
+	bool EnableSpill(const std::string& path, size_t fileBytes);
+	void DisableSpill();
+	bool IsSpillEnabled() const { return m_spill.IsOpen(); }
+
+	// Copies the tile into a TileSize x TileSize buffer
+	bool Find(const TileKey& key, IterationBuffer& tile);
+	bool Contains(const TileKey& key) const;
+	void Insert(const TileKey& key, const IterationBuffer& tile);
+	void Clear();
+
+	TileCacheStats GetStats() const;
+
+	static double GetLevelPixelSize(int level);
+	// The level whose pixels are pixelSize wide, if there is one
+	static bool FindLevel(double pixelSize, int& level);
+};